@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bt_config.h"
+#include "hci.h"
+
+#define ACCEPT_LIST_SIZE BT_ACCEPT_LIST_SIZE /**< Devices the mirror holds, see bt_config.h */
+
+/**
+ * @brief   Sync state of one accept list entry
+ */
+typedef enum {
+  ACCEPT_ENTRY_FREE,           /**< Slot unused */
+  ACCEPT_ENTRY_ADD_PENDING,    /**< Wanted, not yet in the controller */
+  ACCEPT_ENTRY_SYNCED,         /**< Wanted and in the controller */
+  ACCEPT_ENTRY_REMOVE_PENDING  /**< In the controller, no longer wanted */
+} AcceptEntryState;
+
+/**
+ * @brief   One device of the accept list mirror
+ */
+typedef struct {
+  uint8_t state;     /**< AcceptEntryState */
+  uint8_t addr_type; /**< Conn_PeerAddressType, public or random */
+  uint8_t addr[6];   /**< Device address */
+} AcceptListEntry;
+
+/**
+ * @brief   Empty the controller's accept list and learn its size
+ * @return  HCIError Indicates the success or failure of the controller commands
+ * @details Called by HCI_init, the mirror starts out matching an empty controller list
+ */
+HCIError ACCEPT_LIST_init(void);
+
+/**
+ * @brief   Add a device to the accept list
+ * @param   addr_type Conn_PeerAddressType of the device
+ * @param   addr Device address
+ * @return  bool false if the list is full
+ * @details Only changes the mirror, ACCEPT_LIST_sync sends the difference to the controller
+ */
+bool ACCEPT_LIST_add(uint8_t addr_type, const uint8_t *addr);
+
+/**
+ * @brief   Remove a device from the accept list
+ * @param   addr_type Conn_PeerAddressType of the device
+ * @param   addr Device address
+ * @return  bool false if the device is not in the list
+ * @details Only changes the mirror, ACCEPT_LIST_sync sends the difference to the controller
+ */
+bool ACCEPT_LIST_remove(uint8_t addr_type, const uint8_t *addr);
+
+/**
+ * @brief   Remove every device from the accept list
+ * @details Only changes the mirror, ACCEPT_LIST_sync sends the difference to the controller
+ */
+void ACCEPT_LIST_clear(void);
+
+/**
+ * @brief   Check whether a device is in the accept list
+ * @param   addr_type Conn_PeerAddressType of the device
+ * @param   addr Device address
+ * @return  bool true if the device is wanted, whether or not it reached the controller yet
+ */
+bool ACCEPT_LIST_contains(uint8_t addr_type, const uint8_t *addr);
+
+/**
+ * @brief   Get the number of devices in the accept list
+ * @return  uint8_t Devices wanted in the list
+ */
+uint8_t ACCEPT_LIST_count(void);
+
+/**
+ * @brief   Get the number of devices the accept list can hold
+ * @return  uint8_t The smaller of ACCEPT_LIST_SIZE and the controller's list size
+ */
+uint8_t ACCEPT_LIST_capacity(void);
+
+/**
+ * @brief   Check whether the mirror differs from the controller
+ * @return  bool true if ACCEPT_LIST_sync has work to do
+ */
+bool ACCEPT_LIST_dirty(void);
+
+/**
+ * @brief   Send the changes since the last sync to the controller
+ * @return  HCIError Indicates the success or failure of the changes
+ * @details Removals go out before additions so a full controller list has room. The commands are
+ * pipelined as deep as the controller's command credits allow, then the call waits for all of them.
+ * The controller rejects changes while scanning, advertising or initiating uses the list, GAP syncs
+ * before it starts any of them. Never call from interrupt context.
+ */
+HCIError ACCEPT_LIST_sync(void);
+
+/**
+ * @brief   Consume the completion of an accept list command
+ * @param   op_code Command the completion belongs to
+ * @param   status Status of the command
+ * @param   return_parameters Return parameters after the status
+ * @param   length Length of the return parameters
+ * @return  bool true if the completion belonged to a command sent by this module
+ * @details Called by the command complete handler in interrupt context
+ */
+bool ACCEPT_LIST_handle_command_complete(uint16_t op_code, uint8_t status, uint8_t *return_parameters,
+                                         uint8_t length);
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Payload of legacy advertising data and of a legacy scan response */
+#define AD_MAX_DATA_LENGTH 31
+
+/** Room a builder has for AD structures, advertising data plus scan response */
+#define AD_BUILDER_SIZE (2 * AD_MAX_DATA_LENGTH)
+
+/* Flags values */
+#define AD_FLAG_LE_LIMITED_DISCOVERABLE 0x01
+#define AD_FLAG_LE_GENERAL_DISCOVERABLE 0x02
+#define AD_FLAG_BR_EDR_NOT_SUPPORTED 0x04
+
+/**
+ * @brief   AD types used in advertising and scan response data
+ */
+typedef enum {
+  AD_TYPE_FLAGS = 0x01,                   /**< Flags */
+  AD_TYPE_INCOMPLETE_UUID16 = 0x02,       /**< Incomplete list of 16-bit service UUIDs */
+  AD_TYPE_COMPLETE_UUID16 = 0x03,         /**< Complete list of 16-bit service UUIDs */
+  AD_TYPE_INCOMPLETE_UUID32 = 0x04,       /**< Incomplete list of 32-bit service UUIDs */
+  AD_TYPE_COMPLETE_UUID32 = 0x05,         /**< Complete list of 32-bit service UUIDs */
+  AD_TYPE_INCOMPLETE_UUID128 = 0x06,      /**< Incomplete list of 128-bit service UUIDs */
+  AD_TYPE_COMPLETE_UUID128 = 0x07,        /**< Complete list of 128-bit service UUIDs */
+  AD_TYPE_SHORTENED_NAME = 0x08,          /**< Shortened local name */
+  AD_TYPE_COMPLETE_NAME = 0x09,           /**< Complete local name */
+  AD_TYPE_TX_POWER_LEVEL = 0x0A,          /**< TX power level */
+  AD_TYPE_SERVICE_DATA_UUID16 = 0x16,     /**< Service data with a 16-bit UUID */
+  AD_TYPE_APPEARANCE = 0x19,              /**< Appearance */
+  AD_TYPE_MANUFACTURER_DATA = 0xFF        /**< Manufacturer specific data */
+} ADType;
+
+/**
+ * @brief   One AD structure, pointing into the advertising data it was found in
+ */
+typedef struct {
+  uint8_t type;        /**< ADType */
+  uint8_t length;      /**< Length of data, without the type byte */
+  const uint8_t *data; /**< AD data, not a copy */
+} ADStructure;
+
+/**
+ * @brief   Position in a block of advertising data
+ */
+typedef struct {
+  const uint8_t *data; /**< Advertising data being walked */
+  uint16_t length;     /**< Length of the advertising data */
+  uint16_t offset;     /**< Offset of the next AD structure */
+} ADIterator;
+
+/**
+ * @brief   Start walking a block of advertising data
+ * @param   it Iterator to initialize
+ * @param   data Advertising or scan response data
+ * @param   length Length of the data
+ */
+void AD_iterator_init(ADIterator *it, const uint8_t *data, uint16_t length);
+
+/**
+ * @brief   Get the next AD structure
+ * @param   it Iterator
+ * @param   ad Output for the AD structure
+ * @return  bool false at the end of the data or at a malformed structure
+ * @details Never copies, ad->data points into the iterated buffer. Zero length padding ends the walk.
+ */
+bool AD_next(ADIterator *it, ADStructure *ad);
+
+/**
+ * @brief   Find the first AD structure of a type
+ * @param   data Advertising data
+ * @param   length Length of the advertising data
+ * @param   type ADType to look for
+ * @param   ad Output for the AD structure
+ * @return  bool true if found
+ */
+bool AD_find(const uint8_t *data, uint16_t length, uint8_t type, ADStructure *ad);
+
+/**
+ * @brief   Get the advertised flags
+ * @param   data Advertising data
+ * @param   length Length of the advertising data
+ * @param   flags Output for the flags byte
+ * @return  bool true if the data carries flags
+ */
+bool AD_get_flags(const uint8_t *data, uint16_t length, uint8_t *flags);
+
+/**
+ * @brief   Get the advertised local name
+ * @param   data Advertising data
+ * @param   length Length of the advertising data
+ * @param   name Output pointer to the name, not NUL terminated
+ * @param   name_length Output for the length of the name
+ * @return  bool true if the data carries a complete or shortened name
+ */
+bool AD_get_name(const uint8_t *data, uint16_t length, const uint8_t **name, uint8_t *name_length);
+
+/**
+ * @brief   Check whether a 16-bit service UUID is advertised
+ * @param   data Advertising data
+ * @param   length Length of the advertising data
+ * @param   uuid Service UUID
+ * @return  bool true if the UUID is in a complete or incomplete 16-bit UUID list
+ */
+bool AD_has_service_uuid16(const uint8_t *data, uint16_t length, uint16_t uuid);
+
+/**
+ * @brief   Get the manufacturer specific data
+ * @param   data Advertising data
+ * @param   length Length of the advertising data
+ * @param   company_id Output for the Bluetooth SIG company identifier
+ * @param   payload Output pointer to the data after the company identifier
+ * @param   payload_length Output for the length of the payload
+ * @return  bool true if the data carries manufacturer specific data
+ */
+bool AD_get_manufacturer_data(const uint8_t *data, uint16_t length, uint16_t *company_id, const uint8_t **payload,
+                              uint8_t *payload_length);
+
+/**
+ * @brief   AD structures collected for advertising, in the order they should be placed
+ */
+typedef struct {
+  uint8_t buffer[AD_BUILDER_SIZE]; /**< Encoded AD structures */
+  uint8_t length;                  /**< Bytes used */
+} ADBuilder;
+
+/**
+ * @brief   Encoded legacy advertising data and scan response
+ */
+typedef struct {
+  uint8_t adv_data[AD_MAX_DATA_LENGTH];      /**< Advertising data */
+  uint8_t adv_data_length;                   /**< Length of the advertising data */
+  uint8_t scan_rsp_data[AD_MAX_DATA_LENGTH]; /**< Scan response data */
+  uint8_t scan_rsp_data_length;              /**< Length of the scan response data */
+} ADPayload;
+
+/**
+ * @brief   Start an empty builder
+ * @param   builder Builder to initialize
+ */
+void AD_builder_init(ADBuilder *builder);
+
+/**
+ * @brief   Add an AD structure
+ * @param   builder Builder to extend
+ * @param   type ADType
+ * @param   data AD data, may be NULL if length is 0
+ * @param   length Length of the AD data, at most AD_MAX_DATA_LENGTH - 2
+ * @return  bool false if the structure does not fit
+ */
+bool AD_builder_add(ADBuilder *builder, uint8_t type, const uint8_t *data, uint8_t length);
+
+/**
+ * @brief   Add the flags
+ * @param   builder Builder to extend
+ * @param   flags AD_FLAG_* bits
+ * @return  bool false if the structure does not fit
+ * @details Flags are only allowed in advertising data, add them first
+ */
+bool AD_builder_add_flags(ADBuilder *builder, uint8_t flags);
+
+/**
+ * @brief   Add the complete local name
+ * @param   builder Builder to extend
+ * @param   name Name, not NUL terminated
+ * @param   length Length of the name
+ * @return  bool false if the structure does not fit
+ * @details A name longer than the space left at encoding time is sent as a shortened name
+ */
+bool AD_builder_add_name(ADBuilder *builder, const char *name, uint8_t length);
+
+/**
+ * @brief   Add a complete list of 16-bit service UUIDs
+ * @param   builder Builder to extend
+ * @param   uuids Service UUIDs
+ * @param   count Number of UUIDs
+ * @return  bool false if the structure does not fit
+ */
+bool AD_builder_add_uuid16_list(ADBuilder *builder, const uint16_t *uuids, uint8_t count);
+
+/**
+ * @brief   Add a complete list holding one 128-bit service UUID
+ * @param   builder Builder to extend
+ * @param   uuid Service UUID, little endian as sent on air
+ * @return  bool false if the structure does not fit
+ */
+bool AD_builder_add_uuid128(ADBuilder *builder, const uint8_t *uuid);
+
+/**
+ * @brief   Add service data for a 16-bit service UUID
+ * @param   builder Builder to extend
+ * @param   uuid Service UUID
+ * @param   data Service data
+ * @param   length Length of the service data
+ * @return  bool false if the structure does not fit
+ */
+bool AD_builder_add_service_data16(ADBuilder *builder, uint16_t uuid, const uint8_t *data, uint8_t length);
+
+/**
+ * @brief   Add manufacturer specific data
+ * @param   builder Builder to extend
+ * @param   company_id Bluetooth SIG company identifier
+ * @param   data Data after the company identifier
+ * @param   length Length of the data
+ * @return  bool false if the structure does not fit
+ */
+bool AD_builder_add_manufacturer_data(ADBuilder *builder, uint16_t company_id, const uint8_t *data, uint8_t length);
+
+/**
+ * @brief   Split the collected AD structures into advertising data and scan response
+ * @param   builder Builder holding the AD structures
+ * @param   payload Output for the encoded data
+ * @return  bool false if the structures do not fit both
+ * @details Structures are placed in the order they were added. Each goes into the advertising data if
+ * it fits and into the scan response otherwise, so the first ones added are seen by passive scanners.
+ * Flags never go into the scan response.
+ */
+bool AD_builder_encode(const ADBuilder *builder, ADPayload *payload);
+
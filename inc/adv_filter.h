@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bt_config.h"
+
+#define ADV_FILTER_MAX_RULES BT_ADV_FILTER_MAX_RULES       /**< Rules per filter, see bt_config.h */
+#define ADV_FILTER_MAX_MATCHERS (2 * ADV_FILTER_MAX_RULES) /**< A rule matches at most two AD types */
+#define ADV_FILTER_MAX_GROUPS 8                            /**< Groups per filter */
+#define ADV_FILTER_PATTERN_POOL_SIZE 128                   /**< Bytes for UUIDs and prefixes of all rules */
+#define ADV_FILTER_NO_RSSI_LIMIT (-128)                    /**< rssi_min of groups without an RSSI rule */
+
+/**
+ * @brief   How a matcher compares an AD structure with its pattern
+ */
+typedef enum {
+  ADV_FILTER_OP_PREFIX, /**< AD data starts with the pattern */
+  ADV_FILTER_OP_ELEMENT /**< AD data is a list of pattern-sized elements, one of them equals the pattern */
+} AdvFilterOp;
+
+/**
+ * @brief   One compiled test against AD structures of a single type
+ */
+typedef struct {
+  uint8_t ad_type;        /**< ADType the matcher applies to */
+  uint8_t op;             /**< AdvFilterOp */
+  uint8_t rule;           /**< Bit of the rule the matcher satisfies */
+  uint8_t pattern_offset; /**< Pattern position in the pattern pool */
+  uint8_t pattern_length; /**< Pattern length */
+} AdvFilterMatcher;
+
+/**
+ * @brief   Compiled advertising filter
+ * @details Rules are compiled as they are added. Rules in the same group must all match, a report passes
+ * if any group matches. A filter without rules passes every report.
+ */
+typedef struct {
+  uint32_t ad_types[8];                              /**< Bitmap of AD types some matcher looks at */
+  AdvFilterMatcher matchers[ADV_FILTER_MAX_MATCHERS]; /**< Matchers sorted by AD type */
+  uint8_t matcher_count;                             /**< Matchers in use */
+  uint8_t rule_count;                                /**< Rules added */
+  uint8_t groups;                                    /**< Bit per group that has at least one rule */
+  uint32_t group_rules[ADV_FILTER_MAX_GROUPS];       /**< AD rule bits each group needs */
+  int8_t rssi_min[ADV_FILTER_MAX_GROUPS];            /**< Lowest RSSI in dBm each group accepts */
+  uint8_t patterns[ADV_FILTER_PATTERN_POOL_SIZE];    /**< UUIDs and prefixes, little endian as sent on air */
+  uint8_t pattern_used;                              /**< Bytes of the pattern pool in use */
+} AdvFilter;
+
+/**
+ * @brief   Initialize an empty filter
+ * @param   filter Filter to initialize
+ */
+void ADV_FILTER_init(AdvFilter *filter);
+
+/**
+ * @brief   Require a 16-bit service UUID
+ * @param   filter Filter to extend
+ * @param   group Rule group, 0 to ADV_FILTER_MAX_GROUPS - 1
+ * @param   uuid Service UUID, matched in complete and incomplete UUID lists
+ * @return  bool false if the filter is full or the group is invalid
+ */
+bool ADV_FILTER_add_uuid16(AdvFilter *filter, uint8_t group, uint16_t uuid);
+
+/**
+ * @brief   Require a 128-bit service UUID
+ * @param   filter Filter to extend
+ * @param   group Rule group, 0 to ADV_FILTER_MAX_GROUPS - 1
+ * @param   uuid Service UUID, little endian as sent on air
+ * @return  bool false if the filter is full or the group is invalid
+ */
+bool ADV_FILTER_add_uuid128(AdvFilter *filter, uint8_t group, const uint8_t *uuid);
+
+/**
+ * @brief   Require manufacturer specific data
+ * @param   filter Filter to extend
+ * @param   group Rule group, 0 to ADV_FILTER_MAX_GROUPS - 1
+ * @param   company_id Bluetooth SIG company identifier
+ * @param   prefix Bytes the data after the company identifier must start with, may be NULL
+ * @param   prefix_length Length of the prefix
+ * @return  bool false if the filter is full or the group is invalid
+ */
+bool ADV_FILTER_add_manufacturer(AdvFilter *filter, uint8_t group, uint16_t company_id, const uint8_t *prefix,
+                                 uint8_t prefix_length);
+
+/**
+ * @brief   Require a local name prefix
+ * @param   filter Filter to extend
+ * @param   group Rule group, 0 to ADV_FILTER_MAX_GROUPS - 1
+ * @param   prefix Bytes the complete or shortened name must start with
+ * @param   prefix_length Length of the prefix
+ * @return  bool false if the filter is full or the group is invalid
+ */
+bool ADV_FILTER_add_name_prefix(AdvFilter *filter, uint8_t group, const uint8_t *prefix, uint8_t prefix_length);
+
+/**
+ * @brief   Require an AD structure starting with arbitrary bytes
+ * @param   filter Filter to extend
+ * @param   group Rule group, 0 to ADV_FILTER_MAX_GROUPS - 1
+ * @param   ad_type ADType to look at
+ * @param   prefix Bytes the AD data must start with, may be NULL to only require the type
+ * @param   prefix_length Length of the prefix
+ * @return  bool false if the filter is full or the group is invalid
+ */
+bool ADV_FILTER_add_ad_prefix(AdvFilter *filter, uint8_t group, uint8_t ad_type, const uint8_t *prefix,
+                              uint8_t prefix_length);
+
+/**
+ * @brief   Require a minimum signal strength
+ * @param   filter Filter to extend
+ * @param   group Rule group, 0 to ADV_FILTER_MAX_GROUPS - 1
+ * @param   rssi_min Lowest accepted RSSI in dBm, reports without a measurement never pass
+ * @return  bool false if the group is invalid
+ * @details Checked before the AD structures are looked at, and does not take a rule slot
+ */
+bool ADV_FILTER_add_rssi_min(AdvFilter *filter, uint8_t group, int8_t rssi_min);
+
+/**
+ * @brief   Run a filter on one advertising report
+ * @param   filter Compiled filter
+ * @param   data Advertising or scan response data
+ * @param   data_len Length of the data
+ * @param   rssi RSSI of the report in dBm
+ * @return  bool true if the report passes
+ * @details Groups failing their RSSI limit are dropped first. The AD structures are then walked once,
+ * structures of types no rule mentions are skipped through a bitmap test, and the walk stops as soon
+ * as one group is satisfied.
+ */
+bool ADV_FILTER_match(const AdvFilter *filter, const uint8_t *data, uint16_t data_len, int8_t rssi);
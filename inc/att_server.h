@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bt_config.h"
+#include "gatt.h"
+
+#define ATT_ERROR_RESPONSE_SIZE 5        /**< Opcode + request opcode + handle + error code */
+#define ATT_UUID16_SIZE 2                /**< Bytes of a 16-bit UUID on the air */
+#define ATT_UUID128_SIZE 16              /**< Bytes of a 128-bit UUID on the air */
+#define ATT_FIND_INFO_FORMAT_UUID16 0x01 /**< Find Information Response format with 16-bit UUIDs */
+#define ATT_COMMAND_FLAG 0x40            /**< Opcode bit of PDUs that take no response */
+
+#define ATT_CACHE_ENTRIES BT_ATT_DISCOVERY_CACHE_ENTRIES /**< Discovery responses kept pre-encoded */
+#define ATT_CACHE_SIZE BT_ATT_DISCOVERY_CACHE_SIZE       /**< Bytes for the pre-encoded discovery responses */
+
+/**
+ * @brief   Serve a client request or command against the local GATT database
+ * @param   connection_handle Connection the PDU arrived on
+ * @param   packet ATT PDU, opcode first
+ * @param   length Length of the PDU
+ * @param   callback Application callback for read and write events, may be NULL
+ * @return  bool true if the PDU was a request or command and has been handled
+ * @details Answers every request, unsupported ones with an Error Response. Responses are encoded
+ * directly into an ACL TX buffer and hold as many entries as fit the connection's ATT MTU. Runs from
+ * L2CAP_process, never from interrupt context, and so do the read and write callbacks.
+ */
+bool ATT_SERVER_handle(uint16_t connection_handle, uint8_t *packet, uint16_t length, GATTEventCallback callback);
+
+/**
+ * @brief   Pre-encode the discovery responses of the frozen local database
+ * @details Walks primary service, characteristic and descriptor discovery the way clients do, for the
+ * default MTU and for BT_ATT_PREFERRED_MTU, and keeps the responses keyed by request, starting handle and
+ * MTU. Matching requests are then answered with a single copy into the TX buffer. Any other request, or
+ * one that arrives after the database changed, is encoded as usual. Does nothing if the database is not frozen.
+ */
+void ATT_SERVER_build_discovery_cache(void);
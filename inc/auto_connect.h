@@ -0,0 +1,130 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "accept_list.h"
+#include "bt_config.h"
+#include "connection.h"
+#include "hci.h"
+
+#define AUTO_CONN_MAX_PEERS ACCEPT_LIST_SIZE /**< Peers kept connected, each takes an accept list entry */
+
+/**
+ * @brief   Reconnection statistics of one peer
+ */
+typedef struct {
+  uint16_t reconnects;       /**< Reconnections after a dropout */
+  uint32_t last_latency_ms;  /**< Time from disconnection to connection of the last reconnect */
+  uint32_t max_latency_ms;   /**< Longest reconnect */
+  uint32_t total_latency_ms; /**< Sum over all reconnects, divide by reconnects for the mean */
+} AutoConnStats;
+
+/**
+ * @brief   A peer the stack reconnects to on its own
+ */
+typedef struct {
+  bool used;                /**< Slot holds a peer */
+  bool connected;           /**< A link to the peer is up */
+  uint8_t addr_type;        /**< Conn_PeerAddressType, public or random */
+  uint8_t addr[6];          /**< Peer address */
+  uint64_t dropped_ms;      /**< When the last link went down, 0 while connected or never connected */
+  AutoConnStats stats;      /**< Reconnection statistics */
+} AutoConnPeer;
+
+/**
+ * @brief   Add a peer to keep connected
+ * @param   addr_type Conn_PeerAddressType of the peer
+ * @param   addr Peer address
+ * @return  bool false if the peer table or the accept list is full
+ * @details The peer is added to the accept list. Stack-side bonding does not exist yet, the
+ * application registers the peers it trusts.
+ */
+bool AUTO_CONN_add_peer(uint8_t addr_type, const uint8_t *addr);
+
+/**
+ * @brief   Stop reconnecting to a peer
+ * @param   addr_type Conn_PeerAddressType of the peer
+ * @param   addr Peer address
+ * @return  bool false if the peer is unknown
+ */
+bool AUTO_CONN_remove_peer(uint8_t addr_type, const uint8_t *addr);
+
+/**
+ * @brief   Enable or disable background connection initiation
+ * @param   enabled If false, a running initiation is cancelled by the next AUTO_CONN_process
+ */
+void AUTO_CONN_set_enabled(bool enabled);
+
+/**
+ * @brief   Give the radio back to the application
+ * @return  HCIError Indicates whether the initiator was released in time
+ * @details Cancels a running background initiation and waits for the controller to end it. Auto-connect
+ * stays paused until AUTO_CONN_resume. Never call from interrupt context.
+ */
+HCIError AUTO_CONN_pause(void);
+
+/**
+ * @brief   Resume background connection initiation after AUTO_CONN_pause
+ */
+void AUTO_CONN_resume(void);
+
+/**
+ * @brief   Release the initiator for a foreground connection
+ * @return  HCIError Indicates whether the initiator was released in time
+ * @details Called by GAP before it initiates. Background initiation restarts once the foreground
+ * attempt ended. Never call from interrupt context.
+ */
+HCIError AUTO_CONN_yield(void);
+
+/**
+ * @brief   Take the initiator back after a foreground attempt that never started
+ * @details Called by GAP when it fails between AUTO_CONN_yield and a Create Connection the controller
+ * accepted, since no connection complete will end that attempt. Never call from interrupt context.
+ */
+void AUTO_CONN_unyield(void);
+
+/**
+ * @brief   Get the reconnection statistics of a peer
+ * @param   addr_type Conn_PeerAddressType of the peer
+ * @param   addr Peer address
+ * @return  const AutoConnStats* Statistics, or NULL if the peer is unknown
+ */
+const AutoConnStats *AUTO_CONN_get_stats(uint8_t addr_type, const uint8_t *addr);
+
+/**
+ * @brief   Start, restart or stop background initiation
+ * @details Called by bluetooth_stack_process, never from interrupt context. While a known peer is
+ * disconnected it keeps one LE Create Connection running with the accept list as initiator filter, so
+ * whichever peer advertises first reconnects without a host round trip. For
+ * BT_AUTO_CONNECT_FAST_PERIOD_MS after a dropout the initiator scans continuously, then it drops to a
+ * low duty cycle. A running initiation is cancelled when the accept list must change.
+ */
+void AUTO_CONN_process(void);
+
+/**
+ * @brief   Track the end of a connection initiation
+ * @param   status Status of the connection complete event
+ * @param   role Conn_Role of the local device
+ * @param   addr_type Peer address type
+ * @param   addr Peer address
+ * @details Called by the HCI layer for every LE connection complete, successful or not, in interrupt
+ * context. Only central links and failed initiations end the initiator, a peripheral link or the
+ * timeout of directed advertising leaves it running.
+ */
+void AUTO_CONN_handle_connection_complete(uint8_t status, uint8_t role, uint8_t addr_type, const uint8_t *addr);
+
+/**
+ * @brief   Track a closed connection
+ * @param   context Context of the connection, still valid
+ * @details Called by the HCI layer in interrupt context
+ */
+void AUTO_CONN_handle_disconnection(ConnectionContext *context);
+
+/**
+ * @brief   Track the controller's answer to a background initiation or its cancellation
+ * @param   op_code Command the answer belongs to
+ * @param   status Status of the command
+ * @details Called by the command complete and command status handlers in interrupt context
+ */
+void AUTO_CONN_handle_command_result(uint16_t op_code, uint8_t status);
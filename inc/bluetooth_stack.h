@@ -11,3 +11,11 @@ typedef struct {
 } BluetoothAddress;
 
 void bluetooth_stack_init(void);
+
+/**
+ * @brief   Run the stack's time-driven work
+ * @details Call periodically from the main loop, never from interrupt context. Delivers connection events,
+ * serves received ATT and L2CAP PDUs, expires stalled link bring-up, adapts connection parameters to traffic, reconnects dropped
+ * peers and sends queued ACL data.
+ */
+void bluetooth_stack_process(void);
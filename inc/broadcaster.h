@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "adv_data.h"
+#include "gap.h"
+
+/** Largest telemetry value, manufacturer data in one advertising PDU next to the flags */
+#define BCAST_MAX_VALUE_LENGTH (AD_MAX_DATA_LENGTH - 3 - 4)
+
+/**
+ * @brief   Counters of the broadcaster
+ */
+typedef struct {
+  uint32_t writes;    /**< Values written by the application */
+  uint32_t sent;      /**< Set advertising data commands sent */
+  uint32_t collapsed; /**< Values overwritten before they were sent */
+  uint32_t unchanged; /**< Values not sent because the bytes on air were the same */
+} BcastStats;
+
+/**
+ * @brief   Start broadcasting telemetry in manufacturer data
+ * @param   base AD structures advertised next to the value, may be NULL for flags only
+ * @param   company_id Bluetooth SIG company identifier of the manufacturer data
+ * @param   value_length Length of the value, at most BCAST_MAX_VALUE_LENGTH
+ * @param   interval_ms Advertising interval
+ * @param   period_ms Minimum time between two advertising data updates sent to the controller
+ * @return  GAPError GAP_ERROR_INVALID_PARAMETERS if the value does not fit the advertising data
+ * @details Sets the payload with the value zeroed and starts non-connectable advertising. The
+ * manufacturer data is appended to base and must land in the advertising data. Blocks until the
+ * controller advertises, never call from interrupt context.
+ */
+GAPError BCAST_start(const ADBuilder *base, uint16_t company_id, uint8_t value_length, uint16_t interval_ms,
+                     uint16_t period_ms);
+
+/**
+ * @brief   Stop broadcasting
+ * @return  GAPError Result of stopping the advertiser
+ */
+GAPError BCAST_stop(void);
+
+/**
+ * @brief   Store the latest value
+ * @param   value Value bytes, value_length as given to BCAST_start
+ * @return  bool false if the broadcaster is not running
+ * @details Never blocks. A value not yet sent is replaced, only the latest one reaches the air.
+ * Call from the same context as bluetooth_stack_process.
+ */
+bool BCAST_write(const uint8_t *value);
+
+/**
+ * @brief   Get the broadcaster counters
+ * @param   stats Output for the counters
+ */
+void BCAST_get_stats(BcastStats *stats);
+
+/**
+ * @brief   Send the latest value once the update period elapsed
+ * @details Called from bluetooth_stack_process. At most one command is in flight, it is sent
+ * without waiting for its completion.
+ */
+void BCAST_process(void);
+
+/**
+ * @brief   Consume the completion of an advertising data update
+ * @param   op_code Command the completion belongs to
+ * @param   status Status of the command
+ * @return  bool true if the completion belonged to an update sent by this module
+ * @details Called by the command complete handler in interrupt context
+ */
+bool BCAST_handle_command_complete(uint16_t op_code, uint8_t status);
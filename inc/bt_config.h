@@ -0,0 +1,172 @@
+#pragma once
+
+/*
+ * Compile-time sizing of the bluetooth stack.
+ * Every value can be overridden from the build, e.g. CFLAGS += -DBT_MAX_CONNECTIONS=8
+ */
+
+/** Maximum number of simultaneous BLE connections */
+#ifndef BT_MAX_CONNECTIONS
+#define BT_MAX_CONNECTIONS 20
+#endif
+
+/** L2CAP PDUs that can wait in the ACL TX queues, shared by all connections */
+#ifndef BT_ACL_TX_POOL_SIZE
+#define BT_ACL_TX_POOL_SIZE (2 * BT_MAX_CONNECTIONS)
+#endif
+
+/** Maximum notification/indication/bulk PDUs a single connection may queue */
+#ifndef BT_ACL_TX_LINK_QUEUE_LIMIT
+#define BT_ACL_TX_LINK_QUEUE_LIMIT 8
+#endif
+
+/** Received L2CAP PDUs that can wait for bluetooth_stack_process, shared by all connections */
+#ifndef BT_L2CAP_RX_QUEUE_SIZE
+#define BT_L2CAP_RX_QUEUE_SIZE 8
+#endif
+
+/** Client characteristic configurations remembered per connection */
+#ifndef BT_MAX_CCCDS_PER_CONNECTION
+#define BT_MAX_CCCDS_PER_CONNECTION 8
+#endif
+
+/** Largest LE link layer payload to negotiate with Data Length Extension, 27 disables it */
+#ifndef BT_LE_MAX_DATA_LENGTH
+#define BT_LE_MAX_DATA_LENGTH 251
+#endif
+
+/** PHYs (Phy_Preference bits) requested on every new connection, 0x01 keeps links on LE 1M */
+#ifndef BT_LE_PREFERRED_PHYS
+#define BT_LE_PREFERRED_PHYS 0x03
+#endif
+
+/** ATT MTU requested on every new connection, 247 fills one 251 byte LL PDU */
+#ifndef BT_ATT_PREFERRED_MTU
+#define BT_ATT_PREFERRED_MTU 247
+#endif
+
+/** Time after which link bring-up stops waiting for the peer */
+#ifndef BT_LINK_SETUP_TIMEOUT_MS
+#define BT_LINK_SETUP_TIMEOUT_MS 2000
+#endif
+
+/** Traffic observation window of the adaptive connection parameter manager */
+#ifndef BT_CONN_PARAMS_WINDOW_MS
+#define BT_CONN_PARAMS_WINDOW_MS 1000
+#endif
+
+/** Advertisers remembered by the host scan cache, a power of two */
+#ifndef BT_SCAN_CACHE_SIZE
+#define BT_SCAN_CACHE_SIZE 64
+#endif
+
+/** Time without a report after which an advertiser is forgotten and reported as new again */
+#ifndef BT_SCAN_CACHE_MAX_AGE_MS
+#define BT_SCAN_CACHE_MAX_AGE_MS 10000
+#endif
+
+/** Rules one advertising filter can hold */
+#ifndef BT_ADV_FILTER_MAX_RULES
+#define BT_ADV_FILTER_MAX_RULES 16
+#endif
+
+/** Devices the host mirror of the controller accept list can hold */
+#ifndef BT_ACCEPT_LIST_SIZE
+#define BT_ACCEPT_LIST_SIZE 16
+#endif
+
+/** Time after a known peer drops during which auto-connect initiates with a 100 % duty cycle */
+#ifndef BT_AUTO_CONNECT_FAST_PERIOD_MS
+#define BT_AUTO_CONNECT_FAST_PERIOD_MS 30000
+#endif
+
+/** Extended advertising sets the host can run at once */
+#ifndef BT_EXT_ADV_MAX_SETS
+#define BT_EXT_ADV_MAX_SETS 4
+#endif
+
+/** Extended advertising reports reassembled at once, one per advertiser sending fragments */
+#ifndef BT_EXT_SCAN_REASSEMBLY_BUFFERS
+#define BT_EXT_SCAN_REASSEMBLY_BUFFERS 4
+#endif
+
+/** Longest reassembled extended advertising data, the core specification allows 1650 */
+#ifndef BT_EXT_SCAN_MAX_DATA_LENGTH
+#define BT_EXT_SCAN_MAX_DATA_LENGTH 1650
+#endif
+
+/** Attributes in the local GATT database, each characteristic takes two or three */
+#ifndef BT_GATT_MAX_ATTRIBUTES
+#define BT_GATT_MAX_ATTRIBUTES 64
+#endif
+
+/** Bytes shared by all characteristic values of the local GATT database */
+#ifndef BT_GATT_VALUE_ARENA_SIZE
+#define BT_GATT_VALUE_ARENA_SIZE 1024
+#endif
+
+/** Discovery responses the ATT server keeps pre-encoded for a frozen database */
+#ifndef BT_ATT_DISCOVERY_CACHE_ENTRIES
+#define BT_ATT_DISCOVERY_CACHE_ENTRIES 32
+#endif
+
+/** Bytes for the pre-encoded discovery responses, one response needs room for a full MTU while it is built */
+#ifndef BT_ATT_DISCOVERY_CACHE_SIZE
+#define BT_ATT_DISCOVERY_CACHE_SIZE 1024
+#endif
+
+#if BT_MAX_CONNECTIONS < 1 || BT_MAX_CONNECTIONS > 254
+#error "BT_MAX_CONNECTIONS must be between 1 and 254"
+#endif
+
+#if BT_LE_MAX_DATA_LENGTH < 27 || BT_LE_MAX_DATA_LENGTH > 251
+#error "BT_LE_MAX_DATA_LENGTH must be between 27 and 251"
+#endif
+
+#if BT_ACL_TX_POOL_SIZE < 1 || BT_ACL_TX_POOL_SIZE > 254
+#error "BT_ACL_TX_POOL_SIZE must be between 1 and 254"
+#endif
+
+#if BT_L2CAP_RX_QUEUE_SIZE < 1 || BT_L2CAP_RX_QUEUE_SIZE > 254
+#error "BT_L2CAP_RX_QUEUE_SIZE must be between 1 and 254"
+#endif
+
+#if BT_SCAN_CACHE_SIZE < 2 || BT_SCAN_CACHE_SIZE > 256 || (BT_SCAN_CACHE_SIZE & (BT_SCAN_CACHE_SIZE - 1)) != 0
+#error "BT_SCAN_CACHE_SIZE must be a power of two between 2 and 256"
+#endif
+
+#if BT_ADV_FILTER_MAX_RULES < 1 || BT_ADV_FILTER_MAX_RULES > 32
+#error "BT_ADV_FILTER_MAX_RULES must be between 1 and 32"
+#endif
+
+#if BT_ACCEPT_LIST_SIZE < 1 || BT_ACCEPT_LIST_SIZE > 255
+#error "BT_ACCEPT_LIST_SIZE must be between 1 and 255"
+#endif
+
+#if BT_EXT_ADV_MAX_SETS < 1 || BT_EXT_ADV_MAX_SETS > 63
+#error "BT_EXT_ADV_MAX_SETS must be between 1 and 63"
+#endif
+
+#if BT_EXT_SCAN_REASSEMBLY_BUFFERS < 1 || BT_EXT_SCAN_REASSEMBLY_BUFFERS > 255
+#error "BT_EXT_SCAN_REASSEMBLY_BUFFERS must be between 1 and 255"
+#endif
+
+#if BT_EXT_SCAN_MAX_DATA_LENGTH < 31 || BT_EXT_SCAN_MAX_DATA_LENGTH > 1650
+#error "BT_EXT_SCAN_MAX_DATA_LENGTH must be between 31 and 1650"
+#endif
+
+#if BT_GATT_MAX_ATTRIBUTES < 1 || BT_GATT_MAX_ATTRIBUTES > 0xFFFE
+#error "BT_GATT_MAX_ATTRIBUTES must be between 1 and 65534"
+#endif
+
+#if BT_GATT_VALUE_ARENA_SIZE < 64
+#error "BT_GATT_VALUE_ARENA_SIZE must be at least 64"
+#endif
+
+#if BT_ATT_DISCOVERY_CACHE_ENTRIES < 1 || BT_ATT_DISCOVERY_CACHE_ENTRIES > 255
+#error "BT_ATT_DISCOVERY_CACHE_ENTRIES must be between 1 and 255"
+#endif
+
+#if BT_ATT_DISCOVERY_CACHE_SIZE < 23 || BT_ATT_DISCOVERY_CACHE_SIZE > 0xFFFF
+#error "BT_ATT_DISCOVERY_CACHE_SIZE must be between 23 and 65535"
+#endif
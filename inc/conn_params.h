@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief   Connection parameter sets chosen from observed traffic
+ */
+typedef enum {
+  CONN_PARAMS_PROFILE_NORMAL, /**< Parameters GAP_connect opens links with */
+  CONN_PARAMS_PROFILE_BURST,  /**< Shortest interval for bulk transfers */
+  CONN_PARAMS_PROFILE_IDLE    /**< Long interval with peripheral latency to save power */
+} ConnParamsProfile;
+
+/**
+ * @brief   Enable or disable adaptive connection parameters
+ * @param   enabled If false, connections keep whatever parameters they have
+ * @details Enabled by default. Only connections with the GAP_CONN_POLICY_BALANCED policy are managed,
+ * links pinned to throughput or power keep their parameters.
+ */
+void CONN_PARAMS_set_enabled(bool enabled);
+
+/**
+ * @brief   Evaluate traffic and adjust connection parameters
+ * @details Called by bluetooth_stack_process, never from interrupt context. Once every
+ * BT_CONN_PARAMS_WINDOW_MS it rates the bytes each connection sent and received and the depth of its
+ * TX queue, and moves the connection between the burst, normal and idle profiles. A profile must be
+ * observed for several windows before the connection leaves it, so short pauses in a transfer do not
+ * cause update storms. Updates go out without waiting, each when a command credit is free. On every call
+ * it also answers the peers' LE Remote Connection Parameter Requests and applies the L2CAP Connection
+ * Parameter Update Requests GAP accepted.
+ */
+void CONN_PARAMS_process(void);
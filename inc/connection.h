@@ -0,0 +1,188 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bt_config.h"
+#include "gap.h"
+#include "hci_acl.h"
+#include "l2cap.h"
+
+#define CONN_MAX_HANDLE 0x0EFF                       /**< Highest valid HCI connection handle */
+#define CONN_INVALID_SLOT 0xFF                       /**< Handle table entry for handles without a context */
+#define CONN_MAX_CCCDS BT_MAX_CCCDS_PER_CONNECTION   /**< CCCD values remembered per connection */
+#define CONN_DEFAULT_DATA_LENGTH 27                  /**< LL payload octets before Data Length Extension */
+#define CONN_DEFAULT_DATA_TIME 328                   /**< LL PDU time in us before Data Length Extension */
+
+/**
+ * @brief   Link state of a single connection, independent of the global HCI state
+ */
+typedef enum {
+  CONN_STATE_FREE,          /**< Slot unused */
+  CONN_STATE_CONNECTED,     /**< Link established */
+  CONN_STATE_DISCONNECTING, /**< Disconnect requested, waiting for Disconnection Complete */
+  CONN_STATE_CLOSED         /**< Link gone, the slot waits for the main loop to release its TX buffers */
+} ConnectionState;
+
+/**
+ * @brief   Client characteristic configuration written by the peer
+ */
+typedef struct {
+  uint16_t attribute_handle; /**< CCCD attribute handle, 0 if unused */
+  uint16_t value;            /**< GATT_NOTIFY / GATT_INDICATE bits */
+} ConnCCCD;
+
+/**
+ * @brief   ATT bearer state of a connection
+ */
+typedef struct {
+  uint8_t pending_request;  /**< Opcode of the outstanding client request, 0 if none */
+  uint16_t requested_mtu;   /**< MTU sent in our Exchange MTU Request */
+  bool indication_pending;  /**< Indication sent and not yet confirmed */
+} ATTTransaction;
+
+/**
+ * @brief   Traffic observed on a connection, consumed by the connection parameter manager
+ */
+typedef struct {
+  uint32_t tx_bytes;            /**< L2CAP bytes queued since the last evaluation */
+  uint32_t rx_bytes;            /**< L2CAP bytes received since the last evaluation */
+  uint8_t peak_queued;          /**< Deepest TX queue since the last evaluation */
+  uint8_t profile;              /**< ConnParamsProfile last requested */
+  uint8_t wanted_profile;       /**< ConnParamsProfile chosen by the last evaluation, requested with a free credit */
+  uint8_t busy_windows;         /**< Consecutive windows above the burst entry threshold */
+  uint8_t quiet_windows;        /**< Consecutive windows below the burst exit threshold */
+  uint8_t idle_windows;         /**< Consecutive windows below the idle entry threshold */
+  bool update_pending;          /**< Connection update sent, waiting for its completion */
+  uint64_t update_requested_ms; /**< When the pending update was sent */
+} ConnTraffic;
+
+/**
+ * @brief   Peer connection parameter request waiting for the main loop to answer or apply it
+ */
+typedef struct {
+  bool pending;                     /**< Remote request received and not answered yet */
+  GAPConnectionParameters params;   /**< Parameters the peer asked for */
+  bool update_pending;              /**< L2CAP request accepted, its connection update not sent yet */
+  GAPConnectionParameters accepted; /**< Parameters of the accepted L2CAP request */
+} ConnPeerRequest;
+
+/**
+ * @brief   Connection events raised in interrupt context, delivered to the application by GAP_process
+ */
+typedef struct {
+  bool connected;            /**< GAP_EVENT_CONNECTED waiting for delivery */
+  bool updated;              /**< GAP_EVENT_CONNECTION_UPDATED waiting for delivery */
+  bool link_ready;           /**< GAP_EVENT_LINK_READY waiting for delivery */
+  bool reported;             /**< GAP_EVENT_CONNECTED delivered, so the disconnection is reported as well */
+  uint8_t disconnect_reason; /**< Reason delivered with GAP_EVENT_DISCONNECTED */
+} ConnGapEvents;
+
+/**
+ * @brief   Progress of the post-connect bring-up procedures
+ */
+typedef struct {
+  uint8_t pending;     /**< LinkProcedure bits still outstanding */
+  uint8_t unsent;      /**< LinkProcedure bits whose request has not gone out yet */
+  uint64_t started_ms; /**< When bring-up started */
+} ConnLinkSetup;
+
+/**
+ * @brief   Everything the stack tracks for one live connection
+ */
+typedef struct {
+  uint16_t connection_handle;       /**< HCI connection handle */
+  ConnectionState state;            /**< Link state */
+  uint8_t role;                     /**< Conn_Role of the local device */
+  uint8_t peer_address_type;        /**< Conn_PeerAddressType of the peer */
+  uint8_t peer_address[6];          /**< Peer device address */
+  uint16_t conn_interval;           /**< Connection interval in 1.25 ms units */
+  uint16_t conn_latency;            /**< Peripheral latency in connection events */
+  uint16_t supervision_timeout;     /**< Supervision timeout in 10 ms units */
+  uint8_t param_policy;             /**< GAPConnectionPolicy applied to peer parameter requests */
+  ConnPeerRequest peer_request;     /**< Peer parameter request waiting for the main loop */
+  uint8_t signaling_identifier;     /**< Identifier of our last L2CAP signaling request, never 0 once sent */
+  ConnTraffic traffic;              /**< Traffic statistics for adaptive connection parameters */
+  ConnLinkSetup link_setup;         /**< Post-connect bring-up state */
+  ConnGapEvents gap_events;         /**< Connection events not delivered yet */
+  uint16_t max_tx_octets;           /**< LL payload octets we may send per PDU */
+  uint16_t max_tx_time;             /**< LL PDU time in us we may send */
+  uint16_t max_rx_octets;           /**< LL payload octets the peer may send per PDU */
+  uint16_t max_rx_time;             /**< LL PDU time in us the peer may send */
+  uint8_t tx_phy;                   /**< Phy_Type used towards the peer */
+  uint8_t rx_phy;                   /**< Phy_Type used by the peer */
+  uint8_t preferred_phys;           /**< Phy_Preference bits requested for this connection */
+  uint16_t att_mtu;                 /**< Negotiated ATT MTU */
+  bool services_discovered;         /**< Whether the peer's services have been discovered */
+  ATTTransaction att;               /**< ATT transaction state */
+  ConnCCCD cccds[CONN_MAX_CCCDS];   /**< CCCD values written by the peer */
+  L2CAPReassembly l2cap_rx;         /**< Inbound L2CAP reassembly */
+  HCI_ACLQueue tx;                  /**< Outbound ACL queues */
+} ConnectionContext;
+
+/**
+ * @brief   Initialize the connection table
+ * @details Releases every context and clears the handle table
+ */
+void CONN_init(void);
+
+/**
+ * @brief   Create the context for a new connection
+ * @param   connection_handle Handle reported by the controller
+ * @return  ConnectionContext* The new context, or NULL if the handle is invalid or no slot is free
+ */
+ConnectionContext *CONN_open(uint16_t connection_handle);
+
+/**
+ * @brief   Release the context of a closed connection
+ * @param   connection_handle Handle of the connection that was closed
+ * @details Runs in interrupt context. The handle stops resolving at once, the slot is reused only after
+ * CONN_release_closed dropped its queued TX data.
+ */
+void CONN_close(uint16_t connection_handle);
+
+/**
+ * @brief   Free the slots of closed connections
+ * @details Called by bluetooth_stack_process, never from interrupt context, as the TX buffer pool belongs
+ * to the main loop
+ */
+void CONN_release_closed(void);
+
+/**
+ * @brief   Resolve a connection handle to its context
+ * @param   connection_handle Handle to look up
+ * @return  ConnectionContext* The context, or NULL if the handle is not connected
+ * @details Direct index into the handle table, no search
+ */
+ConnectionContext *CONN_lookup(uint16_t connection_handle);
+
+/**
+ * @brief   Get the context stored in a slot
+ * @param   slot Slot index, 0 to MAX_CONNECTIONS - 1
+ * @return  ConnectionContext* The context, or NULL if the slot is free or its connection closed
+ * @details Used to iterate over all live connections
+ */
+ConnectionContext *CONN_get_slot(uint8_t slot);
+
+/**
+ * @brief   Get the number of live connections
+ * @return  uint8_t Number of contexts in use
+ */
+uint8_t CONN_count(void);
+
+/**
+ * @brief   Read a CCCD value for a connection
+ * @param   context Connection context
+ * @param   attribute_handle CCCD attribute handle
+ * @return  uint16_t Stored value, 0 if the peer never wrote it
+ */
+uint16_t CONN_get_cccd(ConnectionContext *context, uint16_t attribute_handle);
+
+/**
+ * @brief   Store a CCCD value for a connection
+ * @param   context Connection context
+ * @param   attribute_handle CCCD attribute handle
+ * @param   value Value written by the peer
+ * @return  bool false if the per-connection CCCD table is full
+ */
+bool CONN_set_cccd(ConnectionContext *context, uint16_t attribute_handle, uint16_t value);
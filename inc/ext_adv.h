@@ -0,0 +1,157 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bt_config.h"
+#include "hci.h"
+
+#define EXT_ADV_MAX_SETS BT_EXT_ADV_MAX_SETS /**< Advertising sets the host tracks */
+#define EXT_ADV_FRAGMENT_SIZE 251            /**< Advertising data one command carries */
+#define EXT_ADV_LEGACY_DATA_LENGTH 31        /**< Data limit of sets using legacy PDUs */
+#define EXT_ADV_INVALID_HANDLE 0xFF          /**< Returned when no set was created */
+#define EXT_ADV_TX_POWER_NO_PREFERENCE 127   /**< Let the controller choose the TX power */
+
+/* Advertising_Event_Properties bits */
+#define EXT_ADV_PROP_CONNECTABLE 0x0001
+#define EXT_ADV_PROP_SCANNABLE 0x0002
+#define EXT_ADV_PROP_DIRECTED 0x0004
+#define EXT_ADV_PROP_HIGH_DUTY_DIRECTED 0x0008
+#define EXT_ADV_PROP_LEGACY 0x0010
+#define EXT_ADV_PROP_ANONYMOUS 0x0020
+#define EXT_ADV_PROP_INCLUDE_TX_POWER 0x0040
+
+/**
+ * @brief   Configuration of one advertising set
+ */
+typedef struct {
+  uint16_t properties;      /**< EXT_ADV_PROP_* bits */
+  uint16_t interval_min_ms; /**< Minimum primary advertising interval */
+  uint16_t interval_max_ms; /**< Maximum primary advertising interval */
+  uint8_t primary_phy;      /**< Phy_Type of the primary channels, LE 1M or LE Coded */
+  uint8_t secondary_phy;    /**< Phy_Type of the auxiliary packets */
+  int8_t tx_power;          /**< Requested TX power in dBm, EXT_ADV_TX_POWER_NO_PREFERENCE for any */
+  uint8_t sid;              /**< Advertising SID, 0 to 15 */
+  uint8_t filter_policy;    /**< Adv_FilterPolicy */
+  uint16_t duration_10ms;   /**< Time the set advertises once enabled, 0 until disabled */
+  uint8_t max_events;       /**< Extended advertising events before the set stops, 0 for no limit */
+} ExtAdvParameters;
+
+/**
+ * @brief   Host state of one advertising set
+ */
+typedef struct {
+  bool used;                /**< Set exists in the controller */
+  volatile bool enabled;    /**< Set advertises */
+  uint16_t properties;      /**< EXT_ADV_PROP_* bits the set was created with */
+  uint16_t duration_10ms;   /**< Duration passed when the set is enabled */
+  uint8_t max_events;       /**< Max_Extended_Advertising_Events passed when the set is enabled */
+  int8_t selected_tx_power; /**< TX power chosen by the controller */
+  uint32_t data_hash;       /**< Hash of the advertising data last sent */
+  uint16_t data_length;     /**< Length of the advertising data last sent */
+  bool data_valid;          /**< Advertising data was sent */
+  uint32_t scan_rsp_hash;   /**< Hash of the scan response data last sent */
+  uint16_t scan_rsp_length; /**< Length of the scan response data last sent */
+  bool scan_rsp_valid;      /**< Scan response data was sent */
+} ExtAdvSet;
+
+/**
+ * @brief   Switch the controller to extended advertising
+ * @return  HCIError HCI_ERROR_UNKNOWN_COMMAND if the controller lacks extended advertising
+ * @details Reads how many sets and how much data the controller supports and removes any sets it
+ * still holds. Once extended advertising commands were sent, the controller rejects the legacy
+ * advertising commands used by GAP until the next HCI_init. Never call from interrupt context.
+ */
+HCIError EXT_ADV_init(void);
+
+/**
+ * @brief   Get the number of sets that can be created
+ * @return  uint8_t Smaller of the controller's and the host's limit, 0 before EXT_ADV_init
+ */
+uint8_t EXT_ADV_max_sets(void);
+
+/**
+ * @brief   Get the longest advertising data a set can carry
+ * @return  uint16_t Maximum advertising data length reported by the controller
+ */
+uint16_t EXT_ADV_max_data_length(void);
+
+/**
+ * @brief   Create an advertising set
+ * @param   params Configuration of the set
+ * @param   handle Output for the handle of the new set
+ * @return  HCIError Indicates the success or failure of the creation
+ * @details The set is created disabled and without data.
+ */
+HCIError EXT_ADV_create_set(const ExtAdvParameters *params, uint8_t *handle);
+
+/**
+ * @brief   Change the configuration of a disabled set
+ * @param   handle Set to configure
+ * @param   params New configuration
+ * @return  HCIError HCI_ERROR_BUSY if the set is enabled
+ */
+HCIError EXT_ADV_set_parameters(uint8_t handle, const ExtAdvParameters *params);
+
+/**
+ * @brief   Set the advertising data of a set
+ * @param   handle Set to update
+ * @param   data Advertising data
+ * @param   length Length of the advertising data, up to EXT_ADV_max_data_length
+ * @return  HCIError HCI_ERROR_BUSY if the set is enabled and the data needs more than one command
+ * @details Data longer than EXT_ADV_FRAGMENT_SIZE is sent in fragments. Nothing is sent when the
+ * data equals what was sent last.
+ */
+HCIError EXT_ADV_set_data(uint8_t handle, const uint8_t *data, uint16_t length);
+
+/**
+ * @brief   Set the scan response data of a scannable set
+ * @param   handle Set to update
+ * @param   data Scan response data
+ * @param   length Length of the scan response data, up to EXT_ADV_max_data_length
+ * @return  HCIError HCI_ERROR_BUSY if the set is enabled and the data needs more than one command
+ */
+HCIError EXT_ADV_set_scan_response(uint8_t handle, const uint8_t *data, uint16_t length);
+
+/**
+ * @brief   Enable or disable several sets in one command
+ * @param   handles Sets to change
+ * @param   count Number of sets, 0 together with enable false disables every set
+ * @param   enable Start or stop advertising
+ * @return  HCIError Indicates the success or failure of the command
+ * @details The controller interleaves all enabled sets on its own, each with its own interval.
+ */
+HCIError EXT_ADV_enable(const uint8_t *handles, uint8_t count, bool enable);
+
+/**
+ * @brief   Remove a disabled set
+ * @param   handle Set to remove
+ * @return  HCIError HCI_ERROR_BUSY if the set is enabled
+ */
+HCIError EXT_ADV_remove_set(uint8_t handle);
+
+/**
+ * @brief   Get the state of a set
+ * @param   handle Set to look up
+ * @return  const ExtAdvSet* The set, or NULL if it does not exist
+ */
+const ExtAdvSet *EXT_ADV_get_set(uint8_t handle);
+
+/**
+ * @brief   Consume the completion of an extended advertising command
+ * @param   op_code Command the completion belongs to
+ * @param   status Status of the command
+ * @param   return_parameters Return parameters after the status
+ * @param   length Length of the return parameters
+ * @return  bool true if the completion belonged to a command sent by this module
+ * @details Called by the command complete handler in interrupt context
+ */
+bool EXT_ADV_handle_command_complete(uint16_t op_code, uint8_t status, uint8_t *return_parameters, uint8_t length);
+
+/**
+ * @brief   Mark a set stopped by the controller
+ * @param   status Zero if a connection ended the set, otherwise why it stopped
+ * @param   handle Set that stopped
+ * @details Called from the advertising set terminated event handler in interrupt context
+ */
+void EXT_ADV_handle_set_terminated(uint8_t status, uint8_t handle);
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bt_config.h"
+
+#define EXT_SCAN_BUFFERS BT_EXT_SCAN_REASSEMBLY_BUFFERS  /**< Reports reassembled at once */
+#define EXT_SCAN_MAX_DATA_LENGTH BT_EXT_SCAN_MAX_DATA_LENGTH /**< Longest reassembled data */
+
+/**
+ * @brief   Reassembly of one advertiser's fragmented data
+ */
+typedef struct {
+  bool used;                               /**< Fragments are being collected */
+  bool scan_rsp;                           /**< Collecting a scan response */
+  uint8_t addr_type;                       /**< Address type of the advertiser */
+  uint8_t addr[6];                         /**< Advertiser address */
+  uint8_t sid;                             /**< Advertising SID */
+  uint16_t length;                         /**< Bytes collected so far */
+  uint64_t updated_ms;                     /**< When the last fragment arrived */
+  uint8_t data[EXT_SCAN_MAX_DATA_LENGTH];  /**< Data collected so far */
+} ExtScanBuffer;
+
+/**
+ * @brief   Counters of the reassembly
+ */
+typedef struct {
+  uint32_t reassembled; /**< Reports delivered from more than one fragment */
+  uint32_t truncated;   /**< Reports dropped because the controller gave up on the chain */
+  uint32_t overflowed;  /**< Reports dropped for exceeding EXT_SCAN_MAX_DATA_LENGTH */
+  uint32_t evicted;     /**< Reassemblies dropped for lack of a free buffer or a fragment timeout */
+} ExtScanStats;
+
+/**
+ * @brief   Drop every partial report
+ * @details Called when scanning starts
+ */
+void EXT_SCAN_reset(void);
+
+/**
+ * @brief   Handle one extended advertising report
+ * @param   event_type Event_Type bits of the report
+ * @param   addr_type Address type of the advertiser
+ * @param   addr Advertiser address
+ * @param   sid Advertising SID
+ * @param   data Data fragment inside the event buffer
+ * @param   data_len Length of the fragment
+ * @param   rssi Signal strength in dBm
+ * @details Called by the HCI layer in interrupt context. A report that arrives complete is passed to
+ * GAP in place. Fragments are collected in a pooled buffer and the whole data is passed on with the
+ * last one.
+ */
+void EXT_SCAN_handle_report(uint16_t event_type, uint8_t addr_type, uint8_t *addr, uint8_t sid, uint8_t *data,
+                            uint8_t data_len, int8_t rssi);
+
+/**
+ * @brief   Get the reassembly counters
+ * @param   stats Output for the counters
+ */
+void EXT_SCAN_get_stats(ExtScanStats *stats);
@@ -3,9 +3,14 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "adv_data.h"
+#include "adv_filter.h"
+#include "bt_config.h"
+#include "scan_cache.h"
+
 #define MAX_SERVICES 10                    /**< Maximum number of services that can be registered */
 #define MAX_CHARACTERISTICS_PER_SERVICE 10 /**< Maximum number of characteristics per service */
-#define MAX_CONNECTIONS 1                  /**< Maximum number of BLE connections */
+#define MAX_CONNECTIONS BT_MAX_CONNECTIONS /**< Maximum number of BLE connections, see bt_config.h */
 
 /** Default MTU size for ATT protocol */
 #define ATT_DEFAULT_MTU 23
@@ -19,13 +24,15 @@ typedef enum {
   GAP_ERROR_NOT_INITIALIZED,
   GAP_ERROR_ALREADY_INITIALIZED,
   GAP_ERROR_HCI_ERROR,
-  GAP_ERROR_BUSY
+  GAP_ERROR_BUSY,
+  GAP_ERROR_NO_RESOURCES
 } GAPError;
 
 typedef enum {
   GAP_EVENT_CONNECTED,
   GAP_EVENT_DISCONNECTED,
   GAP_EVENT_CONNECTION_UPDATED,
+  GAP_EVENT_LINK_READY,
   GAP_EVENT_SCAN_RESULT
 } GAPEventType;
 
@@ -34,11 +41,35 @@ typedef struct {
   uint16_t connection_handle;
   union {
     struct {
+      uint8_t event_type;     /* Scan_ReportType */
+      uint8_t addr_type;      /* Conn_PeerAddressType */
       uint8_t addr[6];
-      int8_t rssi;
-      uint8_t *adv_data;
-      uint8_t adv_data_len;
+      int8_t rssi;            /* dBm, 127 if not available */
+      int8_t rssi_smoothed;   /* Averaged over recent reports, dBm */
+      uint8_t changes;        /* ScanCacheChange bits */
+      uint8_t *adv_data;      /* Points into the HCI event or reassembly buffer, only valid during the callback */
+      uint16_t adv_data_len;
     } scan_result;
+    struct {
+      uint8_t role;                 /* Conn_Role */
+      uint8_t peer_addr_type;       /* Conn_PeerAddressType */
+      uint8_t peer_addr[6];
+      uint16_t interval;            /* 1.25 ms units */
+      uint16_t latency;             /* Connection events */
+      uint16_t supervision_timeout; /* 10 ms units */
+    } connection;                   /* GAP_EVENT_CONNECTED and GAP_EVENT_CONNECTION_UPDATED */
+    struct {
+      uint8_t reason;
+    } disconnection;
+    struct {
+      uint16_t att_mtu;
+      uint16_t max_tx_octets; /* LL payload octets per PDU towards the peer */
+      uint16_t max_rx_octets; /* LL payload octets per PDU from the peer */
+      uint8_t tx_phy;         /* Phy_Type */
+      uint8_t rx_phy;         /* Phy_Type */
+      uint16_t interval;      /* 1.25 ms units */
+      uint16_t latency;       /* Connection events */
+    } link_ready;
   } params;
 } GAPEvent;
 
@@ -47,10 +78,54 @@ typedef struct {
   uint16_t att_mtu;
   bool connected;
   bool services_discovered;
+  uint8_t role;                 /* Conn_Role */
+  uint16_t interval;            /* 1.25 ms units */
+  uint16_t latency;             /* Connection events */
+  uint16_t supervision_timeout; /* 10 ms units */
+  uint16_t max_tx_octets;       /* LL payload octets per PDU towards the peer */
+  uint16_t max_rx_octets;       /* LL payload octets per PDU from the peer */
+  uint8_t tx_phy;               /* Phy_Type */
+  uint8_t rx_phy;               /* Phy_Type */
 } GAPConnection;
 
+/**
+ * @brief   How peer connection parameter requests are answered on a connection
+ */
+typedef enum {
+  GAP_CONN_POLICY_BALANCED,   /**< Accept the requested parameters unchanged */
+  GAP_CONN_POLICY_THROUGHPUT, /**< Shortest interval of the requested range, no peripheral latency */
+  GAP_CONN_POLICY_POWER       /**< Longest interval of the requested range */
+} GAPConnectionPolicy;
+
+/**
+ * @brief   Procedures that only admit devices in the accept list, combined as bits
+ */
+typedef enum {
+  GAP_ACCEPT_LIST_SCAN = 0x01,            /**< Scanning reports only advertisers in the list */
+  GAP_ACCEPT_LIST_ADV_SCAN_REQUEST = 0x02, /**< Advertising answers scan requests only from the list */
+  GAP_ACCEPT_LIST_ADV_CONNECT = 0x04      /**< Advertising accepts connections only from the list */
+} GAPAcceptListUse;
+
+typedef struct {
+  uint16_t interval_min;        /* 1.25 ms units */
+  uint16_t interval_max;        /* 1.25 ms units */
+  uint16_t latency;             /* Connection events */
+  uint16_t supervision_timeout; /* 10 ms units */
+} GAPConnectionParameters;
+
+/**
+ * Application hook for GAP events. Connection events run from bluetooth_stack_process, never in interrupt
+ * context, so the callback may issue GATT requests. GAP_EVENT_SCAN_RESULT runs in interrupt context.
+ */
 typedef void (*GAPEventCallback)(GAPEvent *event);
 
+/**
+ * Application hook for peer connection parameter requests. Receives the parameters after the connection's
+ * policy was applied and may modify them further. Return false to reject the request.
+ * Runs from bluetooth_stack_process, never in interrupt context.
+ */
+typedef bool (*GAPConnectionParameterCallback)(uint16_t connection_handle, GAPConnectionParameters *params);
+
 /**
  * @brief   Initialize the Generic Access Profile (GAP) layer
  * @details Sets up the GAP layer with the specified callback for events and device address
@@ -69,7 +144,9 @@ GAPError GAP_deinit(void);
 
 /**
  * @brief   Set the device name for advertising and discovery
- * @details Updates the GAP device name used in advertising packets
+ * @details Updates the GAP device name used in advertising packets. Advertising data becomes flags,
+ * appearance and name, a name that does not fit goes into the scan response. Only bytes that changed
+ * since the last call are sent to the controller.
  * @param   name Null-terminated string containing the device name
  * @return  GAP_ERROR_SUCCESS on success, or appropriate error code
  */
@@ -93,6 +170,23 @@ GAPError GAP_start_advertising(uint16_t interval_ms, bool connectable);
  */
 GAPError GAP_set_advertising_data(uint8_t *adv_data, uint8_t adv_data_len);
 
+/**
+ * @brief   Set advertising data and scan response from a builder
+ * @details Structures that do not fit the advertising data overflow into the scan response. Each
+ * of the two is only sent to the controller when its bytes differ from what was sent last, so
+ * rebuilding an unchanged payload costs no HCI traffic.
+ * @param   builder AD structures to advertise
+ * @return  GAP_ERROR_SUCCESS on success, GAP_ERROR_INVALID_PARAMETERS if the structures do not fit
+ */
+GAPError GAP_set_advertising_payload(const ADBuilder *builder);
+
+/**
+ * @brief   Forget the advertising data last sent
+ * @details Called by modules that update advertising data without going through GAP, so the next
+ * GAP_set_advertising_data is sent even if it matches what GAP sent before.
+ */
+void GAP_invalidate_advertising_data(void);
+
 /**
  * @brief   Stop advertising
  * @details Halts all advertising activity
@@ -138,6 +232,43 @@ GAPError GAP_stop_scanning(void);
  */
 GAPError GAP_set_scan_response_data(uint8_t *scan_data, uint8_t scan_data_len);
 
+/**
+ * @brief   Scan with the extended scanning commands
+ * @details Takes effect the next time scanning starts. Extended scanning also sees devices that only use
+ * extended advertising, their reports are reassembled and delivered like legacy ones. Once used, the
+ * controller rejects legacy scanning until it is reset.
+ * @param   phys Phy_Preference bits of the primary PHYs to scan, LE 1M and/or LE Coded. 0 scans with
+ * the legacy commands.
+ */
+void GAP_set_extended_scanning(uint8_t phys);
+
+/**
+ * @brief   Filter scanning and advertising through the controller's accept list
+ * @details Takes effect the next time scanning or advertising starts. Devices are managed with
+ * ACCEPT_LIST_add and ACCEPT_LIST_remove, the list is synced to the controller before either starts.
+ * Filtering in the controller keeps other devices' packets off the UART entirely.
+ * @param   uses GAPAcceptListUse bits, 0 admits every device
+ */
+void GAP_set_accept_list_policy(uint8_t uses);
+
+/**
+ * @brief   Choose which advertising reports reach the application
+ * @details Reports are deduplicated by the host scan cache instead of the controller, so RSSI keeps
+ * updating while the application only hears about what it subscribed to. The default is
+ * SCAN_CACHE_NEW_DEVICE | SCAN_CACHE_PAYLOAD_CHANGED, SCAN_CACHE_REPORT delivers every report.
+ * @param   changes ScanCacheChange bits that trigger GAP_EVENT_SCAN_RESULT
+ */
+void GAP_set_scan_result_events(uint8_t changes);
+
+/**
+ * @brief   Install an advertising filter
+ * @details Every report is run through the filter before it reaches the scan cache or the application,
+ * so rejected reports cost one pass over their AD structures. Advertising data and scan responses are
+ * filtered separately.
+ * @param   filter Compiled filter, must stay valid and unchanged while installed. NULL passes every report.
+ */
+void GAP_set_scan_filter(const AdvFilter *filter);
+
 /**
  * @brief   Set scan parameters
  * @details Configures detailed parameters for the scanning process
@@ -158,6 +289,16 @@ GAPError GAP_set_scan_parameters(bool active, bool filter_duplicates, uint8_t fi
  */
 GAPError GAP_connect(uint8_t *peer_addr, uint16_t scan_interval_ms, uint16_t scan_window_ms);
 
+/**
+ * @brief   Connect to whichever device of the accept list advertises first
+ * @details Syncs the accept list and initiates with the initiator filter policy, the controller picks
+ * the peer. Fails if the accept list is empty.
+ * @param   scan_interval_ms Time between connection establishment attempts in milliseconds
+ * @param   scan_window_ms Duration of each connection attempt in milliseconds
+ * @return  GAP_ERROR_SUCCESS on success, or appropriate error code
+ */
+GAPError GAP_connect_accept_list(uint16_t scan_interval_ms, uint16_t scan_window_ms);
+
 /**
  * @brief   Disconnect from a connected device
  * @details Terminates the connection identified by the connection handle
@@ -179,9 +320,37 @@ GAPError GAP_disconnect(uint16_t connection_handle);
 GAPError GAP_update_connection_parameters(uint16_t connection_handle, uint16_t min_interval_ms, uint16_t max_interval_ms,
                                           uint16_t latency, uint16_t timeout_ms);
 
+/**
+ * @brief   Choose how a connection answers the peer's parameter requests
+ * @details Applies to LL Connection Parameter Requests and L2CAP Connection Parameter Update Requests.
+ * New connections start with GAP_CONN_POLICY_BALANCED.
+ * @param   connection_handle Handle identifying the connection
+ * @param   policy Whether to favor throughput or power on this connection
+ * @return  GAP_ERROR_SUCCESS on success, or appropriate error code
+ */
+GAPError GAP_set_connection_policy(uint16_t connection_handle, GAPConnectionPolicy policy);
+
+/**
+ * @brief   Register the application hook for peer connection parameter requests
+ * @param   callback Hook to run after the connection policy, NULL to rely on the policy alone
+ */
+void GAP_set_connection_parameter_callback(GAPConnectionParameterCallback callback);
+
+/**
+ * @brief   Choose the PHYs a connection should use
+ * @details Requests a PHY update, the controller picks the fastest PHY both sides allow. The result is
+ * available through GAP_get_connection_info once the update completes.
+ * @param   connection_handle Handle identifying the connection
+ * @param   phys Phy_Preference bits for both directions, e.g. PHY_PREFER_LE_1M | PHY_PREFER_LE_2M
+ * @return  GAP_ERROR_SUCCESS on success, GAP_ERROR_BUSY if the controller has no command credit free,
+ * or appropriate error code
+ */
+GAPError GAP_set_preferred_phy(uint16_t connection_handle, uint8_t phys);
+
 /**
  * @brief   Set the device's appearance value
- * @details Sets the GAP appearance characteristic value according to Bluetooth SIG definitions
+ * @details Sets the GAP appearance characteristic value according to Bluetooth SIG definitions. It is
+ * advertised with the name set by GAP_set_device_name unless advertising data was set explicitly.
  * @param   appearance Appearance value as defined in the Bluetooth specification
  * @return  GAP_ERROR_SUCCESS on success, or appropriate error code
  */
@@ -198,8 +367,86 @@ GAPError GAP_get_connection_info(uint16_t connection_handle, GAPConnection *conn
 
 /**
  * @brief   Set preferred ATT MTU size
- * @details Sets the maximum transmission unit size for ATT protocol to request during MTU exchange
- * @param   mtu Desired MTU size (23-512 bytes)
+ * @details Sets the maximum transmission unit size for ATT protocol to request during MTU exchange.
+ * Every new connection requests it as part of link bring-up, 23 skips the exchange.
+ * @param   mtu Desired MTU size (23-517 bytes)
  * @return  GAP_ERROR_SUCCESS on success, or appropriate error code
  */
 GAPError GAP_set_preferred_mtu(uint16_t mtu);
+
+/**
+ * @brief   Handle a newly established connection
+ * @details Called by the HCI layer in interrupt context once the connection context exists. Marks
+ * GAP_EVENT_CONNECTED for GAP_process.
+ * @param   connection_handle Handle of the new connection
+ */
+void GAP_handle_connection_complete(uint16_t connection_handle);
+
+/**
+ * @brief   Handle a terminated connection
+ * @details Called by the HCI layer in interrupt context before the connection closes. Keeps the reason
+ * for GAP_EVENT_DISCONNECTED, delivered once the main loop releases the connection.
+ * @param   connection_handle Handle of the closed connection
+ * @param   reason Disconnection reason reported by the controller
+ */
+void GAP_handle_disconnection_complete(uint16_t connection_handle, uint8_t reason);
+
+/**
+ * @brief   Handle the release of a closed connection
+ * @details Called by CONN_release_closed from the main loop for links GAP_process reported. Delivers
+ * GAP_EVENT_DISCONNECTED.
+ * @param   connection_handle Handle of the closed connection
+ * @param   reason Disconnection reason reported by the controller
+ */
+void GAP_handle_connection_released(uint16_t connection_handle, uint8_t reason);
+
+/**
+ * @brief   Handle new connection parameters
+ * @details Called by the HCI layer in interrupt context after the context holds the new interval, latency
+ * and timeout. Marks GAP_EVENT_CONNECTION_UPDATED for GAP_process.
+ * @param   connection_handle Handle of the updated connection
+ */
+void GAP_handle_connection_update(uint16_t connection_handle);
+
+/**
+ * @brief   Handle the end of link bring-up
+ * @details Called by the link bring-up engine once MTU, data length, PHY and connection parameters are
+ * settled. Marks GAP_EVENT_LINK_READY for GAP_process.
+ * @param   connection_handle Handle of the connection
+ */
+void GAP_handle_link_ready(uint16_t connection_handle);
+
+/**
+ * @brief   Deliver the connection events raised since the last call
+ * @details Called by bluetooth_stack_process, never from interrupt context. Per connection the events
+ * follow the order GAP_EVENT_CONNECTED, GAP_EVENT_CONNECTION_UPDATED, GAP_EVENT_LINK_READY.
+ */
+void GAP_process(void);
+
+/**
+ * @brief   Handle one advertising report
+ * @details Called by the HCI layer for every report of an LE Advertising Report event and by the
+ * extended scan reassembly for every complete extended report. Drops reports rejected by the scan
+ * filter, records the rest in the scan cache and, if it changed something the application subscribed to, delivers
+ * GAP_EVENT_SCAN_RESULT with adv_data pointing at the report inside the event or reassembly buffer. Use the AD_
+ * iterator from adv_data.h to parse it and copy what must outlive the callback.
+ * @param   event_type Scan_ReportType of the report
+ * @param   addr_type Address type of the advertiser
+ * @param   addr Advertiser address
+ * @param   data Advertising or scan response data
+ * @param   data_len Length of the data
+ * @param   rssi Signal strength in dBm
+ */
+void GAP_handle_advertising_report(uint8_t event_type, uint8_t addr_type, uint8_t *addr, uint8_t *data,
+                                   uint16_t data_len, int8_t rssi);
+
+/**
+ * @brief   Decide on a peer's connection parameter request
+ * @details Called from the main loop for LE Remote Connection Parameter Requests and L2CAP Connection
+ * Parameter Update Requests. Rejects parameters outside the limits of the core specification, then
+ * applies the connection's policy and the application hook.
+ * @param   connection_handle Handle of the connection the request arrived on
+ * @param   params Requested parameters, updated in place with the parameters to accept
+ * @return  true if the (possibly clamped) parameters should be accepted
+ */
+bool GAP_handle_connection_parameter_request(uint16_t connection_handle, GAPConnectionParameters *params);
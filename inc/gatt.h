@@ -4,13 +4,12 @@
 
 #include "hci.h"
 
-#define MAX_SERVICES 10                    /**< Maximum number of services that can be registered */
-#define MAX_CHARACTERISTICS_PER_SERVICE 10 /**< Maximum number of characteristics per service */
-#define MAX_VALUE_LENGTH 128               /**< Maximum length of characteristic value */
+#define MAX_VALUE_LENGTH 128 /**< Maximum length of characteristic value */
 
 #define GATT_PRIMARY_SERVICE_UUID 0x2800   /**< UUID for primary service declaration */
 #define GATT_SECONDARY_SERVICE_UUID 0x2801 /**< UUID for secondary service declaration */
 #define GATT_CHARACTERISTIC_UUID 0x2803    /**< UUID for characteristic declaration */
+#define GATT_CCCD_UUID 0x2902              /**< UUID for client characteristic configuration descriptor */
 
 /** Default MTU size for ATT protocol */
 #define ATT_DEFAULT_MTU 23
@@ -164,32 +163,6 @@ typedef struct {
   } params; /**< Additional parameters for specific events */
 } GATTEvent;
 
-/**
- * @brief   Structure representing a GATT characteristic
- * @details Stores the characteristic declaration and value
- */
-typedef struct {
-  uint16_t handle;                           /**< Declaration handle */
-  uint16_t uuid;                             /**< UUID of the characteristic */
-  GATTCharacteristicProperties properties;   /**< Properties of the characteristic */
-  GATTCharacteristicPermissions permissions; /**< Permissions of the characteristic */
-  uint16_t value_handle;                     /**< Value handle */
-  uint8_t value[MAX_VALUE_LENGTH];           /**< Characteristic value buffer */
-  uint16_t value_length;                     /**< Current length of the value */
-} GATTCharacteristic;
-
-/**
- * @brief   Structure representing a GATT service
- */
-typedef struct {
-  uint16_t handle;                                                     /**< Service declaration handle */
-  uint16_t uuid;                                                       /**< UUID of the service */
-  bool is_primary;                                                     /**< Whether service is primary */
-  GATTCharacteristic characteristics[MAX_CHARACTERISTICS_PER_SERVICE]; /**< Array of characteristics */
-  uint8_t characteristic_count;                                        /**< Number of characteristics in the service */
-  uint16_t end_handle;                                                 /**< Service end handle */
-} GATTService;
-
 /**
  * @typedef GATTEventCallback
  * @brief   Callback function type for GATT events
@@ -238,10 +211,38 @@ GATTError GATT_remove_service(uint16_t service_uuid);
  * @param   initial_value Pointer to the initial value of the characteristic
  * @param   value_length Length of the initial value
  * @return  GATT_ERROR_SUCCESS if successful, or an appropriate error code
+ * @details The value keeps its initial length, later updates may not be longer. Characteristics that notify or
+ * indicate also get a client characteristic configuration descriptor.
  */
 GATTError GATT_add_characteristic(uint16_t service_uuid, uint16_t char_uuid, GATTCharacteristicProperties properties,
                                   GATTCharacteristicPermissions permissions, uint8_t *initial_value, uint16_t value_length);
 
+/**
+ * @brief   Add a characteristic whose value length can change
+ * @details Same as GATT_add_characteristic, but reserves max_length bytes for the value
+ * @param   service_uuid UUID of the service to which the characteristic should be added
+ * @param   char_uuid UUID of the characteristic to add
+ * @param   properties Bit mask of the characteristic properties
+ * @param   permissions Bit mask of the characteristic permissions
+ * @param   initial_value Pointer to the initial value of the characteristic
+ * @param   value_length Length of the initial value
+ * @param   max_length Longest value the characteristic will hold, at most MAX_VALUE_LENGTH
+ * @return  GATT_ERROR_SUCCESS if successful, or an appropriate error code
+ */
+GATTError GATT_add_variable_characteristic(uint16_t service_uuid, uint16_t char_uuid,
+                                           GATTCharacteristicProperties properties,
+                                           GATTCharacteristicPermissions permissions, uint8_t *initial_value,
+                                           uint16_t value_length, uint16_t max_length);
+
+/**
+ * @brief   Fix the structure of the local GATT database
+ * @details Call once every service is registered, or after loading a static database with GATT_DB_LOAD.
+ * Pre-encodes the discovery responses so clients that rediscover on every connection are answered with a
+ * single copy. Services can no longer be added or removed until GATT_init, values can still be updated.
+ * @return  GATT_ERROR_SUCCESS
+ */
+GATTError GATT_freeze_database(void);
+
 /**
  * @brief   Update the value of a local characteristic
  * @details Updates the value of a characteristic in the local GATT database
@@ -403,7 +404,8 @@ void GATT_handle_acl_data(HCIAsyncData *acl_data);
 
 /**
  * @brief   Process incoming ATT packet
- * @details Handles an ATT protocol packet received from a remote device
+ * @details Handles an ATT protocol packet received from a remote device. Called by L2CAP_process in the
+ * main loop.
  * @param   connection_handle Connection handle of the remote device
  * @param   packet Pointer to the ATT packet data
  * @param   length Length of the ATT packet
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bt_config.h"
+#include "gatt.h"
+
+#define GATT_DB_MAX_ATTRIBUTES BT_GATT_MAX_ATTRIBUTES /**< Attributes the local database can hold */
+#define GATT_DB_ARENA_SIZE BT_GATT_VALUE_ARENA_SIZE   /**< Bytes shared by all mutable values */
+#define GATT_DB_SCRATCH_SIZE 5                        /**< Longest value derived from the table */
+
+/**
+ * @brief   Value of an attribute the application can change
+ */
+typedef struct {
+  uint16_t length;   /**< Current length of the value */
+  uint16_t capacity; /**< Bytes available at data */
+  uint8_t *data;     /**< Value bytes */
+} GATTValue;
+
+/**
+ * @brief   One entry of the attribute table, its handle is its position in the table plus one
+ * @details Declarations built at runtime carry no stored value, it is derived from the table when read: a
+ * service declaration from service_uuid, a characteristic declaration from the value attribute after it.
+ * Static tables carry them pre-encoded. Client characteristic configurations have no value, they are kept
+ * per connection.
+ */
+typedef struct {
+  uint16_t type;           /**< Attribute type, a 16-bit UUID */
+  uint16_t service_uuid;   /**< UUID of the service, on service declarations */
+  uint8_t permissions;     /**< GATTCharacteristicPermissions */
+  uint8_t properties;      /**< GATTCharacteristicProperties, on characteristic values */
+  uint16_t encoded_length; /**< Length of encoded */
+  const uint8_t *encoded;  /**< Pre-encoded declaration or fixed value, NULL to derive it from the table */
+  GATTValue *value;        /**< Mutable value in RAM, NULL for declarations, fixed values and CCCDs */
+} GATTAttribute;
+
+/*
+ * Static database definition
+ *
+ * A database known at build time can be written out as a const GATTAttribute array and served in place,
+ * so it lives in read-only memory and needs no construction at startup. Every entry is placed at a handle
+ * chosen by the application, which keeps handles stable across builds for clients that cache them.
+ * Only GATT_DB_VALUE storage ends up in RAM.
+ *
+ *   enum { HDL_GAP = 1, HDL_NAME_DECL, HDL_NAME, HDL_BATTERY, HDL_LEVEL_DECL, HDL_LEVEL, HDL_LEVEL_CCCD };
+ *
+ *   GATT_DB_VALUE_INIT(battery_level, 1, 100);
+ *
+ *   static const GATTAttribute database[] = {
+ *     GATT_DB_PRIMARY_SERVICE(HDL_GAP, 0x1800),
+ *     GATT_DB_FIXED_CHARACTERISTIC(HDL_NAME, 0x2A00, GATT_PROP_READ, GATT_PERM_READ, 'p', 'i'),
+ *     GATT_DB_PRIMARY_SERVICE(HDL_BATTERY, 0x180F),
+ *     GATT_DB_CHARACTERISTIC(HDL_LEVEL, 0x2A19, GATT_PROP_READ | GATT_PROP_NOTIFY, GATT_PERM_READ, &battery_level),
+ *     GATT_DB_CCCD(HDL_LEVEL_CCCD),
+ *   };
+ *
+ *   GATT_DB_LOAD(database);
+ *   GATT_freeze_database();
+ */
+
+/** Two little endian initializer bytes of a 16-bit UUID or handle */
+#define GATT_DB_LE16(x) (uint8_t)((x) & 0xFFU), (uint8_t)(((x) >> 8U) & 0xFFU)
+
+/** Define RAM storage for a mutable value, initially empty */
+#define GATT_DB_VALUE(name, size)   \
+  static uint8_t name##_data[size]; \
+  static GATTValue name = { .length = 0, .capacity = (size), .data = name##_data }
+
+/** Define RAM storage for a mutable value with initial bytes */
+#define GATT_DB_VALUE_INIT(name, size, ...)                                                   \
+  static uint8_t name##_data[size] = { __VA_ARGS__ };                                         \
+  static GATTValue name = { .length = sizeof((uint8_t[]){ __VA_ARGS__ }), .capacity = (size), \
+                            .data = name##_data }
+
+/** Primary service declaration at handle */
+#define GATT_DB_PRIMARY_SERVICE(handle, uuid)                                                                  \
+  [(handle) - 1] = { .type = GATT_PRIMARY_SERVICE_UUID, .service_uuid = (uuid), .permissions = GATT_PERM_READ, \
+                     .encoded_length = 2, .encoded = (const uint8_t[]){ GATT_DB_LE16(uuid) } }
+
+/** Secondary service declaration at handle */
+#define GATT_DB_SECONDARY_SERVICE(handle, uuid)                                                                  \
+  [(handle) - 1] = { .type = GATT_SECONDARY_SERVICE_UUID, .service_uuid = (uuid), .permissions = GATT_PERM_READ, \
+                     .encoded_length = 2, .encoded = (const uint8_t[]){ GATT_DB_LE16(uuid) } }
+
+/** Characteristic declaration, placed just before value_handle */
+#define GATT_DB_DECLARATION(value_handle, uuid, props)                                                 \
+  [(value_handle) - 2] = { .type = GATT_CHARACTERISTIC_UUID, .permissions = GATT_PERM_READ,            \
+                           .encoded_length = 5,                                                        \
+                           .encoded = (const uint8_t[]){ (uint8_t)(props), GATT_DB_LE16(value_handle), \
+                                                         GATT_DB_LE16(uuid) } }
+
+/** Characteristic declaration and value, the value kept in storage defined with GATT_DB_VALUE */
+#define GATT_DB_CHARACTERISTIC(value_handle, uuid, props, perms, storage)                                   \
+  GATT_DB_DECLARATION(value_handle, uuid, props),                                                           \
+  [(value_handle) - 1] = { .type = (uuid), .permissions = (uint8_t)(perms), .properties = (uint8_t)(props), \
+                           .value = (storage) }
+
+/** Characteristic declaration and a value that never changes, the value bytes follow perms */
+#define GATT_DB_FIXED_CHARACTERISTIC(value_handle, uuid, props, perms, ...)                                 \
+  GATT_DB_DECLARATION(value_handle, uuid, props),                                                           \
+  [(value_handle) - 1] = { .type = (uuid), .permissions = (uint8_t)(perms), .properties = (uint8_t)(props), \
+                           .encoded_length = sizeof((const uint8_t[]){ __VA_ARGS__ }),                      \
+                           .encoded = (const uint8_t[]){ __VA_ARGS__ } }
+
+/** Client characteristic configuration of a notifying or indicating characteristic */
+#define GATT_DB_CCCD(handle) \
+  [(handle) - 1] = { .type = GATT_CCCD_UUID, .permissions = GATT_PERM_READ | GATT_PERM_WRITE }
+
+/** Serve a static table defined with the macros above */
+#define GATT_DB_LOAD(static_table) GATT_DB_load((static_table), sizeof(static_table) / sizeof((static_table)[0]))
+
+/**
+ * @brief   Empty the database
+ */
+void GATT_DB_init(void);
+
+/**
+ * @brief   Serve a static attribute table in place of the runtime one
+ * @param   static_table Table defined with the GATT_DB_ macros, must stay valid while loaded
+ * @param   count Number of entries, the last handle of the database
+ * @return  GATTError GATT_ERROR_INVALID_PARAMETER if a handle was skipped or the table does not start with a service
+ * @details Nothing is copied. The database is frozen until GATT_DB_init.
+ */
+GATTError GATT_DB_load(const GATTAttribute *static_table, uint16_t count);
+
+/**
+ * @brief   Fix the structure of the database
+ * @details Until GATT_DB_init the runtime add and remove functions return GATT_ERROR_REQUEST_NOT_SUPPORTED,
+ * mutable values can still be written
+ */
+void GATT_DB_freeze(void);
+
+/**
+ * @brief   Check whether the structure of the database is fixed
+ * @return  bool true after GATT_DB_freeze or GATT_DB_load
+ */
+bool GATT_DB_is_frozen(void);
+
+/**
+ * @brief   Get a counter that changes whenever the database is emptied or replaced
+ * @return  uint8_t Generation of the database, lets caches built from a frozen database detect a new one
+ */
+uint8_t GATT_DB_generation(void);
+
+/**
+ * @brief   Get the attribute at a handle
+ * @param   handle Attribute handle
+ * @return  const GATTAttribute* The attribute, or NULL if the handle is not in the database
+ * @details Direct index into the table, no search
+ */
+const GATTAttribute *GATT_DB_get(uint16_t handle);
+
+/**
+ * @brief   Get the highest handle in use
+ * @return  uint16_t Last handle, 0 for an empty database
+ */
+uint16_t GATT_DB_last_handle(void);
+
+/**
+ * @brief   Append a service
+ * @param   uuid Service UUID
+ * @param   is_primary true for a primary service, false for a secondary one
+ * @return  GATTError GATT_ERROR_INSUFFICIENT_RESOURCES if the table is full
+ * @details Like the other runtime table functions, not available once the database is frozen
+ */
+GATTError GATT_DB_add_service(uint16_t uuid, bool is_primary);
+
+/**
+ * @brief   Remove a service with everything it contains
+ * @param   uuid Service UUID
+ * @return  GATTError GATT_ERROR_INVALID_HANDLE if no such service exists
+ * @details Attributes after the service move down and the value arena is compacted
+ */
+GATTError GATT_DB_remove_service(uint16_t uuid);
+
+/**
+ * @brief   Add a characteristic at the end of a service
+ * @param   service_uuid UUID of the service
+ * @param   uuid Characteristic UUID
+ * @param   properties GATTCharacteristicProperties
+ * @param   permissions GATTCharacteristicPermissions
+ * @param   value Initial value, may be NULL if length is 0
+ * @param   length Length of the initial value
+ * @param   capacity Bytes reserved for the value, at least length
+ * @return  GATTError GATT_ERROR_INSUFFICIENT_RESOURCES if the table or the arena is full
+ * @details Adds the declaration, the value and, for notifying or indicating characteristics, a CCCD.
+ * Attributes of later services move up.
+ */
+GATTError GATT_DB_add_characteristic(uint16_t service_uuid, uint16_t uuid, uint8_t properties, uint8_t permissions,
+                                     const uint8_t *value, uint16_t length, uint16_t capacity);
+
+/**
+ * @brief   Find a service declaration
+ * @param   uuid Service UUID
+ * @return  uint16_t Handle of the declaration, 0 if not found
+ */
+uint16_t GATT_DB_find_service(uint16_t uuid);
+
+/**
+ * @brief   Get the last handle belonging to a service
+ * @param   service_handle Handle of the service declaration
+ * @return  uint16_t End of the service group
+ */
+uint16_t GATT_DB_service_end(uint16_t service_handle);
+
+/**
+ * @brief   Find a characteristic value within a service
+ * @param   service_handle Handle of the service declaration
+ * @param   uuid Characteristic UUID
+ * @return  uint16_t Handle of the value attribute, 0 if not found
+ */
+uint16_t GATT_DB_find_characteristic(uint16_t service_handle, uint16_t uuid);
+
+/**
+ * @brief   Resolve a characteristic declaration or value handle to the value handle
+ * @param   handle Declaration or value handle
+ * @return  uint16_t Handle of the value attribute, 0 if the handle is not part of a characteristic
+ */
+uint16_t GATT_DB_value_handle(uint16_t handle);
+
+/**
+ * @brief   Resolve a descriptor to the value handle of its characteristic
+ * @param   handle Descriptor handle
+ * @return  uint16_t Handle of the value attribute, 0 if the handle is not a descriptor
+ * @details Descriptors follow the value in any order, e.g. a CCCD behind a user description, so this
+ * walks back to the characteristic declaration
+ */
+uint16_t GATT_DB_descriptor_owner(uint16_t handle);
+
+/**
+ * @brief   Read the value of an attribute
+ * @param   handle Attribute handle
+ * @param   scratch Room for values derived from the table, GATT_DB_SCRATCH_SIZE bytes
+ * @param   length Output for the length of the value
+ * @return  const uint8_t* The value, or NULL for CCCDs and unknown handles
+ */
+const uint8_t *GATT_DB_read(uint16_t handle, uint8_t *scratch, uint16_t *length);
+
+/**
+ * @brief   Replace a mutable value
+ * @param   handle Value handle
+ * @param   value New value
+ * @param   length Length of the new value
+ * @return  GATTError GATT_ERROR_INVALID_VALUE_LENGTH if it exceeds the capacity of the value
+ */
+GATTError GATT_DB_write(uint16_t handle, const uint8_t *value, uint16_t length);
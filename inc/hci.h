@@ -5,19 +5,41 @@
 
 #include "hci_defs.h"
 
+/** LL PDU time in us on the LE 1M PHY for a payload size, header, MIC and CRC add 14 octets */
+#define LE_1M_PDU_TIME(octets) (((octets) + 14) * 8)
+
+/**
+ * @brief   Lifecycle of the controller itself, what it is doing is tracked per role in HCIRoles
+ */
 typedef enum {
   HCI_STATE_IDLE,
   HCI_STATE_WAITING_RESPONSE,
   HCI_STATE_ON,
-  HCI_STATE_ADVERTISING,
-  HCI_STATE_SCANNING,
-  HCI_STATE_CONNECTING,
-  HCI_STATE_CONNECTED,
-  HCI_STATE_DISCONNECTED,
   HCI_STATE_SLEEP,
   HCI_STATE_ERROR
 } HCIState;
 
+/**
+ * @brief   State of one controller role
+ */
+typedef enum {
+  HCI_ROLE_OFF,      /**< Role not running */
+  HCI_ROLE_STARTING, /**< Enable sent, waiting for the controller */
+  HCI_ROLE_ON,       /**< Role running */
+  HCI_ROLE_STOPPING  /**< Disable sent, waiting for the controller */
+} HCIRoleState;
+
+/**
+ * @brief   Snapshot of everything the controller runs at once
+ */
+typedef struct {
+  HCIRoleState advertiser;  /**< Legacy advertising */
+  HCIRoleState scanner;     /**< Scanning */
+  HCIRoleState initiator;   /**< LE Create Connection */
+  uint8_t central_links;    /**< Connections on which the local device is central */
+  uint8_t peripheral_links; /**< Connections on which the local device is peripheral */
+} HCIRoles;
+
 typedef enum {
   HCI_ERROR_SUCCESS,
   HCI_ERROR_INVALID_OPCODE,
@@ -63,6 +85,21 @@ typedef struct {
   uint8_t *parameters;
 } HCIEvent;
 
+/** Handler for an HCI event or LE subevent, receives the parameters after the (sub)event code */
+typedef void (*HCIEventHandler)(uint8_t *parameters, uint8_t parameter_length);
+
+#define HCI_MAX_EVENT_CODE 0x7F   /**< Highest event code covered by the event mask pages */
+#define HCI_MAX_LE_SUBEVENT 0x40  /**< Highest LE subevent code covered by the LE event mask */
+
+/**
+ * @brief   Event masks derived from the registered handlers
+ */
+typedef struct {
+  uint64_t event_mask;        /**< Set Event Mask, event codes 0x01-0x3F */
+  uint64_t event_mask_page_2; /**< Set Event Mask Page 2, event codes 0x40-0x7F */
+  uint64_t le_event_mask;     /**< LE Set Event Mask, LE subevent codes 0x01-0x40 */
+} HCIEventMasks;
+
 typedef struct {
   uint8_t hci_version;
   uint16_t hci_revision;
@@ -121,6 +158,21 @@ HCIError HCI_decode_packet(uint8_t *buffer, uint16_t buffer_size, uint8_t *packe
  */
 HCIError HCI_send_command(HCICommand *cmd);
 
+/**
+ * @brief   Send an HCI command without claiming the response wait
+ * @param   cmd Pointer to the HCI command to be sent
+ * @return  HCIError Indicates the success or failure of sending the command
+ * @details Its completion does not release a concurrent HCI_wait_response(). Used for commands
+ * issued from HCI event handlers, which run in interrupt context.
+ */
+HCIError HCI_send_command_async(HCICommand *cmd);
+
+/**
+ * @brief   Get the number of commands the controller currently accepts
+ * @return  uint8_t Num_HCI_Command_Packets of the last command complete or status, less commands sent since
+ */
+uint8_t HCI_get_command_credits(void);
+
 /**
  * @brief   Send asynchronous data through the HCI layer
  * @param   data Pointer to the asynchronous data to be sent
@@ -147,6 +199,14 @@ HCIError HCI_BLE_set_advertising_param(uint16_t adv_interval_min, uint16_t adv_i
                                        uint8_t *direct_address, Adv_ChannelMap adv_channel_map,
                                        Adv_FilterPolicy adv_filter_policy);
 
+/**
+ * @brief   Enable or disable BLE advertising
+ * @param   enable Boolean flag to turn advertising on or off
+ * @return  HCIError Indicates the success or failure of changing advertising state
+ * @details Moves the advertiser role to starting or stopping, the command completion settles it
+ */
+HCIError HCI_BLE_set_advertise_enable(bool enable);
+
 /**
  * @brief   Configure BLE scanning parameters
  * @param   scan_type Type of scan to perform
@@ -169,6 +229,31 @@ HCIError HCI_BLE_set_scan_parameters(Scan_Type scan_type, uint16_t scan_interval
  */
 HCIError HCI_BLE_set_scan_enable(bool enable, bool filter_duplicates);
 
+/**
+ * @brief   Configure BLE scanning with the extended scanning commands
+ * @param   scan_type Type of scan to perform
+ * @param   scan_interval_ms Interval between scan cycles in milliseconds
+ * @param   scan_window_ms Duration of each scan cycle in milliseconds
+ * @param   own_address_type Address type for the local device
+ * @param   scanning_filter_policy Filtering policy for scanning
+ * @param   phys Phy_Preference bits of the primary PHYs to scan, LE 1M and/or LE Coded
+ * @return  HCIError Indicates the success or failure of setting scan parameters
+ * @details Extended scanning also receives extended advertising. Once used, the controller rejects the
+ * legacy scan commands until it is reset.
+ */
+HCIError HCI_BLE_set_extended_scan_parameters(Scan_Type scan_type, uint16_t scan_interval_ms, uint16_t scan_window_ms,
+                                              Scan_OwnAddressType own_address_type,
+                                              Scan_FilterPolicy scanning_filter_policy, uint8_t phys);
+
+/**
+ * @brief   Enable or disable extended scanning
+ * @param   enable Boolean flag to turn scanning on or off
+ * @param   filter_duplicates Flag to filter out duplicate reports
+ * @return  HCIError Indicates the success or failure of changing scanning state
+ * @details Scans until disabled, reports arrive as LE Extended Advertising Report events
+ */
+HCIError HCI_BLE_set_extended_scan_enable(bool enable, bool filter_duplicates);
+
 /**
  * @brief   Initiate a BLE connection
  * @param   scan_interval_ms Interval between scan cycles in milliseconds
@@ -190,6 +275,37 @@ HCIError HCI_BLE_create_connection(uint16_t scan_interval_ms, uint16_t scan_wind
                                    uint16_t conn_interval_min_ms, uint16_t conn_interval_max_ms, uint16_t conn_latency,
                                    uint16_t supervision_timeout_ms);
 
+/**
+ * @brief   Initiate a BLE connection without waiting for the controller's response
+ * @param   scan_interval_ms Interval between scan cycles in milliseconds
+ * @param   scan_window_ms Duration of each scan cycle in milliseconds
+ * @param   filter_policy Connection initiator filter policy
+ * @param   peer_address_type Address type of the target device
+ * @param   peer_address Pointer to the target device's address, ignored with the accept list
+ * @param   own_address_type Local device's address type
+ * @param   conn_interval_min_ms Minimum connection interval
+ * @param   conn_interval_max_ms Maximum connection interval
+ * @param   conn_latency Connection latency parameter
+ * @param   supervision_timeout_ms Supervision timeout in milliseconds
+ * @return  HCIError Indicates the success or failure of sending the command
+ * @details Used for background initiation, the command status and the connection complete event arrive
+ * through the event handlers
+ */
+HCIError HCI_BLE_create_connection_async(uint16_t scan_interval_ms, uint16_t scan_window_ms,
+                                         Conn_InitiatorFilterPolicy filter_policy,
+                                         Conn_PeerAddressType peer_address_type, uint8_t *peer_address,
+                                         Conn_OwnAddressType own_address_type, uint16_t conn_interval_min_ms,
+                                         uint16_t conn_interval_max_ms, uint16_t conn_latency,
+                                         uint16_t supervision_timeout_ms);
+
+/**
+ * @brief   Stop a pending connection initiation without waiting for the controller's response
+ * @return  HCIError Indicates the success or failure of sending the command
+ * @details The controller ends the initiation with an LE connection complete event carrying the
+ * Unknown Connection Identifier status
+ */
+HCIError HCI_BLE_create_connection_cancel_async(void);
+
 /**
  * @brief   Update parameters of an existing BLE connection
  * @param   connection_handle Handle identifying the connection to update
@@ -203,6 +319,96 @@ HCIError HCI_BLE_create_connection(uint16_t scan_interval_ms, uint16_t scan_wind
 HCIError HCI_BLE_connection_update(uint16_t connection_handle, uint16_t conn_interval_min_ms, uint16_t conn_interval_max_ms,
                                    uint16_t conn_latency, uint16_t supervision_timeout_ms);
 
+/**
+ * @brief   Request new parameters for a connection without waiting for the controller's response
+ * @param   connection_handle Handle identifying the connection to update
+ * @param   conn_interval_min Minimum connection interval in 1.25 ms units
+ * @param   conn_interval_max Maximum connection interval in 1.25 ms units
+ * @param   conn_latency Connection latency in connection events
+ * @param   supervision_timeout Supervision timeout in 10 ms units
+ * @return  HCIError Indicates the success or failure of sending the command
+ * @details Safe to call from HCI event handlers, which run in interrupt context
+ */
+HCIError HCI_BLE_connection_update_async(uint16_t connection_handle, uint16_t conn_interval_min,
+                                         uint16_t conn_interval_max, uint16_t conn_latency,
+                                         uint16_t supervision_timeout);
+
+/**
+ * @brief   Accept a peer's connection parameter request
+ * @param   connection_handle Handle of the connection the request arrived on
+ * @param   conn_interval_min Minimum connection interval in 1.25 ms units
+ * @param   conn_interval_max Maximum connection interval in 1.25 ms units
+ * @param   conn_latency Connection latency in connection events
+ * @param   supervision_timeout Supervision timeout in 10 ms units
+ * @return  HCIError Indicates the success or failure of sending the reply
+ * @details Does not wait for the controller, safe to call from HCI event handlers
+ */
+HCIError HCI_BLE_remote_connection_parameter_request_reply(uint16_t connection_handle, uint16_t conn_interval_min,
+                                                           uint16_t conn_interval_max, uint16_t conn_latency,
+                                                           uint16_t supervision_timeout);
+
+/**
+ * @brief   Reject a peer's connection parameter request
+ * @param   connection_handle Handle of the connection the request arrived on
+ * @param   reason Reason code reported to the peer
+ * @return  HCIError Indicates the success or failure of sending the reply
+ * @details Does not wait for the controller, safe to call from HCI event handlers
+ */
+HCIError HCI_BLE_remote_connection_parameter_request_negative_reply(uint16_t connection_handle,
+                                                                    Conn_ParamRejectReason reason);
+
+/**
+ * @brief   Read the largest LE data length the controller supports
+ * @param   max_tx_octets Output for the maximum LL payload octets
+ * @param   max_tx_time Output for the maximum LL PDU time in microseconds
+ * @return  HCIError Indicates the success or failure of reading the data length
+ */
+HCIError HCI_BLE_read_maximum_data_length(uint16_t *max_tx_octets, uint16_t *max_tx_time);
+
+/**
+ * @brief   Set the data length the controller proposes on new connections
+ * @param   tx_octets Preferred LL payload octets (27-251)
+ * @param   tx_time Preferred LL PDU time in microseconds (328-17040)
+ * @return  HCIError Indicates the success or failure of writing the default
+ */
+HCIError HCI_BLE_write_suggested_default_data_length(uint16_t tx_octets, uint16_t tx_time);
+
+/**
+ * @brief   Get the LL payload size requested on new connections
+ * @return  uint16_t Octets negotiated at init, 27 if the controller lacks Data Length Extension
+ */
+uint16_t HCI_BLE_get_suggested_data_length(void);
+
+/**
+ * @brief   Start the data length update procedure on a connection
+ * @param   connection_handle Handle identifying the connection
+ * @param   tx_octets Preferred LL payload octets (27-251)
+ * @param   tx_time Preferred LL PDU time in microseconds (328-17040)
+ * @return  HCIError Indicates the success or failure of sending the command
+ * @details Does not wait for the controller, safe to call from HCI event handlers. The result is
+ * reported by the LE Data Length Change event.
+ */
+HCIError HCI_BLE_set_data_length_async(uint16_t connection_handle, uint16_t tx_octets, uint16_t tx_time);
+
+/**
+ * @brief   Set the PHYs the controller prefers for new connections
+ * @param   tx_phys Phy_Preference bits for transmitting
+ * @param   rx_phys Phy_Preference bits for receiving
+ * @return  HCIError Indicates the success or failure of setting the default PHY
+ */
+HCIError HCI_BLE_set_default_phy(uint8_t tx_phys, uint8_t rx_phys);
+
+/**
+ * @brief   Request a PHY update on a connection
+ * @param   connection_handle Handle identifying the connection
+ * @param   tx_phys Phy_Preference bits for transmitting
+ * @param   rx_phys Phy_Preference bits for receiving
+ * @return  HCIError Indicates the success or failure of sending the command
+ * @details Does not wait for the controller, safe to call from HCI event handlers. The result is
+ * reported by the LE PHY Update Complete event.
+ */
+HCIError HCI_BLE_set_phy_async(uint16_t connection_handle, uint8_t tx_phys, uint8_t rx_phys);
+
 /**
  * @brief   Terminate an active Bluetooth connection
  * @param   connection_handle Handle identifying the connection to terminate
@@ -212,13 +418,70 @@ HCIError HCI_BLE_connection_update(uint16_t connection_handle, uint16_t conn_int
  */
 HCIError HCI_disconnect(uint16_t connection_handle, Conn_DisconnectReason reason);
 
+/**
+ * @brief   Terminate a connection without waiting for the controller's response
+ * @param   connection_handle Handle identifying the connection to terminate
+ * @param   reason Reason code for disconnection
+ * @return  HCIError Indicates the success or failure of sending the command
+ * @details Safe to call from HCI event handlers, which run in interrupt context
+ */
+HCIError HCI_disconnect_async(uint16_t connection_handle, Conn_DisconnectReason reason);
+
 /**
  * @brief   Set the BLE event mask to control which events are reported
- * @param   mask Bitmask defining which events to enable
+ * @param   mask Bit n enables LE subevent code n + 1
  * @return  HCIError Indicates the success or failure of setting the event mask
  * @details Configures which Bluetooth Low Energy events will generate notifications
  */
-HCIError HCI_BLE_set_event_mask(uint8_t mask);
+HCIError HCI_BLE_set_event_mask(uint64_t mask);
+
+/**
+ * @brief   Set the page 1 event mask
+ * @param   mask Bit n enables event code n + 1
+ * @return  HCIError Indicates the success or failure of setting the event mask
+ * @details Bit 61 (LE Meta) must be set for any LE event to be reported
+ */
+HCIError HCI_set_event_mask(uint64_t mask);
+
+/**
+ * @brief   Set the page 2 event mask
+ * @param   mask Bit n enables event code n + 0x40
+ * @return  HCIError Indicates the success or failure of setting the event mask
+ */
+HCIError HCI_set_event_mask_page_2(uint64_t mask);
+
+/**
+ * @brief   Register the handler for an HCI event
+ * @param   event_code Event code, up to HCI_MAX_EVENT_CODE
+ * @param   handler Handler to run in interrupt context, NULL to stop handling the event
+ * @return  HCIError Indicates the success or failure of registering the handler
+ * @details Takes effect on the controller with the next HCI_apply_event_masks, which HCI_init runs
+ */
+HCIError HCI_register_event_handler(uint8_t event_code, HCIEventHandler handler);
+
+/**
+ * @brief   Register the handler for an LE subevent
+ * @param   subevent_code LE subevent code, up to HCI_MAX_LE_SUBEVENT
+ * @param   handler Handler to run in interrupt context, NULL to stop handling the subevent
+ * @return  HCIError Indicates the success or failure of registering the handler
+ * @details Takes effect on the controller with the next HCI_apply_event_masks, which HCI_init runs
+ */
+HCIError HCI_register_le_event_handler(uint8_t subevent_code, HCIEventHandler handler);
+
+/**
+ * @brief   Derive the event masks from the registered handlers
+ * @param   masks Output for the three masks
+ * @details Only events with a handler are enabled. Command Complete, Command Status and Number of
+ * Completed Packets cannot be masked and are left out.
+ */
+void HCI_build_event_masks(HCIEventMasks *masks);
+
+/**
+ * @brief   Program the controller with the masks derived from the registered handlers
+ * @return  HCIError Indicates the success or failure of setting the masks
+ * @details Page 2 is only written when it enables something, its default is all zeros
+ */
+HCIError HCI_apply_event_masks(void);
 
 /**
  * @brief   Handle incoming asynchronous data
@@ -281,6 +544,14 @@ void HCI_handle_disconnection_complete_event(uint8_t *parameters, uint8_t parame
  */
 void HCI_handle_BLE_connection_complete(uint8_t *subevent_parameters, uint8_t subevent_length);
 
+/**
+ * @brief   Handle BLE advertising report events
+ * @param   subevent_parameters Pointer to subevent-specific parameters
+ * @param   subevent_length Length of the subevent parameters
+ * @details Parses every report of the event in one pass and passes each to GAP in place
+ */
+void HCI_handle_BLE_advertising_report(uint8_t *subevent_parameters, uint8_t subevent_length);
+
 /**
  * @brief   Handle BLE connection update complete events
  * @param   subevent_parameters Pointer to subevent-specific parameters
@@ -298,6 +569,47 @@ void HCI_handle_BLE_connection_update_complete(uint8_t *subevent_parameters, uin
  */
 void HCI_handle_BLE_enhanced_connection_complete(uint8_t *subevent_parameters, uint8_t subevent_length);
 
+/**
+ * @brief   Handle BLE remote connection parameter request events
+ * @param   subevent_parameters Pointer to subevent-specific parameters
+ * @param   subevent_length Length of the subevent parameters
+ * @details Records the request on the connection, CONN_PARAMS_process runs it through the GAP parameter
+ * policy and replies
+ */
+void HCI_handle_BLE_remote_connection_parameter_request(uint8_t *subevent_parameters, uint8_t subevent_length);
+
+/**
+ * @brief   Handle BLE data length change events
+ * @param   subevent_parameters Pointer to subevent-specific parameters
+ * @param   subevent_length Length of the subevent parameters
+ * @details Stores the negotiated LL payload sizes and times in the connection context
+ */
+void HCI_handle_BLE_data_length_change(uint8_t *subevent_parameters, uint8_t subevent_length);
+
+/**
+ * @brief   Handle BLE PHY update complete events
+ * @param   subevent_parameters Pointer to subevent-specific parameters
+ * @param   subevent_length Length of the subevent parameters
+ * @details Stores the PHYs now in use in the connection context
+ */
+void HCI_handle_BLE_phy_update_complete(uint8_t *subevent_parameters, uint8_t subevent_length);
+
+/**
+ * @brief   Handle BLE advertising set terminated events
+ * @param   subevent_parameters Pointer to subevent-specific parameters
+ * @param   subevent_length Length of the subevent parameters
+ * @details Marks an extended advertising set stopped by a connection, its duration or its event limit
+ */
+void HCI_handle_BLE_advertising_set_terminated(uint8_t *subevent_parameters, uint8_t subevent_length);
+
+/**
+ * @brief   Handle BLE extended advertising report events
+ * @param   subevent_parameters Pointer to subevent-specific parameters
+ * @param   subevent_length Length of the subevent parameters
+ * @details Parses every report of the event in one pass and passes each to the extended scan reassembly
+ */
+void HCI_handle_BLE_extended_advertising_report(uint8_t *subevent_parameters, uint8_t subevent_length);
+
 /**
  * @brief   Retrieve the current HCI layer state
  * @return  HCIState Current state of the HCI layer
@@ -305,6 +617,14 @@ void HCI_handle_BLE_enhanced_connection_complete(uint8_t *subevent_parameters, u
  */
 HCIState HCI_get_state(void);
 
+/**
+ * @brief   Get the state of every controller role
+ * @param   roles Output for the snapshot
+ * @details Advertiser, scanner and initiator change only on the completion of the commands that
+ * start and stop them and on the events that end them, so they never overwrite each other
+ */
+void HCI_get_roles(HCIRoles *roles);
+
 /**
  * @brief   Set the current HCI layer state
  * @param   new_state The state to transition the HCI layer to
@@ -352,10 +672,10 @@ void HCI_handle_hw_rx(uint8_t byte);
 
 /**
  * @brief   Check available buffer space
- * @return  uint8_t Number of free buffer slots
+ * @return  uint16_t Number of free buffer slots
  * @details Returns the amount of remaining space in the HCI communication buffer
  */
-uint8_t HCI_buffer_space();
+uint16_t HCI_buffer_space();
 
 /**
  * @brief   Parse an incoming HCI event
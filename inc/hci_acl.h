@@ -0,0 +1,140 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bt_config.h"
+#include "hci.h"
+#include "l2cap.h"
+
+#define HCI_ACL_POOL_SIZE BT_ACL_TX_POOL_SIZE               /**< L2CAP PDUs queued across all connections */
+#define HCI_ACL_LINK_QUEUE_LIMIT BT_ACL_TX_LINK_QUEUE_LIMIT /**< Low priority PDUs queued per connection */
+#define HCI_ACL_DEFAULT_DATA_LENGTH 27  /**< LE ACL data packet length assumed until the controller reports it */
+#define HCI_ACL_DEFAULT_NUM_PACKETS 4   /**< LE ACL buffers assumed until the controller reports them */
+#define HCI_ACL_NO_BUFFER 0xFF          /**< Marks an empty queue link */
+
+/** Largest L2CAP payload one TX buffer holds */
+#define HCI_ACL_MAX_PAYLOAD (L2CAP_MAX_PDU_SIZE - L2CAP_HEADER_SIZE)
+
+/**
+ * @brief   Outbound ACL traffic classes, highest priority first
+ */
+typedef enum {
+  HCI_ACL_PRIORITY_SIGNALING,    /**< L2CAP signaling channel */
+  HCI_ACL_PRIORITY_ATT_RESPONSE, /**< ATT requests, responses and confirmations */
+  HCI_ACL_PRIORITY_INDICATION,   /**< ATT handle value indications */
+  HCI_ACL_PRIORITY_NOTIFICATION, /**< ATT handle value notifications */
+  HCI_ACL_PRIORITY_BULK,         /**< Bulk data (e.g. L2CAP credit based channels) */
+  HCI_ACL_PRIORITY_COUNT
+} HCI_ACLPriority;
+
+/**
+ * @brief   Per-connection outbound ACL queues
+ * @details One FIFO per priority, plus the PDU currently being fragmented. Fragments of one PDU must
+ * not interleave with another PDU on the same connection, so a started PDU always finishes first.
+ */
+typedef struct {
+  uint8_t head[HCI_ACL_PRIORITY_COUNT];    /**< First queued buffer per priority */
+  uint8_t tail[HCI_ACL_PRIORITY_COUNT];    /**< Last queued buffer per priority */
+  uint8_t queued;                          /**< Number of PDUs waiting in the queues */
+  uint8_t current;                         /**< Buffer being fragmented, or HCI_ACL_NO_BUFFER */
+  uint8_t current_priority;                /**< Priority of the buffer being fragmented */
+  uint16_t current_offset;                 /**< Bytes of the current buffer already sent */
+  volatile uint8_t packets_sent;           /**< ACL packets handed to the controller, counts up and wraps */
+  volatile uint8_t packets_completed;      /**< ACL packets the controller reported done, advanced by the interrupt */
+} HCI_ACLQueue;
+
+/**
+ * @brief   Initialize the ACL TX scheduler
+ * @details Empties the buffer pool and restores the default controller buffer credits
+ */
+void HCI_ACL_init(void);
+
+/**
+ * @brief   Reset a connection's queues to empty
+ * @param   queue Pointer to the queues to reset
+ * @details Does not release buffers, use HCI_ACL_flush for a queue that may hold data
+ */
+void HCI_ACL_queue_init(HCI_ACLQueue *queue);
+
+/**
+ * @brief   Set the controller's LE ACL buffer geometry
+ * @param   data_packet_length Maximum payload of a single HCI ACL data packet
+ * @param   total_num_packets Number of ACL data packets the controller can buffer
+ * @details Normally fed from the LE Read Buffer Size command complete event
+ */
+void HCI_ACL_set_buffer_size(uint16_t data_packet_length, uint8_t total_num_packets);
+
+/**
+ * @brief   Queue an L2CAP PDU for transmission
+ * @param   connection_handle Connection to send on
+ * @param   cid L2CAP channel ID
+ * @param   priority Traffic class of the PDU
+ * @param   payload Pointer to the L2CAP payload (the basic header is added here)
+ * @param   length Length of the payload
+ * @return  HCIError Indicates the success or failure of queueing the PDU
+ * @details The payload is copied, so the caller may reuse its buffer immediately. The PDU goes out on the
+ * next HCI_ACL_schedule. Never call from interrupt context.
+ */
+HCIError HCI_ACL_enqueue(uint16_t connection_handle, uint16_t cid, HCI_ACLPriority priority, uint8_t *payload,
+                         uint16_t length);
+
+/**
+ * @brief   Take a TX buffer to encode an L2CAP payload in place
+ * @param   payload Output for where the payload goes, HCI_ACL_MAX_PAYLOAD bytes are available
+ * @return  uint8_t Buffer for HCI_ACL_commit or HCI_ACL_release, HCI_ACL_NO_BUFFER if the pool is empty
+ * @details Saves the copy HCI_ACL_enqueue makes for payloads built field by field
+ */
+uint8_t HCI_ACL_reserve(uint8_t **payload);
+
+/**
+ * @brief   Queue a reserved buffer for transmission
+ * @param   connection_handle Connection to send on
+ * @param   cid L2CAP channel ID
+ * @param   priority Traffic class of the PDU
+ * @param   buffer_index Buffer returned by HCI_ACL_reserve
+ * @param   length Length of the payload written to the buffer
+ * @return  HCIError Indicates the success or failure of queueing the PDU
+ * @details The buffer goes back to the pool if it cannot be queued
+ */
+HCIError HCI_ACL_commit(uint16_t connection_handle, uint16_t cid, HCI_ACLPriority priority, uint8_t buffer_index,
+                        uint16_t length);
+
+/**
+ * @brief   Return a reserved buffer that will not be sent
+ * @param   buffer_index Buffer returned by HCI_ACL_reserve
+ */
+void HCI_ACL_release(uint8_t buffer_index);
+
+/**
+ * @brief   Hand queued ACL fragments to the controller
+ * @details Sends fragments while controller buffer credits are available. The highest priority class
+ * waiting on any connection goes first; connections waiting in the same class are served round-robin
+ * over the connection table. Called by bluetooth_stack_process, never from interrupt context, so only the
+ * main loop touches the pool, the queues and the UART for ACL data.
+ */
+void HCI_ACL_schedule(void);
+
+/**
+ * @brief   Handle the Number Of Completed Packets event
+ * @param   parameters Pointer to event-specific parameters
+ * @param   parameter_length Length of the parameters
+ * @details Runs in interrupt context and only counts the completed packets per connection, the credits
+ * they free are used by the next HCI_ACL_schedule
+ */
+void HCI_ACL_handle_completed_packets(uint8_t *parameters, uint8_t parameter_length);
+
+/**
+ * @brief   Drop all queued data of a closed connection
+ * @param   queue Queues of the connection
+ * @details The controller discards buffered packets of a closed link, so their credits are returned.
+ * Never call from interrupt context.
+ */
+void HCI_ACL_flush(HCI_ACLQueue *queue);
+
+/**
+ * @brief   Get the number of free controller ACL buffers
+ * @return  uint8_t Number of ACL packets that can be sent right now
+ * @details Derived from the packets in flight on every live connection
+ */
+uint8_t HCI_ACL_get_free_credits(void);
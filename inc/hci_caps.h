@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hci.h"
+
+/* Supported commands bits, (octet << 3) | bit as listed for Read Local Supported Commands */
+#define HCI_CAPS_CMD_SET_EVENT_MASK_PAGE_2 ((22 << 3) | 2)
+#define HCI_CAPS_CMD_LE_REMOTE_CONN_PARAM_REQUEST_REPLY ((33 << 3) | 4)
+#define HCI_CAPS_CMD_LE_SET_DATA_LENGTH ((33 << 3) | 6)
+#define HCI_CAPS_CMD_LE_WRITE_SUGGESTED_DEFAULT_DATA_LENGTH ((34 << 3) | 0)
+#define HCI_CAPS_CMD_LE_READ_MAXIMUM_DATA_LENGTH ((35 << 3) | 3)
+#define HCI_CAPS_CMD_LE_SET_DEFAULT_PHY ((35 << 3) | 5)
+#define HCI_CAPS_CMD_LE_SET_PHY ((35 << 3) | 6)
+
+/* LMP feature bits, (page 0 octet << 3) | bit */
+#define HCI_CAPS_LMP_LE_SUPPORTED ((4 << 3) | 6)
+
+/**
+ * @brief   LE link layer feature bits reported by LE Read Local Supported Features
+ */
+typedef enum {
+  HCI_LE_FEATURE_ENCRYPTION = 0,
+  HCI_LE_FEATURE_CONN_PARAM_REQUEST = 1,
+  HCI_LE_FEATURE_EXTENDED_REJECT = 2,
+  HCI_LE_FEATURE_PERIPHERAL_FEATURE_EXCHANGE = 3,
+  HCI_LE_FEATURE_PING = 4,
+  HCI_LE_FEATURE_DATA_LENGTH_EXTENSION = 5,
+  HCI_LE_FEATURE_LL_PRIVACY = 6,
+  HCI_LE_FEATURE_EXTENDED_SCANNER_FILTER = 7,
+  HCI_LE_FEATURE_2M_PHY = 8,
+  HCI_LE_FEATURE_CODED_PHY = 11,
+  HCI_LE_FEATURE_EXTENDED_ADVERTISING = 12,
+  HCI_LE_FEATURE_PERIODIC_ADVERTISING = 13,
+  HCI_LE_FEATURE_CHANNEL_SELECTION_2 = 14
+} HCI_LEFeature;
+
+/**
+ * @brief   Everything learned about the controller at init
+ */
+typedef struct {
+  uint8_t commands[64];        /**< Supported commands bitmap */
+  uint8_t lmp_features[8];     /**< LMP features page 0 */
+  uint64_t le_features;        /**< HCI_LEFeature bits */
+  uint64_t le_states;          /**< LE supported states */
+  uint16_t le_acl_data_length; /**< LE ACL data packet length */
+  uint8_t le_acl_num_packets;  /**< LE ACL data packets the controller buffers */
+  bool valid;                  /**< Discovery completed */
+} HCICapabilities;
+
+/**
+ * @brief   Query the controller's capabilities
+ * @return  HCIError Indicates the success or failure of the discovery
+ * @details Sends all queries back to back, as far as the controller's command credits allow, and waits
+ * for the answers. The LE buffer size is passed on to the ACL scheduler. Called by HCI_init.
+ */
+HCIError HCI_CAPS_discover(void);
+
+/**
+ * @brief   Consume the answer to a discovery query
+ * @param   op_code Command the answer belongs to
+ * @param   status Status of the command
+ * @param   return_parameters Return parameters after the status
+ * @param   length Length of the return parameters
+ * @return  bool true if the answer belonged to a discovery query
+ * @details Called by the command complete handler in interrupt context
+ */
+bool HCI_CAPS_handle_command_complete(uint16_t op_code, uint8_t status, uint8_t *return_parameters, uint8_t length);
+
+/**
+ * @brief   Check whether the controller supports an HCI command
+ * @param   command HCI_CAPS_CMD_* bit
+ * @return  bool true if supported, false if unsupported or discovery has not run
+ */
+bool HCI_CAPS_command_supported(uint16_t command);
+
+/**
+ * @brief   Check whether the controller supports an LMP feature
+ * @param   feature HCI_CAPS_LMP_* bit
+ * @return  bool true if supported, false if unsupported or discovery has not run
+ */
+bool HCI_CAPS_lmp_feature_supported(uint16_t feature);
+
+/**
+ * @brief   Check whether the controller supports an LE link layer feature
+ * @param   feature Feature bit
+ * @return  bool true if supported, false if unsupported or discovery has not run
+ */
+bool HCI_CAPS_le_feature_supported(HCI_LEFeature feature);
+
+/**
+ * @brief   Check whether the controller supports an LE state or state combination
+ * @param   state Bit of the LE Read Supported States bitmap
+ * @return  bool true if supported, false if unsupported or discovery has not run
+ */
+bool HCI_CAPS_le_state_supported(uint8_t state);
+
+/**
+ * @brief   Get the full capability cache
+ * @return  const HCICapabilities* Cached capabilities
+ */
+const HCICapabilities *HCI_CAPS_get(void);
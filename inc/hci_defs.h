@@ -17,6 +17,7 @@ typedef enum {
   CMD_BT_READ_LOCAL_VERSION_INFORMATION = 0x1001,
   CMD_BT_READ_LOCAL_SUPPORTED_COMMANDS = 0x1002,
   CMD_BT_READ_LOCAL_SUPPORTED_FEATURES = 0x1003,
+  CMD_BT_READ_BUFFER_SIZE = 0x1005,
   CMD_BT_READ_BD_ADDR = 0x1009,
   CMD_BT_READ_RSSI = 0x1405,
 
@@ -67,6 +68,20 @@ typedef enum {
   CMD_BLE_SET_ADDRESS_RESOLUTION_ENABLE = 0x202D,
   CMD_BLE_SET_RESOLVABLE_PRIVATE_ADDRESS_TIMEOUT = 0x202E,
   CMD_BLE_READ_MAXIMUM_DATA_LENGTH = 0x202F,
+  CMD_BLE_READ_PHY = 0x2030,
+  CMD_BLE_SET_DEFAULT_PHY = 0x2031,
+  CMD_BLE_SET_PHY = 0x2032,
+  CMD_BLE_SET_ADVERTISING_SET_RANDOM_ADDRESS = 0x2035,
+  CMD_BLE_SET_EXTENDED_ADVERTISING_PARAMETERS = 0x2036,
+  CMD_BLE_SET_EXTENDED_ADVERTISING_DATA = 0x2037,
+  CMD_BLE_SET_EXTENDED_SCAN_RESPONSE_DATA = 0x2038,
+  CMD_BLE_SET_EXTENDED_ADVERTISING_ENABLE = 0x2039,
+  CMD_BLE_READ_MAXIMUM_ADVERTISING_DATA_LENGTH = 0x203A,
+  CMD_BLE_READ_NUMBER_OF_SUPPORTED_ADVERTISING_SETS = 0x203B,
+  CMD_BLE_REMOVE_ADVERTISING_SET = 0x203C,
+  CMD_BLE_CLEAR_ADVERTISING_SETS = 0x203D,
+  CMD_BLE_SET_EXTENDED_SCAN_PARAMETERS = 0x2041,
+  CMD_BLE_SET_EXTENDED_SCAN_ENABLE = 0x2042,
 
   /* Broadcom Vendor Commands. */
   CMD_BROADCOM_SET_SLEEP_MODE = 0xFC27,
@@ -115,7 +130,16 @@ typedef enum {
   SUB_EVNT_BLE_READ_LOCAL_P256_PUBLIC_KEY_COMPLETE,
   SUB_EVNT_BLE_GENERATE_DHKEY_COMPLETE,
   SUB_EVNT_BLE_ENHANCED_CONNECTION_COMPLETED,
-  SUB_EVNT_BLE_DIRECT_ADVERTISING_REPORT
+  SUB_EVNT_BLE_DIRECT_ADVERTISING_REPORT,
+  SUB_EVNT_BLE_PHY_UPDATE_COMPLETE,
+  SUB_EVNT_BLE_EXTENDED_ADVERTISING_REPORT,
+  SUB_EVNT_BLE_PERIODIC_ADVERTISING_SYNC_ESTABLISHED,
+  SUB_EVNT_BLE_PERIODIC_ADVERTISING_REPORT,
+  SUB_EVNT_BLE_PERIODIC_ADVERTISING_SYNC_LOST,
+  SUB_EVNT_BLE_SCAN_TIMEOUT,
+  SUB_EVNT_BLE_ADVERTISING_SET_TERMINATED,
+  SUB_EVNT_BLE_SCAN_REQUEST_RECEIVED,
+  SUB_EVNT_BLE_CHANNEL_SELECTION_ALGORITHM
 } HCI_SubEventCode;
 
 typedef enum {
@@ -178,6 +202,36 @@ typedef enum {
   SCAN_WHITELIST_ONLY,
 } Scan_FilterPolicy;
 
+typedef enum {
+  SCAN_REPORT_ADV_IND,         /** Connectable undirected advertising */
+  SCAN_REPORT_ADV_DIRECT_IND,  /** Connectable directed advertising */
+  SCAN_REPORT_ADV_SCAN_IND,    /** Scannable undirected advertising */
+  SCAN_REPORT_ADV_NONCONN_IND, /** Non-connectable undirected advertising */
+  SCAN_REPORT_SCAN_RSP,        /** Scan response */
+  SCAN_REPORT_EXT_ADV,         /** Advertising data sent with extended advertising PDUs */
+  SCAN_REPORT_EXT_SCAN_RSP     /** Scan response to extended advertising */
+} Scan_ReportType;
+
+/** Legacy advertising report: event type, address type, address, data length and RSSI around the data */
+#define SCAN_REPORT_FIXED_SIZE 10
+
+/** Extended advertising report: everything from the event type to the data length */
+#define EXT_SCAN_REPORT_FIXED_SIZE 24
+
+/* Event_Type bits of an extended advertising report */
+#define EXT_SCAN_EVENT_CONNECTABLE 0x0001
+#define EXT_SCAN_EVENT_SCANNABLE 0x0002
+#define EXT_SCAN_EVENT_DIRECTED 0x0004
+#define EXT_SCAN_EVENT_SCAN_RSP 0x0008
+#define EXT_SCAN_EVENT_LEGACY 0x0010
+#define EXT_SCAN_EVENT_DATA_STATUS_SHIFT 5
+#define EXT_SCAN_EVENT_DATA_STATUS_MASK 0x0060
+
+/* Data status of an extended advertising report */
+#define EXT_SCAN_DATA_COMPLETE 0x00
+#define EXT_SCAN_DATA_MORE 0x01
+#define EXT_SCAN_DATA_TRUNCATED 0x02
+
 /***************************************************************************************
  * Connection defs
  **************************************************************************************/
@@ -198,6 +252,8 @@ typedef enum {
   CONN_OWN_NON_RESOLVABLE_PRIVATE_ADDRESS
 } Conn_OwnAddressType;
 
+typedef enum { CONN_ROLE_CENTRAL, CONN_ROLE_PERIPHERAL } Conn_Role;
+
 typedef enum {
   CONN_DISCONNECT_AUTHENTICATION_FAILURE = 0x05,
   CONN_DISCONNECT_REMOTE_USER_TERMINATED = 0x13,
@@ -206,6 +262,27 @@ typedef enum {
   CONN_DISCONNECT_CONNECTION_TIMEOUT = 0x22
 } Conn_DisconnectReason;
 
+typedef enum { CONN_PARAM_REJECT_UNACCEPTABLE_PARAMETERS = 0x3B } Conn_ParamRejectReason;
+
+/* Connection complete status ending high duty cycle directed advertising */
+#define STATUS_ADVERTISING_TIMEOUT 0x3C
+
+/***************************************************************************************
+ * PHY defs
+ **************************************************************************************/
+
+typedef enum {
+  PHY_LE_1M = 0x01,   /** LE 1M PHY */
+  PHY_LE_2M = 0x02,   /** LE 2M PHY */
+  PHY_LE_CODED = 0x03 /** LE Coded PHY */
+} Phy_Type;
+
+typedef enum {
+  PHY_PREFER_LE_1M = 0x01,   /** LE 1M PHY acceptable */
+  PHY_PREFER_LE_2M = 0x02,   /** LE 2M PHY acceptable */
+  PHY_PREFER_LE_CODED = 0x04 /** LE Coded PHY acceptable */
+} Phy_Preference;
+
 /***************************************************************************************
  * Hardware RX defs
  **************************************************************************************/
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "bt_config.h"
+#include "gap.h"
+#include "hci.h"
+
+/** L2CAP basic header: PDU length + channel ID */
+#define L2CAP_HEADER_SIZE 4
+
+/** L2CAP basic header + largest ATT PDU */
+#define L2CAP_MAX_PDU_SIZE 521
+
+/** Complete inbound PDUs waiting for L2CAP_process */
+#define L2CAP_RX_QUEUE_SIZE BT_L2CAP_RX_QUEUE_SIZE
+
+/* Fixed LE channel IDs */
+#define L2CAP_LE_SIGNALING_CID 0x0005
+
+/** Signaling command header: code + identifier + data length */
+#define L2CAP_SIG_HEADER_SIZE 4
+
+/* LE signaling command codes */
+#define L2CAP_SIG_COMMAND_REJECT 0x01
+#define L2CAP_SIG_CONN_PARAM_UPDATE_REQUEST 0x12
+#define L2CAP_SIG_CONN_PARAM_UPDATE_RESPONSE 0x13
+
+/* Command Reject reasons */
+#define L2CAP_REJECT_COMMAND_NOT_UNDERSTOOD 0x0000
+
+/* Connection Parameter Update Response results */
+#define L2CAP_CONN_PARAM_ACCEPTED 0x0000
+#define L2CAP_CONN_PARAM_REJECTED 0x0001
+
+/* ACL packet boundary flags as received from the controller */
+#define L2CAP_PB_CONTINUING_FRAGMENT 0x01
+#define L2CAP_PB_FIRST_FLUSHABLE 0x02
+
+/**
+ * @brief   Reassembly state for one connection's inbound L2CAP PDU
+ */
+typedef struct {
+  uint16_t expected;                  /**< Total PDU length including header, 0 until the header is in */
+  uint16_t received;                  /**< Bytes collected so far */
+  uint8_t buffer[L2CAP_MAX_PDU_SIZE]; /**< PDU being reassembled */
+} L2CAPReassembly;
+
+/**
+ * @brief   Handle inbound ACL data
+ * @param   data Pointer to the ACL data packet received
+ * @details Runs in interrupt context. Resolves the connection context, reassembles fragmented PDUs and
+ * queues complete PDUs for L2CAP_process. A PDU that finds the queue full is dropped.
+ */
+void L2CAP_handle_acl_data(HCIAsyncData *data);
+
+/**
+ * @brief   Dispatch received PDUs to the protocol bound to their channel ID
+ * @details Called by bluetooth_stack_process, never from interrupt context. ATT requests are served,
+ * signaling requests answered and application callbacks run from here, so responses are queued by the
+ * main loop that owns the ACL TX buffers.
+ */
+void L2CAP_process(void);
+
+/**
+ * @brief   Ask the central for new connection parameters
+ * @param   connection_handle Connection on which the local device is peripheral
+ * @param   params Requested parameters in controller units
+ * @return  HCIError Indicates the success or failure of queueing the request
+ * @details Sends a Connection Parameter Update Request on the LE signaling channel. If the central
+ * accepts, it applies the parameters and the controller reports an LE Connection Update Complete.
+ */
+HCIError L2CAP_request_connection_parameter_update(uint16_t connection_handle, GAPConnectionParameters *params);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "gap.h"
+
+/**
+ * @brief   Procedures run by the link bring-up engine after a connection completes
+ */
+typedef enum {
+  LINK_PROC_MTU = 0x01,         /**< ATT Exchange MTU */
+  LINK_PROC_DATA_LENGTH = 0x02, /**< LL data length update */
+  LINK_PROC_PHY = 0x04,         /**< LL PHY update */
+  LINK_PROC_CONN_PARAMS = 0x08  /**< Connection parameter update */
+} LinkProcedure;
+
+/**
+ * @brief   Set the ATT MTU requested on every new connection
+ * @param   mtu MTU to request, ATT_DEFAULT_MTU skips the exchange
+ */
+void LINK_set_preferred_mtu(uint16_t mtu);
+
+/**
+ * @brief   Set the connection parameters requested on every new connection
+ * @param   params Parameters in controller units, NULL keeps whatever the link was opened with
+ * @details As central the parameters are applied with a connection update, as peripheral they are
+ * requested on the L2CAP signaling channel.
+ */
+void LINK_set_preferred_connection_parameters(GAPConnectionParameters *params);
+
+/**
+ * @brief   Start bringing up a new connection
+ * @param   connection_handle Handle of the connection that just completed
+ * @details Picks the MTU exchange, data length update, PHY update and connection parameter update the
+ * link needs, LINK_process sends them. Delivers GAP_EVENT_LINK_READY when the last one completes, or
+ * right away if there is nothing to negotiate. Called by the HCI layer from interrupt context.
+ */
+void LINK_start(uint16_t connection_handle);
+
+/**
+ * @brief   Record the completion of a bring-up procedure
+ * @param   connection_handle Handle of the connection
+ * @param   procedure Procedure that completed, successfully or not
+ * @details Ignored if the procedure is not outstanding, so every completion may be reported
+ * whether or not bring-up started it.
+ */
+void LINK_complete(uint16_t connection_handle, LinkProcedure procedure);
+
+/**
+ * @brief   Give up on bring-up procedures the peer never answered
+ * @details Called by bluetooth_stack_process. Sends the requests of started procedures: ATT and L2CAP
+ * requests at once, HCI commands one at a time as the controller returns its command credit. After
+ * BT_LINK_SETUP_TIMEOUT_MS outstanding procedures are abandoned and GAP_EVENT_LINK_READY is delivered
+ * with the values in use.
+ */
+void LINK_process(void);
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bt_config.h"
+
+#define SCAN_CACHE_SIZE BT_SCAN_CACHE_SIZE /**< Advertisers remembered, see bt_config.h */
+#define SCAN_CACHE_RSSI_UNAVAILABLE 127    /**< RSSI value of reports without a measurement */
+
+/**
+ * @brief   What an advertising report changed in the cache, combined as bits
+ */
+typedef enum {
+  SCAN_CACHE_NEW_DEVICE = 0x01,      /**< First report of the advertiser, or first since it aged out */
+  SCAN_CACHE_PAYLOAD_CHANGED = 0x02, /**< Advertising or scan response data is new or differs from the last */
+  SCAN_CACHE_REPORT = 0x04,          /**< Set for every report, including repeats */
+  SCAN_CACHE_ALL = 0x07
+} ScanCacheChange;
+
+/**
+ * @brief   One advertiser seen while scanning
+ */
+typedef struct {
+  bool used;             /**< Slot holds an advertiser */
+  uint8_t addr_type;     /**< Address type of the advertiser */
+  uint8_t addr[6];       /**< Advertiser address */
+  int8_t rssi;           /**< RSSI of the last report in dBm */
+  int16_t rssi_filtered; /**< Smoothed RSSI in 1/16 dBm */
+  uint32_t adv_hash;     /**< Hash of the last advertising data, 0 until one arrives */
+  uint32_t rsp_hash;     /**< Hash of the last scan response data, 0 until one arrives */
+  uint64_t last_seen_ms; /**< Time of the last report */
+} ScanCacheEntry;
+
+/**
+ * @brief   Forget every advertiser
+ * @details Called by GAP before scanning starts, so a new scan reports every advertiser as new
+ */
+void SCAN_CACHE_clear(void);
+
+/**
+ * @brief   Record an advertising report
+ * @param   addr_type Address type of the advertiser
+ * @param   addr Advertiser address
+ * @param   event_type Scan_ReportType, scan responses are tracked apart from advertising data
+ * @param   data Advertising or scan response data
+ * @param   data_len Length of the data
+ * @param   rssi RSSI of the report in dBm
+ * @param   entry Output for the advertiser's entry, may be NULL
+ * @return  uint8_t ScanCacheChange bits
+ * @details Runs in interrupt context. A lookup hashes the address into an open-addressed table, so the
+ * cost does not grow with the number of advertisers. Each call also ages out a few stale entries. If
+ * the table is full, the least recently seen advertiser on the probe path is replaced.
+ */
+uint8_t SCAN_CACHE_update(uint8_t addr_type, const uint8_t *addr, uint8_t event_type, const uint8_t *data,
+                          uint16_t data_len, int8_t rssi, const ScanCacheEntry **entry);
+
+/**
+ * @brief   Find an advertiser
+ * @param   addr_type Address type of the advertiser
+ * @param   addr Advertiser address
+ * @return  const ScanCacheEntry* The entry, or NULL if the advertiser is unknown or aged out
+ * @details Entries are updated from the HCI interrupt, read them while scanning is stopped or accept
+ * that a report may land in between.
+ */
+const ScanCacheEntry *SCAN_CACHE_lookup(uint8_t addr_type, const uint8_t *addr);
+
+/**
+ * @brief   Get the smoothed RSSI of an advertiser
+ * @param   entry Cache entry
+ * @return  int8_t RSSI in dBm, SCAN_CACHE_RSSI_UNAVAILABLE if no report carried a measurement
+ */
+int8_t SCAN_CACHE_get_smoothed_rssi(const ScanCacheEntry *entry);
+
+/**
+ * @brief   Get the number of advertisers in the cache
+ * @return  uint16_t Number of used entries, including stale ones not yet aged out
+ */
+uint16_t SCAN_CACHE_count(void);
@@ -0,0 +1,234 @@
+#include "accept_list.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "hardware_bl.h"
+#include "log_bl.h"
+
+#define SYNC_TIMEOUT_MS 1000
+
+/* Controller status codes the mirror reacts to */
+#define STATUS_MEMORY_CAPACITY_EXCEEDED 0x07
+#define STATUS_COMMAND_DISALLOWED 0x0C
+
+/* Room for one command per entry plus the clear and the size read of ACCEPT_LIST_init. */
+#define MAX_IN_FLIGHT (ACCEPT_LIST_SIZE + 2)
+#define NO_ENTRY 0xFF
+
+typedef struct {
+  uint16_t op_code;
+  uint8_t entry;
+} InFlightCommand;
+
+static AcceptListEntry entries[ACCEPT_LIST_SIZE];
+static uint8_t controller_size = ACCEPT_LIST_SIZE;
+
+/* Commands sent and not yet completed, answered in the order they were sent */
+static InFlightCommand in_flight[MAX_IN_FLIGHT];
+static volatile uint8_t in_flight_head = 0;
+static volatile uint8_t in_flight_count = 0;
+static volatile uint8_t sync_status = HCI_ERROR_SUCCESS;
+
+static AcceptListEntry *find_entry(uint8_t addr_type, const uint8_t *addr) {
+  for (uint8_t i = 0; i < ACCEPT_LIST_SIZE; i++) {
+    if (entries[i].state != ACCEPT_ENTRY_FREE && entries[i].addr_type == addr_type &&
+        memcmp(entries[i].addr, addr, 6) == 0) {
+      return &entries[i];
+    }
+  }
+  return NULL;
+}
+
+static HCIError send_command(uint16_t op_code, uint8_t entry) {
+  uint64_t start_ms = hw_get_time_ms();
+  while (HCI_get_command_credits() == 0 || in_flight_count == MAX_IN_FLIGHT) {
+    if (hw_get_time_ms() - start_ms > SYNC_TIMEOUT_MS) {
+      return HCI_ERROR_COMMAND_TIMEOUT;
+    }
+  }
+
+  uint8_t params[7];
+  HCICommand cmd = { .op_code.raw = op_code, .parameter_length = 0, .parameters = params };
+  if (entry != NO_ENTRY) {
+    params[0] = entries[entry].addr_type;
+    memcpy(&params[1], entries[entry].addr, 6);
+    cmd.parameter_length = sizeof(params);
+  }
+
+  /* Queue before sending, the completion may arrive before HCI_send_command_async returns. */
+  uint8_t tail = (in_flight_head + in_flight_count) % MAX_IN_FLIGHT;
+  in_flight[tail] = (InFlightCommand){ .op_code = op_code, .entry = entry };
+  in_flight_count++;
+
+  HCIError status = HCI_send_command_async(&cmd);
+  if (status != HCI_ERROR_SUCCESS) {
+    in_flight_count--;
+  }
+  return status;
+}
+
+static HCIError wait_for_completions(void) {
+  uint64_t start_ms = hw_get_time_ms();
+  while (in_flight_count != 0) {
+    if (hw_get_time_ms() - start_ms > SYNC_TIMEOUT_MS) {
+      in_flight_count = 0;
+      return HCI_ERROR_COMMAND_TIMEOUT;
+    }
+  }
+  return (HCIError)sync_status;
+}
+
+HCIError ACCEPT_LIST_init(void) {
+  memset(entries, 0, sizeof(entries));
+  in_flight_head = 0;
+  in_flight_count = 0;
+  sync_status = HCI_ERROR_SUCCESS;
+
+  HCIError status = send_command(CMD_BLE_CLEAR_WHITE_LIST, NO_ENTRY);
+  if (status == HCI_ERROR_SUCCESS) {
+    status = send_command(CMD_BLE_READ_WHITE_LIST_SIZE, NO_ENTRY);
+  }
+  if (status == HCI_ERROR_SUCCESS) {
+    status = wait_for_completions();
+  }
+  return status;
+}
+
+bool ACCEPT_LIST_add(uint8_t addr_type, const uint8_t *addr) {
+  if (!addr) {
+    return false;
+  }
+
+  AcceptListEntry *entry = find_entry(addr_type, addr);
+  if (entry) {
+    /* Still in the controller, cancel the removal. */
+    if (entry->state == ACCEPT_ENTRY_REMOVE_PENDING) {
+      entry->state = ACCEPT_ENTRY_SYNCED;
+    }
+    return true;
+  }
+
+  if (ACCEPT_LIST_count() >= ACCEPT_LIST_capacity()) {
+    return false;
+  }
+
+  for (uint8_t i = 0; i < ACCEPT_LIST_SIZE; i++) {
+    if (entries[i].state == ACCEPT_ENTRY_FREE) {
+      entries[i].state = ACCEPT_ENTRY_ADD_PENDING;
+      entries[i].addr_type = addr_type;
+      memcpy(entries[i].addr, addr, 6);
+      return true;
+    }
+  }
+
+  /* Every slot is taken by a pending removal, the next sync frees them. */
+  return false;
+}
+
+bool ACCEPT_LIST_remove(uint8_t addr_type, const uint8_t *addr) {
+  AcceptListEntry *entry = addr ? find_entry(addr_type, addr) : NULL;
+  if (!entry || entry->state == ACCEPT_ENTRY_REMOVE_PENDING) {
+    return false;
+  }
+
+  entry->state = (entry->state == ACCEPT_ENTRY_SYNCED) ? ACCEPT_ENTRY_REMOVE_PENDING : ACCEPT_ENTRY_FREE;
+  return true;
+}
+
+void ACCEPT_LIST_clear(void) {
+  for (uint8_t i = 0; i < ACCEPT_LIST_SIZE; i++) {
+    if (entries[i].state == ACCEPT_ENTRY_SYNCED) {
+      entries[i].state = ACCEPT_ENTRY_REMOVE_PENDING;
+    } else if (entries[i].state == ACCEPT_ENTRY_ADD_PENDING) {
+      entries[i].state = ACCEPT_ENTRY_FREE;
+    }
+  }
+}
+
+bool ACCEPT_LIST_contains(uint8_t addr_type, const uint8_t *addr) {
+  AcceptListEntry *entry = addr ? find_entry(addr_type, addr) : NULL;
+  return entry && entry->state != ACCEPT_ENTRY_REMOVE_PENDING;
+}
+
+uint8_t ACCEPT_LIST_count(void) {
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < ACCEPT_LIST_SIZE; i++) {
+    if (entries[i].state == ACCEPT_ENTRY_ADD_PENDING || entries[i].state == ACCEPT_ENTRY_SYNCED) {
+      count++;
+    }
+  }
+  return count;
+}
+
+uint8_t ACCEPT_LIST_capacity(void) {
+  return (controller_size < ACCEPT_LIST_SIZE) ? controller_size : ACCEPT_LIST_SIZE;
+}
+
+bool ACCEPT_LIST_dirty(void) {
+  for (uint8_t i = 0; i < ACCEPT_LIST_SIZE; i++) {
+    if (entries[i].state == ACCEPT_ENTRY_ADD_PENDING || entries[i].state == ACCEPT_ENTRY_REMOVE_PENDING) {
+      return true;
+    }
+  }
+  return false;
+}
+
+HCIError ACCEPT_LIST_sync(void) {
+  sync_status = HCI_ERROR_SUCCESS;
+  HCIError status = HCI_ERROR_SUCCESS;
+
+  for (uint8_t i = 0; i < ACCEPT_LIST_SIZE && status == HCI_ERROR_SUCCESS; i++) {
+    if (entries[i].state == ACCEPT_ENTRY_REMOVE_PENDING) {
+      status = send_command(CMD_BLE_REMOVE_DEVICE_FROM_WHITE_LIST, i);
+    }
+  }
+  for (uint8_t i = 0; i < ACCEPT_LIST_SIZE && status == HCI_ERROR_SUCCESS; i++) {
+    if (entries[i].state == ACCEPT_ENTRY_ADD_PENDING) {
+      status = send_command(CMD_BLE_ADD_DEVICE_TO_WHITE_LIST, i);
+    }
+  }
+
+  /* Wait for what was sent even if a later send failed, so the mirror stays accurate. */
+  HCIError completion_status = wait_for_completions();
+  return (status != HCI_ERROR_SUCCESS) ? status : completion_status;
+}
+
+bool ACCEPT_LIST_handle_command_complete(uint16_t op_code, uint8_t status, uint8_t *return_parameters,
+                                         uint8_t length) {
+  if (in_flight_count == 0 || in_flight[in_flight_head].op_code != op_code) {
+    return false;
+  }
+
+  uint8_t index = in_flight[in_flight_head].entry;
+  in_flight_head = (in_flight_head + 1) % MAX_IN_FLIGHT;
+
+  if (status != HCI_ERROR_SUCCESS) {
+    /* A full controller list will not take the device on the next sync either. */
+    if (op_code == CMD_BLE_ADD_DEVICE_TO_WHITE_LIST && status == STATUS_MEMORY_CAPACITY_EXCEEDED) {
+      log_bl_warning("Controller accept list full, device dropped\r\n");
+      entries[index].state = ACCEPT_ENTRY_FREE;
+    }
+    /* Disallowed means scanning, advertising or initiating still uses the list. */
+    sync_status = (status == STATUS_COMMAND_DISALLOWED) ? HCI_ERROR_BUSY : HCI_ERROR_INTERNAL_ERROR;
+  } else {
+    switch (op_code) {
+      case CMD_BLE_ADD_DEVICE_TO_WHITE_LIST:
+        entries[index].state = ACCEPT_ENTRY_SYNCED;
+        break;
+      case CMD_BLE_REMOVE_DEVICE_FROM_WHITE_LIST:
+        entries[index].state = ACCEPT_ENTRY_FREE;
+        break;
+      case CMD_BLE_READ_WHITE_LIST_SIZE:
+        if (length >= 1) {
+          controller_size = return_parameters[0];
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  in_flight_count--;
+  return true;
+}
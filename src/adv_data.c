@@ -0,0 +1,239 @@
+#include "adv_data.h"
+
+#include <string.h>
+
+void AD_iterator_init(ADIterator *it, const uint8_t *data, uint16_t length) {
+  it->data = data;
+  it->length = length;
+  it->offset = 0;
+}
+
+bool AD_next(ADIterator *it, ADStructure *ad) {
+  if (it->offset >= it->length) {
+    return false;
+  }
+
+  /* Each structure is length, type, data, where length covers type and data. */
+  uint8_t ad_length = it->data[it->offset];
+  if (ad_length == 0 || it->offset + 1 + ad_length > it->length) {
+    it->offset = it->length;
+    return false;
+  }
+
+  ad->type = it->data[it->offset + 1];
+  ad->length = ad_length - 1;
+  ad->data = &it->data[it->offset + 2];
+  it->offset += 1 + ad_length;
+  return true;
+}
+
+bool AD_find(const uint8_t *data, uint16_t length, uint8_t type, ADStructure *ad) {
+  ADIterator it;
+  AD_iterator_init(&it, data, length);
+
+  while (AD_next(&it, ad)) {
+    if (ad->type == type) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool AD_get_flags(const uint8_t *data, uint16_t length, uint8_t *flags) {
+  ADStructure ad;
+  if (!AD_find(data, length, AD_TYPE_FLAGS, &ad) || ad.length < 1) {
+    return false;
+  }
+
+  *flags = ad.data[0];
+  return true;
+}
+
+bool AD_get_name(const uint8_t *data, uint16_t length, const uint8_t **name, uint8_t *name_length) {
+  ADIterator it;
+  ADStructure ad;
+  AD_iterator_init(&it, data, length);
+
+  while (AD_next(&it, &ad)) {
+    if (ad.type == AD_TYPE_COMPLETE_NAME || ad.type == AD_TYPE_SHORTENED_NAME) {
+      *name = ad.data;
+      *name_length = ad.length;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool AD_has_service_uuid16(const uint8_t *data, uint16_t length, uint16_t uuid) {
+  ADIterator it;
+  ADStructure ad;
+  AD_iterator_init(&it, data, length);
+
+  while (AD_next(&it, &ad)) {
+    if (ad.type != AD_TYPE_COMPLETE_UUID16 && ad.type != AD_TYPE_INCOMPLETE_UUID16) {
+      continue;
+    }
+
+    for (uint8_t i = 0; i + 1 < ad.length; i += 2) {
+      if ((ad.data[i] | (ad.data[i + 1] << 8)) == uuid) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool AD_get_manufacturer_data(const uint8_t *data, uint16_t length, uint16_t *company_id, const uint8_t **payload,
+                              uint8_t *payload_length) {
+  ADStructure ad;
+  if (!AD_find(data, length, AD_TYPE_MANUFACTURER_DATA, &ad) || ad.length < 2) {
+    return false;
+  }
+
+  *company_id = ad.data[0] | (ad.data[1] << 8);
+  *payload = &ad.data[2];
+  *payload_length = ad.length - 2;
+  return true;
+}
+
+/***************************************************************************************
+ * Builder
+ **************************************************************************************/
+
+/* Smallest useful shortened name, shorter ones go to the scan response whole instead. */
+#define MIN_SHORTENED_NAME 4
+
+void AD_builder_init(ADBuilder *builder) {
+  builder->length = 0;
+}
+
+static uint8_t *builder_reserve(ADBuilder *builder, uint8_t type, uint8_t length) {
+  if (length > AD_MAX_DATA_LENGTH - 2 || builder->length + 2 + length > AD_BUILDER_SIZE) {
+    return NULL;
+  }
+
+  uint8_t *structure = &builder->buffer[builder->length];
+  structure[0] = length + 1;
+  structure[1] = type;
+  builder->length += 2 + length;
+  return &structure[2];
+}
+
+bool AD_builder_add(ADBuilder *builder, uint8_t type, const uint8_t *data, uint8_t length) {
+  if (length > 0 && !data) {
+    return false;
+  }
+
+  uint8_t *dest = builder_reserve(builder, type, length);
+  if (!dest) {
+    return false;
+  }
+  memcpy(dest, data, length);
+  return true;
+}
+
+bool AD_builder_add_flags(ADBuilder *builder, uint8_t flags) {
+  return AD_builder_add(builder, AD_TYPE_FLAGS, &flags, 1);
+}
+
+bool AD_builder_add_name(ADBuilder *builder, const char *name, uint8_t length) {
+  /* Encoding shortens the name to what fits, the builder keeps it whole up to one PDU. */
+  if (length > AD_MAX_DATA_LENGTH - 2) {
+    length = AD_MAX_DATA_LENGTH - 2;
+  }
+  return AD_builder_add(builder, AD_TYPE_COMPLETE_NAME, (const uint8_t *)name, length);
+}
+
+bool AD_builder_add_uuid16_list(ADBuilder *builder, const uint16_t *uuids, uint8_t count) {
+  if (count > (AD_MAX_DATA_LENGTH - 2) / 2 || (count > 0 && !uuids)) {
+    return false;
+  }
+
+  uint8_t *dest = builder_reserve(builder, AD_TYPE_COMPLETE_UUID16, count * 2);
+  if (!dest) {
+    return false;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    dest[2 * i] = uuids[i] & 0xFF;
+    dest[2 * i + 1] = (uuids[i] >> 8) & 0xFF;
+  }
+  return true;
+}
+
+bool AD_builder_add_uuid128(ADBuilder *builder, const uint8_t *uuid) {
+  return AD_builder_add(builder, AD_TYPE_COMPLETE_UUID128, uuid, 16);
+}
+
+bool AD_builder_add_service_data16(ADBuilder *builder, uint16_t uuid, const uint8_t *data, uint8_t length) {
+  if (length > AD_MAX_DATA_LENGTH - 4 || (length > 0 && !data)) {
+    return false;
+  }
+
+  uint8_t *dest = builder_reserve(builder, AD_TYPE_SERVICE_DATA_UUID16, length + 2);
+  if (!dest) {
+    return false;
+  }
+  dest[0] = uuid & 0xFF;
+  dest[1] = (uuid >> 8) & 0xFF;
+  memcpy(&dest[2], data, length);
+  return true;
+}
+
+bool AD_builder_add_manufacturer_data(ADBuilder *builder, uint16_t company_id, const uint8_t *data, uint8_t length) {
+  if (length > AD_MAX_DATA_LENGTH - 4 || (length > 0 && !data)) {
+    return false;
+  }
+
+  uint8_t *dest = builder_reserve(builder, AD_TYPE_MANUFACTURER_DATA, length + 2);
+  if (!dest) {
+    return false;
+  }
+  dest[0] = company_id & 0xFF;
+  dest[1] = (company_id >> 8) & 0xFF;
+  memcpy(&dest[2], data, length);
+  return true;
+}
+
+static void place(uint8_t *dest, uint8_t *dest_length, const uint8_t *structure, uint8_t size) {
+  memcpy(&dest[*dest_length], structure, size);
+  *dest_length += size;
+}
+
+bool AD_builder_encode(const ADBuilder *builder, ADPayload *payload) {
+  memset(payload, 0, sizeof(ADPayload));
+
+  uint8_t offset = 0;
+  while (offset < builder->length) {
+    const uint8_t *structure = &builder->buffer[offset];
+    uint8_t size = structure[0] + 1;
+    uint8_t type = structure[1];
+    offset += size;
+
+    uint8_t adv_space = AD_MAX_DATA_LENGTH - payload->adv_data_length;
+    uint8_t rsp_space = AD_MAX_DATA_LENGTH - payload->scan_rsp_data_length;
+
+    if (size <= adv_space) {
+      place(payload->adv_data, &payload->adv_data_length, structure, size);
+    } else if (type != AD_TYPE_FLAGS && size <= rsp_space) {
+      place(payload->scan_rsp_data, &payload->scan_rsp_data_length, structure, size);
+    } else if (type == AD_TYPE_COMPLETE_NAME) {
+      /* Shorten the name into whichever PDU has more room left. */
+      bool to_adv = adv_space >= rsp_space;
+      uint8_t space = to_adv ? adv_space : rsp_space;
+      if (space < 2 + MIN_SHORTENED_NAME) {
+        return false;
+      }
+
+      uint8_t *dest = to_adv ? payload->adv_data : payload->scan_rsp_data;
+      uint8_t *dest_length = to_adv ? &payload->adv_data_length : &payload->scan_rsp_data_length;
+      dest[*dest_length] = space - 1;
+      dest[*dest_length + 1] = AD_TYPE_SHORTENED_NAME;
+      memcpy(&dest[*dest_length + 2], &structure[2], space - 2);
+      *dest_length += space;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
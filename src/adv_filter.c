@@ -0,0 +1,209 @@
+#include "adv_filter.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "adv_data.h"
+#include "scan_cache.h"
+
+#define UUID16_SIZE 2
+#define UUID128_SIZE 16
+
+static bool ad_type_used(const AdvFilter *filter, uint8_t ad_type) {
+  return (filter->ad_types[ad_type >> 5] & (1u << (ad_type & 0x1F))) != 0;
+}
+
+static bool valid_rule(AdvFilter *filter, uint8_t group) {
+  return filter && group < ADV_FILTER_MAX_GROUPS && filter->rule_count < ADV_FILTER_MAX_RULES;
+}
+
+static bool store_pattern(AdvFilter *filter, const uint8_t *pattern, uint8_t length, uint8_t *offset) {
+  if (filter->pattern_used + length > ADV_FILTER_PATTERN_POOL_SIZE) {
+    return false;
+  }
+
+  *offset = filter->pattern_used;
+  if (length > 0) {
+    memcpy(&filter->patterns[*offset], pattern, length);
+  }
+  filter->pattern_used += length;
+  return true;
+}
+
+/* Keeps the matchers sorted by AD type so a lookup can stop at the first larger type. */
+static void insert_matcher(AdvFilter *filter, uint8_t ad_type, uint8_t op, uint8_t offset, uint8_t length) {
+  uint8_t position = filter->matcher_count;
+  while (position > 0 && filter->matchers[position - 1].ad_type > ad_type) {
+    filter->matchers[position] = filter->matchers[position - 1];
+    position--;
+  }
+
+  filter->matchers[position] = (AdvFilterMatcher){
+    .ad_type = ad_type,
+    .op = op,
+    .rule = filter->rule_count,
+    .pattern_offset = offset,
+    .pattern_length = length,
+  };
+  filter->matcher_count++;
+  filter->ad_types[ad_type >> 5] |= 1u << (ad_type & 0x1F);
+}
+
+/* Compiles one rule into matchers for up to two AD types sharing the same pattern. */
+static bool add_rule(AdvFilter *filter, uint8_t group, uint8_t op, uint8_t ad_type, uint8_t alt_ad_type,
+                     const uint8_t *pattern, uint8_t length) {
+  if (!valid_rule(filter, group) || (length > 0 && !pattern)) {
+    return false;
+  }
+
+  uint8_t offset;
+  if (!store_pattern(filter, pattern, length, &offset)) {
+    return false;
+  }
+
+  insert_matcher(filter, ad_type, op, offset, length);
+  if (alt_ad_type != ad_type) {
+    insert_matcher(filter, alt_ad_type, op, offset, length);
+  }
+
+  filter->group_rules[group] |= 1u << filter->rule_count;
+  filter->groups |= 1 << group;
+  filter->rule_count++;
+  return true;
+}
+
+static bool matcher_test(const AdvFilter *filter, const AdvFilterMatcher *matcher, ADStructure *ad) {
+  const uint8_t *pattern = &filter->patterns[matcher->pattern_offset];
+  uint8_t length = matcher->pattern_length;
+
+  if (matcher->op == ADV_FILTER_OP_PREFIX) {
+    return ad->length >= length && memcmp(ad->data, pattern, length) == 0;
+  }
+
+  for (uint8_t i = 0; i + length <= ad->length; i += length) {
+    if (memcmp(&ad->data[i], pattern, length) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ADV_FILTER_init(AdvFilter *filter) {
+  memset(filter, 0, sizeof(AdvFilter));
+  for (uint8_t i = 0; i < ADV_FILTER_MAX_GROUPS; i++) {
+    filter->rssi_min[i] = ADV_FILTER_NO_RSSI_LIMIT;
+  }
+}
+
+bool ADV_FILTER_add_uuid16(AdvFilter *filter, uint8_t group, uint16_t uuid) {
+  uint8_t pattern[UUID16_SIZE] = { uuid & 0xFF, (uuid >> 8) & 0xFF };
+  return add_rule(filter, group, ADV_FILTER_OP_ELEMENT, AD_TYPE_INCOMPLETE_UUID16, AD_TYPE_COMPLETE_UUID16, pattern,
+                  sizeof(pattern));
+}
+
+bool ADV_FILTER_add_uuid128(AdvFilter *filter, uint8_t group, const uint8_t *uuid) {
+  if (!uuid) {
+    return false;
+  }
+  return add_rule(filter, group, ADV_FILTER_OP_ELEMENT, AD_TYPE_INCOMPLETE_UUID128, AD_TYPE_COMPLETE_UUID128, uuid,
+                  UUID128_SIZE);
+}
+
+bool ADV_FILTER_add_manufacturer(AdvFilter *filter, uint8_t group, uint16_t company_id, const uint8_t *prefix,
+                                 uint8_t prefix_length) {
+  /* The company identifier leads the AD data, so it becomes part of one prefix. */
+  uint8_t pattern[ADV_FILTER_PATTERN_POOL_SIZE];
+  if (prefix_length > sizeof(pattern) - 2 || (prefix_length > 0 && !prefix)) {
+    return false;
+  }
+
+  pattern[0] = company_id & 0xFF;
+  pattern[1] = (company_id >> 8) & 0xFF;
+  if (prefix_length > 0) {
+    memcpy(&pattern[2], prefix, prefix_length);
+  }
+
+  return add_rule(filter, group, ADV_FILTER_OP_PREFIX, AD_TYPE_MANUFACTURER_DATA, AD_TYPE_MANUFACTURER_DATA, pattern,
+                  prefix_length + 2);
+}
+
+bool ADV_FILTER_add_name_prefix(AdvFilter *filter, uint8_t group, const uint8_t *prefix, uint8_t prefix_length) {
+  return add_rule(filter, group, ADV_FILTER_OP_PREFIX, AD_TYPE_SHORTENED_NAME, AD_TYPE_COMPLETE_NAME, prefix,
+                  prefix_length);
+}
+
+bool ADV_FILTER_add_ad_prefix(AdvFilter *filter, uint8_t group, uint8_t ad_type, const uint8_t *prefix,
+                              uint8_t prefix_length) {
+  return add_rule(filter, group, ADV_FILTER_OP_PREFIX, ad_type, ad_type, prefix, prefix_length);
+}
+
+bool ADV_FILTER_add_rssi_min(AdvFilter *filter, uint8_t group, int8_t rssi_min) {
+  if (!filter || group >= ADV_FILTER_MAX_GROUPS) {
+    return false;
+  }
+
+  if (rssi_min > filter->rssi_min[group]) {
+    filter->rssi_min[group] = rssi_min;
+  }
+  filter->groups |= 1 << group;
+  return true;
+}
+
+bool ADV_FILTER_match(const AdvFilter *filter, const uint8_t *data, uint16_t data_len, int8_t rssi) {
+  if (filter->groups == 0) {
+    return true;
+  }
+
+  /* Drop the groups the signal strength already rules out, and collect the rules the rest need. */
+  uint8_t candidates = 0;
+  uint32_t needed = 0;
+  for (uint8_t group = 0; group < ADV_FILTER_MAX_GROUPS; group++) {
+    if (!(filter->groups & (1 << group))) {
+      continue;
+    }
+    if (filter->rssi_min[group] != ADV_FILTER_NO_RSSI_LIMIT &&
+        (rssi == SCAN_CACHE_RSSI_UNAVAILABLE || rssi < filter->rssi_min[group])) {
+      continue;
+    }
+    if (filter->group_rules[group] == 0) {
+      return true;
+    }
+    candidates |= 1 << group;
+    needed |= filter->group_rules[group];
+  }
+
+  if (candidates == 0) {
+    return false;
+  }
+
+  uint32_t matched = 0;
+  ADIterator it;
+  ADStructure ad;
+  AD_iterator_init(&it, data, data_len);
+
+  while (AD_next(&it, &ad)) {
+    if (!ad_type_used(filter, ad.type)) {
+      continue;
+    }
+
+    uint32_t before = matched;
+    for (uint8_t i = 0; i < filter->matcher_count && filter->matchers[i].ad_type <= ad.type; i++) {
+      const AdvFilterMatcher *matcher = &filter->matchers[i];
+      uint32_t rule_bit = 1u << matcher->rule;
+      if (matcher->ad_type == ad.type && (needed & rule_bit) && !(matched & rule_bit) &&
+          matcher_test(filter, matcher, &ad)) {
+        matched |= rule_bit;
+      }
+    }
+
+    if (matched == before) {
+      continue;
+    }
+    for (uint8_t group = 0; group < ADV_FILTER_MAX_GROUPS; group++) {
+      if ((candidates & (1 << group)) && (filter->group_rules[group] & ~matched) == 0) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
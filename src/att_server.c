@@ -0,0 +1,737 @@
+#include "att_server.h"
+
+#include <string.h>
+
+#include "bt_config.h"
+#include "connection.h"
+#include "gatt_db.h"
+#include "hci_acl.h"
+#include "log_bl.h"
+
+/* Bluetooth Base UUID in air order, bytes 12 and 13 carry the 16-bit alias. */
+static const uint8_t base_uuid[ATT_UUID128_SIZE] = { 0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00, 0x00, 0x80,
+                                                     0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+/* Where an encoder stopped: the last attribute it included, and whether the next match did not fit the MTU. */
+typedef struct {
+  uint16_t last;
+  bool full;
+} EncodeResult;
+
+/* Pre-encoded discovery response, served for requests from start with an end handle in [min_end, max_end]. */
+typedef struct {
+  uint8_t opcode;       /* Request the response answers */
+  uint8_t entry_length; /* Bytes per entry in the response */
+  bool full;            /* Cut short by the MTU it was built for */
+  uint16_t start;       /* Starting handle of the request */
+  uint16_t min_end;     /* Smallest ending handle giving this response */
+  uint16_t max_end;     /* Largest ending handle giving this response */
+  uint16_t offset;      /* Position of the PDU in cache_data */
+  uint16_t length;      /* Length of the PDU */
+} ATTCacheEntry;
+
+static ATTCacheEntry cache[ATT_CACHE_ENTRIES];
+static uint8_t cache_count = 0;
+static uint8_t cache_data[ATT_CACHE_SIZE];
+static uint16_t cache_used = 0;
+static uint8_t cache_generation = 0;
+static bool cache_ready = false;
+
+static void put16(uint8_t *data, uint16_t value) {
+  data[0] = value & 0xFFU;
+  data[1] = (value >> 8U) & 0xFFU;
+}
+
+static uint16_t get16(const uint8_t *data) {
+  return data[0] | (data[1] << 8U);
+}
+
+static uint16_t min16(uint16_t a, uint16_t b) {
+  return (a < b) ? a : b;
+}
+
+static void send_error(uint16_t connection_handle, uint8_t request, uint16_t handle, GATTError error) {
+  uint8_t pdu[ATT_ERROR_RESPONSE_SIZE] = { ATT_ERROR_RESPONSE, request, handle & 0xFFU, (handle >> 8U) & 0xFFU,
+                                           (uint8_t)error };
+  HCI_ACL_enqueue(connection_handle, L2CAP_ATT_CID, HCI_ACL_PRIORITY_ATT_RESPONSE, pdu, sizeof(pdu));
+}
+
+static uint8_t *reserve_response(uint8_t *buffer) {
+  uint8_t *pdu = NULL;
+  *buffer = HCI_ACL_reserve(&pdu);
+  if (*buffer == HCI_ACL_NO_BUFFER) {
+    log_bl_warning("ATT response dropped, no TX buffer\r\n");
+  }
+  return pdu;
+}
+
+static void send_response(ConnectionContext *context, uint8_t buffer, uint16_t length) {
+  HCI_ACL_commit(context->connection_handle, L2CAP_ATT_CID, HCI_ACL_PRIORITY_ATT_RESPONSE, buffer, length);
+}
+
+/* Responses are bounded by the MTU and by what one TX buffer holds. */
+static uint16_t response_mtu(ConnectionContext *context) {
+  return min16(context->att_mtu, HCI_ACL_MAX_PAYLOAD);
+}
+
+/* Accept a 16-bit UUID, or a 128-bit one that is a 16-bit UUID on the Bluetooth Base UUID. */
+static bool parse_uuid(const uint8_t *data, uint16_t length, uint16_t *uuid) {
+  if (length == ATT_UUID16_SIZE) {
+    *uuid = get16(data);
+    return true;
+  }
+
+  if (length == ATT_UUID128_SIZE && memcmp(data, base_uuid, 12) == 0 && data[14] == 0 && data[15] == 0) {
+    *uuid = get16(&data[12]);
+    return true;
+  }
+
+  return false;
+}
+
+/* The link security level is not tracked yet, so attributes that need more than plain access are refused. */
+static GATTError check_access(const GATTAttribute *attr, bool write) {
+  uint8_t permissions = attr->permissions;
+
+  if (permissions & (write ? GATT_PERM_WRITE : GATT_PERM_READ)) {
+    return GATT_ERROR_SUCCESS;
+  }
+  if (permissions & (write ? GATT_PERM_WRITE_AUTHEN : GATT_PERM_READ_AUTHEN)) {
+    return GATT_ERROR_INSUFFICIENT_AUTH;
+  }
+  if (permissions & (write ? GATT_PERM_WRITE_ENC : GATT_PERM_READ_ENC)) {
+    return GATT_ERROR_INSUFFICIENT_ENCRYPTION;
+  }
+  if (permissions & (write ? GATT_PERM_WRITE_AUTHOR : GATT_PERM_READ_AUTHOR)) {
+    return GATT_ERROR_INSUFFICIENT_AUTHORIZATION;
+  }
+  return write ? GATT_ERROR_WRITE_NOT_PERMITTED : GATT_ERROR_READ_NOT_PERMITTED;
+}
+
+/* Current value of an attribute as seen by this connection. The application may refresh mutable values
+ * from the read event before they are encoded. */
+static const uint8_t *read_attribute(ConnectionContext *context, uint16_t handle, const GATTAttribute *attr,
+                                     uint8_t *scratch, uint16_t *length, GATTEventCallback callback) {
+  if (attr->type == GATT_CCCD_UUID) {
+    put16(scratch, context ? CONN_get_cccd(context, handle) : 0);
+    *length = 2;
+    return scratch;
+  }
+
+  if (attr->value && callback) {
+    GATTEvent event = { .type = GATT_EVENT_READ_REQUEST,
+                        .connection_handle = context->connection_handle,
+                        .attribute_handle = handle,
+                        .offset = 0,
+                        .length = 0,
+                        .data = NULL };
+    callback(&event);
+  }
+
+  *length = 0;
+  return GATT_DB_read(handle, scratch, length);
+}
+
+/***************************************************************************************
+ * Requests
+ **************************************************************************************/
+
+static void handle_exchange_mtu(ConnectionContext *context, uint8_t *packet, uint16_t length,
+                                GATTEventCallback callback) {
+  if (length != 3) {
+    send_error(context->connection_handle, packet[0], 0, GATT_ERROR_INVALID_PDU);
+    return;
+  }
+
+  uint16_t client_mtu = get16(&packet[1]);
+  uint8_t response[3] = { ATT_EXCHANGE_MTU_RESPONSE, BT_ATT_PREFERRED_MTU & 0xFFU,
+                          (BT_ATT_PREFERRED_MTU >> 8U) & 0xFFU };
+  HCI_ACL_enqueue(context->connection_handle, L2CAP_ATT_CID, HCI_ACL_PRIORITY_ATT_RESPONSE, response,
+                  sizeof(response));
+
+  /* The new MTU applies from the PDU after the response. */
+  uint16_t mtu = min16(client_mtu, BT_ATT_PREFERRED_MTU);
+  context->att_mtu = (mtu < ATT_DEFAULT_MTU) ? ATT_DEFAULT_MTU : mtu;
+
+  if (callback) {
+    GATTEvent event = { .type = GATT_EVENT_MTU_EXCHANGE,
+                        .connection_handle = context->connection_handle,
+                        .attribute_handle = 0,
+                        .offset = 0,
+                        .length = 2,
+                        .data = &packet[1] };
+    event.params.mtu_exchange.mtu = context->att_mtu;
+    callback(&event);
+  }
+}
+
+static void handle_read(ConnectionContext *context, uint8_t *packet, uint16_t length, GATTEventCallback callback) {
+  if (length != 3) {
+    send_error(context->connection_handle, packet[0], 0, GATT_ERROR_INVALID_PDU);
+    return;
+  }
+
+  uint16_t handle = get16(&packet[1]);
+  const GATTAttribute *attr = GATT_DB_get(handle);
+  if (!attr) {
+    send_error(context->connection_handle, packet[0], handle, GATT_ERROR_INVALID_HANDLE);
+    return;
+  }
+
+  GATTError error = check_access(attr, false);
+  if (error != GATT_ERROR_SUCCESS) {
+    send_error(context->connection_handle, packet[0], handle, error);
+    return;
+  }
+
+  uint8_t scratch[GATT_DB_SCRATCH_SIZE];
+  uint16_t value_length = 0;
+  const uint8_t *value = read_attribute(context, handle, attr, scratch, &value_length, callback);
+
+  uint8_t buffer;
+  uint8_t *pdu = reserve_response(&buffer);
+  if (!pdu) {
+    return;
+  }
+
+  /* Longer values are read in full with Read Blob, the first MTU - 1 bytes go here. */
+  value_length = value ? min16(value_length, response_mtu(context) - 1) : 0;
+  pdu[0] = ATT_READ_RESPONSE;
+  if (value_length > 0) {
+    memcpy(&pdu[1], value, value_length);
+  }
+  send_response(context, buffer, 1 + value_length);
+}
+
+static void handle_write(ConnectionContext *context, uint8_t *packet, uint16_t length, GATTEventCallback callback) {
+  bool respond = packet[0] == ATT_WRITE_REQUEST;
+
+  if (length < 3) {
+    if (respond) {
+      send_error(context->connection_handle, packet[0], 0, GATT_ERROR_INVALID_PDU);
+    }
+    return;
+  }
+
+  uint16_t handle = get16(&packet[1]);
+  uint8_t *value = &packet[3];
+  uint16_t value_length = length - 3;
+
+  const GATTAttribute *attr = GATT_DB_get(handle);
+  GATTError error = attr ? check_access(attr, true) : GATT_ERROR_INVALID_HANDLE;
+
+  if (error == GATT_ERROR_SUCCESS && attr->type == GATT_CCCD_UUID) {
+    /* Other descriptors may sit between the characteristic value and its CCCD. */
+    const GATTAttribute *characteristic = GATT_DB_get(GATT_DB_descriptor_owner(handle));
+    uint16_t allowed = 0;
+    if (characteristic) {
+      allowed |= (characteristic->properties & GATT_PROP_NOTIFY) ? GATT_NOTIFY : 0;
+      allowed |= (characteristic->properties & GATT_PROP_INDICATE) ? GATT_INDICATE : 0;
+    }
+
+    if (value_length != 2) {
+      error = GATT_ERROR_INVALID_VALUE_LENGTH;
+    } else if (get16(value) & ~allowed) {
+      error = GATT_ERROR_VALUE_NOT_ALLOWED;
+    } else if (!CONN_set_cccd(context, handle, get16(value))) {
+      error = GATT_ERROR_INSUFFICIENT_RESOURCES;
+    }
+  } else if (error == GATT_ERROR_SUCCESS) {
+    /* Declarations and fixed values have no storage to write to. */
+    error = attr->value ? GATT_DB_write(handle, value, value_length) : GATT_ERROR_WRITE_NOT_PERMITTED;
+  }
+
+  if (error != GATT_ERROR_SUCCESS) {
+    if (respond) {
+      send_error(context->connection_handle, packet[0], handle, error);
+    }
+    return;
+  }
+
+  if (respond) {
+    uint8_t response[1] = { ATT_WRITE_RESPONSE };
+    HCI_ACL_enqueue(context->connection_handle, L2CAP_ATT_CID, HCI_ACL_PRIORITY_ATT_RESPONSE, response,
+                    sizeof(response));
+  }
+
+  if (callback) {
+    GATTEvent event = { .type = GATT_EVENT_WRITE_REQUEST,
+                        .connection_handle = context->connection_handle,
+                        .attribute_handle = handle,
+                        .offset = 0,
+                        .length = value_length,
+                        .data = value };
+    callback(&event);
+  }
+}
+
+/* Parse the handle range shared by the discovery requests, answering malformed ones. */
+static bool parse_range(ConnectionContext *context, uint8_t *packet, uint16_t length, uint16_t min_length,
+                        uint16_t *start, uint16_t *end) {
+  if (length < min_length) {
+    send_error(context->connection_handle, packet[0], 0, GATT_ERROR_INVALID_PDU);
+    return false;
+  }
+
+  *start = get16(&packet[1]);
+  *end = get16(&packet[3]);
+  if (*start == 0 || *start > *end) {
+    send_error(context->connection_handle, packet[0], *start, GATT_ERROR_INVALID_HANDLE);
+    return false;
+  }
+
+  *end = min16(*end, GATT_DB_last_handle());
+  return true;
+}
+
+/***************************************************************************************
+ * Discovery response encoding
+ **************************************************************************************/
+
+/* The encoders below fill pdu with as many entries as fit mtu and return its length, 0 if nothing matched. */
+
+static uint16_t encode_read_by_group_type(uint8_t *pdu, uint16_t mtu, uint16_t start, uint16_t end,
+                                          uint16_t group_type, EncodeResult *result) {
+  /* Every local service has a 16-bit UUID, so all entries are handle, group end and UUID. */
+  const uint16_t entry_length = 4 + ATT_UUID16_SIZE;
+  uint16_t offset = 2;
+  result->full = false;
+
+  for (uint16_t handle = start; handle <= end; handle++) {
+    const GATTAttribute *attr = GATT_DB_get(handle);
+    if (attr->type != group_type) {
+      continue;
+    }
+    if (offset + entry_length > mtu) {
+      result->full = true;
+      break;
+    }
+
+    put16(&pdu[offset], handle);
+    put16(&pdu[offset + 2], GATT_DB_service_end(handle));
+    put16(&pdu[offset + 4], attr->service_uuid);
+    offset += entry_length;
+    result->last = handle;
+  }
+
+  if (offset == 2) {
+    return 0;
+  }
+
+  pdu[0] = ATT_READ_BY_GROUP_TYPE_RESPONSE;
+  pdu[1] = entry_length;
+  return offset;
+}
+
+/* Also reports the access error of a first match that cannot be read, with its handle in result->last. */
+static uint16_t encode_read_by_type(ConnectionContext *context, uint8_t *pdu, uint16_t mtu, uint16_t start,
+                                    uint16_t end, uint16_t type, GATTEventCallback callback, EncodeResult *result,
+                                    GATTError *error) {
+  uint16_t offset = 2;
+  uint16_t entry_length = 0;
+  result->full = false;
+  *error = GATT_ERROR_ATTRIBUTE_NOT_FOUND;
+
+  for (uint16_t handle = start; handle <= end; handle++) {
+    const GATTAttribute *attr = GATT_DB_get(handle);
+    if (attr->type != type) {
+      continue;
+    }
+
+    /* Only the first match may report an access error, later ones end the response instead. */
+    GATTError access = check_access(attr, false);
+    if (access != GATT_ERROR_SUCCESS) {
+      if (entry_length == 0) {
+        result->last = handle;
+        *error = access;
+        return 0;
+      }
+      break;
+    }
+
+    uint8_t scratch[GATT_DB_SCRATCH_SIZE];
+    uint16_t value_length = 0;
+    const uint8_t *value = read_attribute(context, handle, attr, scratch, &value_length, callback);
+    if (!value) {
+      value_length = 0;
+    }
+
+    /* The first entry fixes the length for the whole response, truncated to fit the MTU and the length byte. */
+    if (entry_length == 0) {
+      entry_length = 2 + min16(value_length, min16(mtu - 4, 253));
+    } else if (2 + value_length != entry_length) {
+      break;
+    } else if (offset + entry_length > mtu) {
+      result->full = true;
+      break;
+    }
+
+    put16(&pdu[offset], handle);
+    if (entry_length > 2) {
+      memcpy(&pdu[offset + 2], value, entry_length - 2);
+    }
+    offset += entry_length;
+    result->last = handle;
+  }
+
+  if (entry_length == 0) {
+    return 0;
+  }
+
+  pdu[0] = ATT_READ_BY_TYPE_RESPONSE;
+  pdu[1] = entry_length;
+  return offset;
+}
+
+static uint16_t encode_find_information(uint8_t *pdu, uint16_t mtu, uint16_t start, uint16_t end,
+                                        EncodeResult *result) {
+  const uint16_t entry_length = 2 + ATT_UUID16_SIZE;
+  uint16_t offset = 2;
+  result->full = false;
+
+  for (uint16_t handle = start; handle <= end; handle++) {
+    if (offset + entry_length > mtu) {
+      result->full = true;
+      break;
+    }
+
+    put16(&pdu[offset], handle);
+    put16(&pdu[offset + 2], GATT_DB_get(handle)->type);
+    offset += entry_length;
+    result->last = handle;
+  }
+
+  if (offset == 2) {
+    return 0;
+  }
+
+  pdu[0] = ATT_FIND_INFORMATION_RESPONSE;
+  pdu[1] = ATT_FIND_INFO_FORMAT_UUID16;
+  return offset;
+}
+
+/***************************************************************************************
+ * Discovery response cache
+ **************************************************************************************/
+
+/* First handle after from that a discovery request of this kind would return, 0 if none. */
+static uint16_t next_match(uint8_t opcode, uint16_t from) {
+  uint16_t last = GATT_DB_last_handle();
+  if (opcode == ATT_FIND_INFORMATION_REQUEST) {
+    return (from <= last) ? from : 0;
+  }
+
+  uint16_t type = (opcode == ATT_READ_BY_GROUP_TYPE_REQUEST) ? GATT_PRIMARY_SERVICE_UUID : GATT_CHARACTERISTIC_UUID;
+  for (uint16_t handle = from; handle != 0 && handle <= last; handle++) {
+    if (GATT_DB_get(handle)->type == type) {
+      return handle;
+    }
+  }
+  return 0;
+}
+
+/* Room to encode one response for mtu at the end of the cache, NULL when the cache is full. */
+static uint8_t *cache_slot(uint16_t mtu) {
+  if (cache_count >= ATT_CACHE_ENTRIES || cache_used + mtu > sizeof(cache_data)) {
+    return NULL;
+  }
+  return &cache_data[cache_used];
+}
+
+/* Keep the response just encoded into cache_slot. */
+static void cache_store(uint8_t opcode, uint16_t start, uint16_t scan_end, uint16_t length,
+                        const EncodeResult *result) {
+  uint8_t entry_length = (opcode == ATT_FIND_INFORMATION_REQUEST) ? 2 + ATT_UUID16_SIZE : cache_data[cache_used + 1];
+
+  /* A response that held everything in range is the same for every larger MTU, keep it once. */
+  for (uint8_t i = 0; i < cache_count; i++) {
+    ATTCacheEntry *entry = &cache[i];
+    if (entry->opcode == opcode && entry->start == start && !entry->full && entry->length == length) {
+      return;
+    }
+  }
+
+  /* Without a fill limit the response also holds for a longer range, up to the next attribute it would take. */
+  uint16_t next = (scan_end < GATT_DB_last_handle()) ? next_match(opcode, scan_end + 1) : 0;
+
+  ATTCacheEntry *entry = &cache[cache_count++];
+  entry->opcode = opcode;
+  entry->entry_length = entry_length;
+  entry->full = result->full;
+  entry->start = start;
+  entry->min_end = result->last;
+  entry->max_end = (result->full || next == 0) ? 0xFFFF : next - 1;
+  entry->offset = cache_used;
+  entry->length = length;
+  cache_used += length;
+}
+
+static void cache_build_for_mtu(uint16_t mtu) {
+  uint16_t last = GATT_DB_last_handle();
+  EncodeResult result;
+  GATTError error;
+  uint8_t *pdu;
+
+  /* Primary service discovery walks the whole database. */
+  for (uint16_t start = 1; start <= last && (pdu = cache_slot(mtu)) != NULL;) {
+    uint16_t length = encode_read_by_group_type(pdu, mtu, start, last, GATT_PRIMARY_SERVICE_UUID, &result);
+    if (length == 0) {
+      break;
+    }
+    cache_store(ATT_READ_BY_GROUP_TYPE_REQUEST, start, last, length, &result);
+    start = GATT_DB_service_end(result.last) + 1;
+  }
+
+  for (uint16_t service = 1; service <= last; service = GATT_DB_service_end(service) + 1) {
+    uint16_t service_end = GATT_DB_service_end(service);
+
+    /* Characteristic discovery walks each service from its declaration. */
+    for (uint16_t start = service; start <= service_end && (pdu = cache_slot(mtu)) != NULL;) {
+      uint16_t length = encode_read_by_type(NULL, pdu, mtu, start, service_end, GATT_CHARACTERISTIC_UUID, NULL,
+                                            &result, &error);
+      if (length == 0) {
+        break;
+      }
+      cache_store(ATT_READ_BY_TYPE_REQUEST, start, service_end, length, &result);
+      start = result.last + 1;
+    }
+
+    /* Descriptor discovery walks the handles between a characteristic value and the next declaration. */
+    for (uint16_t handle = service + 1; handle < service_end; handle++) {
+      if (GATT_DB_get(handle)->type != GATT_CHARACTERISTIC_UUID) {
+        continue;
+      }
+
+      uint16_t characteristic_end = handle + 1;
+      while (characteristic_end < service_end &&
+             GATT_DB_get(characteristic_end + 1)->type != GATT_CHARACTERISTIC_UUID) {
+        characteristic_end++;
+      }
+
+      for (uint16_t start = handle + 2; start <= characteristic_end && (pdu = cache_slot(mtu)) != NULL;) {
+        uint16_t length = encode_find_information(pdu, mtu, start, characteristic_end, &result);
+        cache_store(ATT_FIND_INFORMATION_REQUEST, start, characteristic_end, length, &result);
+        start = result.last + 1;
+      }
+    }
+  }
+}
+
+void ATT_SERVER_build_discovery_cache(void) {
+  cache_count = 0;
+  cache_used = 0;
+  cache_generation = GATT_DB_generation();
+  cache_ready = false;
+
+  if (!GATT_DB_is_frozen()) {
+    return;
+  }
+
+  /* Connections on the default MTU and on the MTU this device negotiates cover nearly every client. */
+  cache_build_for_mtu(ATT_DEFAULT_MTU);
+  if (BT_ATT_PREFERRED_MTU > ATT_DEFAULT_MTU) {
+    cache_build_for_mtu(min16(BT_ATT_PREFERRED_MTU, HCI_ACL_MAX_PAYLOAD));
+  }
+  cache_ready = true;
+}
+
+/* Answer from the cache with a single copy when it holds exactly what would be encoded for this request. */
+static bool cache_serve(ConnectionContext *context, uint8_t opcode, uint16_t start, uint16_t end) {
+  if (!cache_ready || cache_generation != GATT_DB_generation()) {
+    return false;
+  }
+
+  uint16_t mtu = response_mtu(context);
+  for (uint8_t i = 0; i < cache_count; i++) {
+    ATTCacheEntry *entry = &cache[i];
+    if (entry->opcode != opcode || entry->start != start || end < entry->min_end || end > entry->max_end) {
+      continue;
+    }
+
+    /* A response cut by its MTU only matches connections on which the same number of entries fit. */
+    bool fits = entry->full ? (mtu - 2) / entry->entry_length == (entry->length - 2) / entry->entry_length
+                            : entry->length <= mtu;
+    if (!fits) {
+      continue;
+    }
+
+    uint8_t buffer;
+    uint8_t *pdu = reserve_response(&buffer);
+    if (pdu) {
+      memcpy(pdu, &cache_data[entry->offset], entry->length);
+      send_response(context, buffer, entry->length);
+    }
+    return true;
+  }
+
+  return false;
+}
+
+/***************************************************************************************
+ * Discovery requests
+ **************************************************************************************/
+
+static void handle_read_by_group_type(ConnectionContext *context, uint8_t *packet, uint16_t length) {
+  uint16_t start, end, group_type;
+  if (!parse_range(context, packet, length, 5, &start, &end)) {
+    return;
+  }
+
+  if (!parse_uuid(&packet[5], length - 5, &group_type) ||
+      (group_type != GATT_PRIMARY_SERVICE_UUID && group_type != GATT_SECONDARY_SERVICE_UUID)) {
+    send_error(context->connection_handle, packet[0], start,
+               (length == 7 || length == 21) ? GATT_ERROR_UNSUPPORTED_GROUP_TYPE : GATT_ERROR_INVALID_PDU);
+    return;
+  }
+
+  if (group_type == GATT_PRIMARY_SERVICE_UUID && cache_serve(context, packet[0], start, end)) {
+    return;
+  }
+
+  uint8_t buffer;
+  uint8_t *pdu = reserve_response(&buffer);
+  if (!pdu) {
+    return;
+  }
+
+  EncodeResult result;
+  uint16_t response_length = encode_read_by_group_type(pdu, response_mtu(context), start, end, group_type, &result);
+  if (response_length == 0) {
+    HCI_ACL_release(buffer);
+    send_error(context->connection_handle, packet[0], start, GATT_ERROR_ATTRIBUTE_NOT_FOUND);
+    return;
+  }
+
+  send_response(context, buffer, response_length);
+}
+
+static void handle_read_by_type(ConnectionContext *context, uint8_t *packet, uint16_t length,
+                                GATTEventCallback callback) {
+  uint16_t start, end, type;
+  if (!parse_range(context, packet, length, 5, &start, &end)) {
+    return;
+  }
+
+  if (length != 7 && length != 21) {
+    send_error(context->connection_handle, packet[0], 0, GATT_ERROR_INVALID_PDU);
+    return;
+  }
+
+  /* A 128-bit type outside the Base UUID matches nothing in a database of 16-bit types. */
+  if (!parse_uuid(&packet[5], length - 5, &type)) {
+    send_error(context->connection_handle, packet[0], start, GATT_ERROR_ATTRIBUTE_NOT_FOUND);
+    return;
+  }
+
+  if (type == GATT_CHARACTERISTIC_UUID && cache_serve(context, packet[0], start, end)) {
+    return;
+  }
+
+  uint8_t buffer;
+  uint8_t *pdu = reserve_response(&buffer);
+  if (!pdu) {
+    return;
+  }
+
+  EncodeResult result;
+  GATTError error;
+  uint16_t response_length =
+      encode_read_by_type(context, pdu, response_mtu(context), start, end, type, callback, &result, &error);
+  if (response_length == 0) {
+    HCI_ACL_release(buffer);
+    send_error(context->connection_handle, packet[0],
+               (error == GATT_ERROR_ATTRIBUTE_NOT_FOUND) ? start : result.last, error);
+    return;
+  }
+
+  send_response(context, buffer, response_length);
+}
+
+static void handle_find_information(ConnectionContext *context, uint8_t *packet, uint16_t length) {
+  uint16_t start, end;
+  if (!parse_range(context, packet, length, 5, &start, &end)) {
+    return;
+  }
+
+  if (cache_serve(context, packet[0], start, end)) {
+    return;
+  }
+
+  uint8_t buffer;
+  uint8_t *pdu = reserve_response(&buffer);
+  if (!pdu) {
+    return;
+  }
+
+  EncodeResult result;
+  uint16_t response_length = encode_find_information(pdu, response_mtu(context), start, end, &result);
+  if (response_length == 0) {
+    HCI_ACL_release(buffer);
+    send_error(context->connection_handle, packet[0], start, GATT_ERROR_ATTRIBUTE_NOT_FOUND);
+    return;
+  }
+
+  send_response(context, buffer, response_length);
+}
+
+/***************************************************************************************
+ * Dispatch
+ **************************************************************************************/
+
+static bool is_request(uint8_t opcode) {
+  /* Requests are the even opcodes without the command flag, except the Handle Value Confirmation. */
+  return !(opcode & ATT_COMMAND_FLAG) && !(opcode & 0x01U) && opcode != ATT_HANDLE_VALUE_CONFIRMATION;
+}
+
+bool ATT_SERVER_handle(uint16_t connection_handle, uint8_t *packet, uint16_t length, GATTEventCallback callback) {
+  if (!packet || length < 1) {
+    return false;
+  }
+
+  uint8_t opcode = packet[0];
+  bool command = (opcode & ATT_COMMAND_FLAG) != 0;
+  if (!command && !is_request(opcode)) {
+    return false;
+  }
+
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (!context) {
+    return true;
+  }
+
+  switch (opcode) {
+    case ATT_EXCHANGE_MTU_REQUEST:
+      handle_exchange_mtu(context, packet, length, callback);
+      break;
+
+    case ATT_READ_REQUEST:
+      handle_read(context, packet, length, callback);
+      break;
+
+    case ATT_WRITE_REQUEST:
+    case ATT_WRITE_COMMAND:
+      handle_write(context, packet, length, callback);
+      break;
+
+    case ATT_READ_BY_GROUP_TYPE_REQUEST:
+      handle_read_by_group_type(context, packet, length);
+      break;
+
+    case ATT_READ_BY_TYPE_REQUEST:
+      handle_read_by_type(context, packet, length, callback);
+      break;
+
+    case ATT_FIND_INFORMATION_REQUEST:
+      handle_find_information(context, packet, length);
+      break;
+
+    default:
+      /* Unknown commands are ignored, unknown requests must still be answered. */
+      if (!command) {
+        send_error(connection_handle, opcode, 0, GATT_ERROR_REQUEST_NOT_SUPPORTED);
+      }
+      break;
+  }
+
+  return true;
+}
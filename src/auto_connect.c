@@ -0,0 +1,262 @@
+#include "auto_connect.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "hardware_bl.h"
+#include "hci_defs.h"
+#include "log_bl.h"
+
+/* Initiator duty cycles. Fast scans continuously, slow catches a peer advertising every second or so
+ * while leaving the radio mostly idle. */
+#define FAST_SCAN_INTERVAL_MS 30
+#define FAST_SCAN_WINDOW_MS 30
+#define SLOW_SCAN_INTERVAL_MS 1280
+#define SLOW_SCAN_WINDOW_MS 60
+
+/* Time the controller gets to end an initiation after a cancel */
+#define CANCEL_TIMEOUT_MS 500
+
+static AutoConnPeer peers[AUTO_CONN_MAX_PEERS];
+
+static bool auto_enabled = true;
+static bool paused = false;
+static uint64_t fast_until_ms = 0;
+
+/* Background initiation state, cleared from the event handlers */
+static volatile bool initiating = false;
+static volatile bool cancel_pending = false;
+static bool initiating_fast = false;
+
+/* Set when GAP took the initiator, cleared once the foreground attempt ends */
+static volatile bool yielded = false;
+
+static AutoConnPeer *find_peer(uint8_t addr_type, const uint8_t *addr) {
+  /* Identity address types (0x02, 0x03) carry the same address as public and random. */
+  addr_type &= 0x01;
+
+  for (uint8_t i = 0; i < AUTO_CONN_MAX_PEERS; i++) {
+    if (peers[i].used && peers[i].addr_type == addr_type && memcmp(peers[i].addr, addr, 6) == 0) {
+      return &peers[i];
+    }
+  }
+  return NULL;
+}
+
+static bool peer_missing(void) {
+  for (uint8_t i = 0; i < AUTO_CONN_MAX_PEERS; i++) {
+    if (peers[i].used && !peers[i].connected) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static HCIError stop_initiating(void) {
+  if (!initiating) {
+    return HCI_ERROR_SUCCESS;
+  }
+
+  if (!cancel_pending) {
+    uint64_t start_ms = hw_get_time_ms();
+    while (HCI_get_command_credits() == 0) {
+      if (hw_get_time_ms() - start_ms > CANCEL_TIMEOUT_MS) {
+        return HCI_ERROR_COMMAND_TIMEOUT;
+      }
+    }
+
+    cancel_pending = true;
+    HCIError status = HCI_BLE_create_connection_cancel_async();
+    if (status != HCI_ERROR_SUCCESS) {
+      cancel_pending = false;
+      return status;
+    }
+  }
+
+  uint64_t start_ms = hw_get_time_ms();
+  while (initiating) {
+    if (hw_get_time_ms() - start_ms > CANCEL_TIMEOUT_MS) {
+      return HCI_ERROR_COMMAND_TIMEOUT;
+    }
+  }
+  return HCI_ERROR_SUCCESS;
+}
+
+static void start_initiating(uint64_t now_ms) {
+  /* The accept list cannot change while the initiator uses it, so bring it up to date first. */
+  if (ACCEPT_LIST_sync() != HCI_ERROR_SUCCESS) {
+    return;
+  }
+
+  /* Without a command credit, try again on the next AUTO_CONN_process. */
+  if (HCI_get_command_credits() == 0) {
+    return;
+  }
+
+  bool fast = now_ms < fast_until_ms;
+  uint8_t no_addr[6] = { 0 };
+
+  initiating = true;
+  initiating_fast = fast;
+  HCIError status = HCI_BLE_create_connection_async(fast ? FAST_SCAN_INTERVAL_MS : SLOW_SCAN_INTERVAL_MS,
+                                                    fast ? FAST_SCAN_WINDOW_MS : SLOW_SCAN_WINDOW_MS,
+                                                    CONN_INITIATOR_FILTER_LIST_USED,
+                                                    CONN_PEER_PUBLIC_DEVICE_ADDRESS, no_addr,
+                                                    CONN_OWN_PUBLIC_DEVICE_ADDRESS, 50, 100, 0, 2000);
+  if (status != HCI_ERROR_SUCCESS) {
+    initiating = false;
+  }
+}
+
+bool AUTO_CONN_add_peer(uint8_t addr_type, const uint8_t *addr) {
+  if (!addr) {
+    return false;
+  }
+  if (find_peer(addr_type, addr)) {
+    return true;
+  }
+
+  for (uint8_t i = 0; i < AUTO_CONN_MAX_PEERS; i++) {
+    if (!peers[i].used) {
+      if (!ACCEPT_LIST_add(addr_type & 0x01, addr)) {
+        return false;
+      }
+      memset(&peers[i], 0, sizeof(AutoConnPeer));
+      peers[i].addr_type = addr_type & 0x01;
+      memcpy(peers[i].addr, addr, 6);
+      peers[i].used = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool AUTO_CONN_remove_peer(uint8_t addr_type, const uint8_t *addr) {
+  AutoConnPeer *peer = addr ? find_peer(addr_type, addr) : NULL;
+  if (!peer) {
+    return false;
+  }
+
+  ACCEPT_LIST_remove(peer->addr_type, peer->addr);
+  peer->used = false;
+  return true;
+}
+
+void AUTO_CONN_set_enabled(bool enabled) {
+  auto_enabled = enabled;
+}
+
+HCIError AUTO_CONN_pause(void) {
+  paused = true;
+  return stop_initiating();
+}
+
+void AUTO_CONN_resume(void) {
+  paused = false;
+}
+
+HCIError AUTO_CONN_yield(void) {
+  yielded = true;
+  HCIError status = stop_initiating();
+  if (status != HCI_ERROR_SUCCESS) {
+    yielded = false;
+  }
+  return status;
+}
+
+void AUTO_CONN_unyield(void) {
+  yielded = false;
+}
+
+const AutoConnStats *AUTO_CONN_get_stats(uint8_t addr_type, const uint8_t *addr) {
+  AutoConnPeer *peer = addr ? find_peer(addr_type, addr) : NULL;
+  return peer ? &peer->stats : NULL;
+}
+
+void AUTO_CONN_process(void) {
+  uint64_t now_ms = hw_get_time_ms();
+  bool wanted = auto_enabled && !paused && !yielded && peer_missing() && CONN_count() < MAX_CONNECTIONS;
+
+  if (initiating) {
+    /* Restart to change the duty cycle or the accept list, stop if nothing is missing. */
+    bool fast = now_ms < fast_until_ms;
+    if (!cancel_pending && HCI_get_command_credits() > 0 &&
+        (!wanted || fast != initiating_fast || ACCEPT_LIST_dirty())) {
+      cancel_pending = true;
+      if (HCI_BLE_create_connection_cancel_async() != HCI_ERROR_SUCCESS) {
+        cancel_pending = false;
+      }
+    }
+    return;
+  }
+
+  if (wanted) {
+    start_initiating(now_ms);
+  }
+}
+
+void AUTO_CONN_handle_connection_complete(uint8_t status, uint8_t role, uint8_t addr_type, const uint8_t *addr) {
+  /* A central link or a failed attempt, a cancel included, ends the initiator, the background one or GAP's.
+   * Advertising completes with the peripheral role or an advertising timeout. */
+  bool initiator_ended = (status == HCI_ERROR_SUCCESS) ? role == CONN_ROLE_CENTRAL
+                                                       : status != STATUS_ADVERTISING_TIMEOUT;
+  if (initiator_ended) {
+    initiating = false;
+    cancel_pending = false;
+    yielded = false;
+  }
+
+  if (status != HCI_ERROR_SUCCESS) {
+    return;
+  }
+
+  AutoConnPeer *peer = find_peer(addr_type, addr);
+  if (!peer) {
+    return;
+  }
+
+  peer->connected = true;
+  if (peer->dropped_ms != 0) {
+    uint32_t latency_ms = (uint32_t)(hw_get_time_ms() - peer->dropped_ms);
+    peer->stats.reconnects++;
+    peer->stats.last_latency_ms = latency_ms;
+    peer->stats.total_latency_ms += latency_ms;
+    if (latency_ms > peer->stats.max_latency_ms) {
+      peer->stats.max_latency_ms = latency_ms;
+    }
+    peer->dropped_ms = 0;
+  }
+}
+
+void AUTO_CONN_handle_disconnection(ConnectionContext *context) {
+  AutoConnPeer *peer = find_peer(context->peer_address_type, context->peer_address);
+  if (!peer) {
+    return;
+  }
+
+  peer->connected = false;
+  peer->dropped_ms = hw_get_time_ms();
+  fast_until_ms = peer->dropped_ms + BT_AUTO_CONNECT_FAST_PERIOD_MS;
+}
+
+void AUTO_CONN_handle_command_result(uint16_t op_code, uint8_t status) {
+  if (status == HCI_ERROR_SUCCESS) {
+    return;
+  }
+
+  switch (op_code) {
+    case CMD_BLE_CREATE_CONNECTION:
+      /* Rejected, background or foreground, no connection complete will follow. */
+      initiating = false;
+      yielded = false;
+      break;
+
+    case CMD_BLE_CREATE_CONNECTION_CANCEL:
+      /* Nothing to cancel, the initiation already ended with a connection. */
+      cancel_pending = false;
+      break;
+
+    default:
+      break;
+  }
+}
@@ -0,0 +1,20 @@
+#include "bluetooth_stack.h"
+
+#include "auto_connect.h"
+#include "broadcaster.h"
+#include "conn_params.h"
+#include "connection.h"
+#include "hci_acl.h"
+#include "l2cap.h"
+#include "link_setup.h"
+
+void bluetooth_stack_process(void) {
+  CONN_release_closed();
+  GAP_process();
+  L2CAP_process();
+  LINK_process();
+  CONN_PARAMS_process();
+  AUTO_CONN_process();
+  BCAST_process();
+  HCI_ACL_schedule();
+}
@@ -0,0 +1,181 @@
+#include "broadcaster.h"
+
+#include <string.h>
+
+#include "hardware_bl.h"
+#include "hci.h"
+#include "hci_defs.h"
+#include "log_bl.h"
+
+/* Time after which an update without completion is given up */
+#define UPDATE_TIMEOUT_MS 1000
+
+static bool running = false;
+static uint16_t update_period_ms = 0;
+
+/* Advertising data in HCI parameter layout, the value is patched in at value_offset. */
+static uint8_t params[AD_MAX_DATA_LENGTH + 1];
+static uint8_t value_offset = 0;
+static uint8_t slot_length = 0;
+
+static uint8_t latest[BCAST_MAX_VALUE_LENGTH];
+static bool pending = false;
+
+static volatile bool in_flight = false;
+static uint64_t sent_ms = 0;
+
+static BcastStats stats;
+
+GAPError BCAST_start(const ADBuilder *base, uint16_t company_id, uint8_t value_length, uint16_t interval_ms,
+                     uint16_t period_ms) {
+  if (value_length == 0 || value_length > BCAST_MAX_VALUE_LENGTH) {
+    return GAP_ERROR_INVALID_PARAMETERS;
+  }
+
+  if (running) {
+    BCAST_stop();
+  }
+
+  ADBuilder builder;
+  if (base) {
+    builder = *base;
+  } else {
+    AD_builder_init(&builder);
+    AD_builder_add_flags(&builder, AD_FLAG_BR_EDR_NOT_SUPPORTED);
+  }
+
+  uint8_t zero[BCAST_MAX_VALUE_LENGTH] = { 0 };
+  if (!AD_builder_add_manufacturer_data(&builder, company_id, zero, value_length)) {
+    return GAP_ERROR_INVALID_PARAMETERS;
+  }
+
+  ADPayload payload;
+  if (!AD_builder_encode(&builder, &payload)) {
+    return GAP_ERROR_INVALID_PARAMETERS;
+  }
+
+  /* The value has to reach passive scanners, so the manufacturer data must not overflow. */
+  ADIterator it;
+  ADStructure ad;
+  bool found = false;
+  AD_iterator_init(&it, payload.adv_data, payload.adv_data_length);
+  while (AD_next(&it, &ad)) {
+    if (ad.type == AD_TYPE_MANUFACTURER_DATA && ad.length == value_length + 2 && ad.data[0] == (company_id & 0xFF) &&
+        ad.data[1] == ((company_id >> 8) & 0xFF)) {
+      value_offset = 1 + (uint8_t)(&ad.data[2] - payload.adv_data);
+      found = true;
+    }
+  }
+  if (!found) {
+    return GAP_ERROR_INVALID_PARAMETERS;
+  }
+
+  GAPError status = GAP_set_advertising_payload(&builder);
+  if (status != GAP_ERROR_SUCCESS) {
+    return status;
+  }
+
+  memset(params, 0, sizeof(params));
+  params[0] = payload.adv_data_length;
+  memcpy(&params[1], payload.adv_data, payload.adv_data_length);
+  slot_length = value_length;
+  update_period_ms = period_ms;
+  pending = false;
+  in_flight = false;
+  sent_ms = 0;
+  memset(&stats, 0, sizeof(stats));
+
+  status = GAP_start_advertising(interval_ms, false);
+  if (status != GAP_ERROR_SUCCESS) {
+    return status;
+  }
+
+  running = true;
+  return GAP_ERROR_SUCCESS;
+}
+
+GAPError BCAST_stop(void) {
+  if (!running) {
+    return GAP_ERROR_SUCCESS;
+  }
+
+  running = false;
+  pending = false;
+
+  /* GAP must not skip its next advertising data because of bytes sent behind its back. */
+  uint64_t start_ms = hw_get_time_ms();
+  while (in_flight && hw_get_time_ms() - start_ms <= UPDATE_TIMEOUT_MS) {
+  }
+  in_flight = false;
+  GAP_invalidate_advertising_data();
+
+  return GAP_stop_advertising();
+}
+
+bool BCAST_write(const uint8_t *value) {
+  if (!running || !value) {
+    return false;
+  }
+
+  if (pending) {
+    stats.collapsed++;
+  }
+  memcpy(latest, value, slot_length);
+  pending = true;
+  stats.writes++;
+  return true;
+}
+
+void BCAST_get_stats(BcastStats *out) {
+  *out = stats;
+}
+
+void BCAST_process(void) {
+  if (!running) {
+    return;
+  }
+
+  uint64_t now_ms = hw_get_time_ms();
+
+  if (in_flight) {
+    if (now_ms - sent_ms <= UPDATE_TIMEOUT_MS) {
+      return;
+    }
+    log_bl_warning("Advertising data update timed out\r\n");
+    in_flight = false;
+  }
+
+  if (!pending || now_ms - sent_ms < update_period_ms || HCI_get_command_credits() == 0) {
+    return;
+  }
+
+  pending = false;
+  if (memcmp(&params[value_offset], latest, slot_length) == 0) {
+    stats.unchanged++;
+    return;
+  }
+  memcpy(&params[value_offset], latest, slot_length);
+
+  HCICommand cmd = { .op_code.raw = CMD_BLE_SET_ADVERTISING_DATA, .parameter_length = sizeof(params), .parameters = params };
+
+  in_flight = true;
+  sent_ms = now_ms;
+  if (HCI_send_command_async(&cmd) != HCI_ERROR_SUCCESS) {
+    in_flight = false;
+    return;
+  }
+  GAP_invalidate_advertising_data();
+  stats.sent++;
+}
+
+bool BCAST_handle_command_complete(uint16_t op_code, uint8_t status) {
+  if (op_code != CMD_BLE_SET_ADVERTISING_DATA || !in_flight) {
+    return false;
+  }
+
+  in_flight = false;
+  if (status != HCI_ERROR_SUCCESS) {
+    log_bl_warning("Advertising data update failed: 0x%x\r\n", status);
+  }
+  return true;
+}
@@ -0,0 +1,197 @@
+#include "conn_params.h"
+
+#include "connection.h"
+#include "hardware_bl.h"
+#include "hci.h"
+#include "log_bl.h"
+
+/* Byte rates (L2CAP TX + RX per second) separating the profiles. Entry and exit thresholds differ
+ * so a link sitting at the edge does not flip between profiles. */
+#define BURST_ENTER_RATE 4096
+#define BURST_EXIT_RATE 1024
+#define IDLE_ENTER_RATE 32
+#define IDLE_EXIT_RATE 128
+
+/* A TX queue this deep means the link cannot keep up with the application. */
+#define BURST_QUEUE_DEPTH 4
+
+/* Consecutive windows needed before leaving a profile */
+#define BURST_ENTER_WINDOWS 1
+#define BURST_EXIT_WINDOWS 3
+#define IDLE_ENTER_WINDOWS 5
+
+/* Give up on an update whose completion never arrived, e.g. because the controller rejected it. */
+#define UPDATE_TIMEOUT_MS 10000
+
+/* Controller units: intervals in 1.25 ms, supervision timeout in 10 ms.
+ * Normal is 50-100 ms, burst 7.5-15 ms, idle 100-200 ms with latency 4. */
+static const GAPConnectionParameters profiles[] = {
+  [CONN_PARAMS_PROFILE_NORMAL] = { .interval_min = 40, .interval_max = 80, .latency = 0, .supervision_timeout = 200 },
+  [CONN_PARAMS_PROFILE_BURST] = { .interval_min = 6, .interval_max = 12, .latency = 0, .supervision_timeout = 200 },
+  [CONN_PARAMS_PROFILE_IDLE] = { .interval_min = 80, .interval_max = 160, .latency = 4, .supervision_timeout = 600 },
+};
+
+static bool manager_enabled = true;
+static uint64_t window_start_ms = 0;
+
+static uint8_t saturating_increment(uint8_t count) {
+  return (count == UINT8_MAX) ? count : count + 1;
+}
+
+static ConnParamsProfile next_profile(ConnTraffic *traffic, uint32_t rate, uint8_t peak_queued) {
+  bool busy = rate >= BURST_ENTER_RATE || peak_queued >= BURST_QUEUE_DEPTH;
+  bool quiet = rate < BURST_EXIT_RATE && peak_queued == 0;
+  bool idle = rate < IDLE_ENTER_RATE && peak_queued == 0;
+
+  traffic->busy_windows = busy ? saturating_increment(traffic->busy_windows) : 0;
+  traffic->quiet_windows = quiet ? saturating_increment(traffic->quiet_windows) : 0;
+  traffic->idle_windows = idle ? saturating_increment(traffic->idle_windows) : 0;
+
+  switch (traffic->profile) {
+    case CONN_PARAMS_PROFILE_BURST:
+      return (traffic->quiet_windows >= BURST_EXIT_WINDOWS) ? CONN_PARAMS_PROFILE_NORMAL : CONN_PARAMS_PROFILE_BURST;
+
+    case CONN_PARAMS_PROFILE_IDLE:
+      if (busy) {
+        return CONN_PARAMS_PROFILE_BURST;
+      }
+      return (rate >= IDLE_EXIT_RATE || peak_queued > 0) ? CONN_PARAMS_PROFILE_NORMAL : CONN_PARAMS_PROFILE_IDLE;
+
+    default:
+      if (traffic->busy_windows >= BURST_ENTER_WINDOWS) {
+        return CONN_PARAMS_PROFILE_BURST;
+      }
+      return (traffic->idle_windows >= IDLE_ENTER_WINDOWS) ? CONN_PARAMS_PROFILE_IDLE : CONN_PARAMS_PROFILE_NORMAL;
+  }
+}
+
+/* Leave links alone until bring-up has applied the preferred parameters. */
+static bool is_managed(ConnectionContext *context) {
+  return context->state == CONN_STATE_CONNECTED && context->param_policy == GAP_CONN_POLICY_BALANCED &&
+         context->link_setup.pending == 0;
+}
+
+static void evaluate_connection(ConnectionContext *context, uint64_t now_ms, uint32_t elapsed_ms) {
+  ConnTraffic *traffic = &context->traffic;
+
+  uint32_t bytes = traffic->tx_bytes + traffic->rx_bytes;
+  uint8_t peak_queued = traffic->peak_queued;
+  traffic->tx_bytes = 0;
+  traffic->rx_bytes = 0;
+  traffic->peak_queued = context->tx.queued;
+
+  if (traffic->update_pending) {
+    if (now_ms - traffic->update_requested_ms < UPDATE_TIMEOUT_MS) {
+      return;
+    }
+    traffic->update_pending = false;
+  }
+
+  uint32_t rate = (uint32_t)(((uint64_t)bytes * 1000) / elapsed_ms);
+  traffic->wanted_profile = next_profile(traffic, rate, peak_queued);
+}
+
+/* The update shares the command credit with bring-up and peer replies, so it may wait a few calls. */
+static void request_profiles(void) {
+  uint64_t now_ms = hw_get_time_ms();
+
+  for (uint8_t i = 0; i < MAX_CONNECTIONS && HCI_get_command_credits() > 0; i++) {
+    ConnectionContext *context = CONN_get_slot(i);
+    if (!context || !is_managed(context) || context->traffic.update_pending ||
+        context->traffic.wanted_profile == context->traffic.profile) {
+      continue;
+    }
+
+    ConnTraffic *traffic = &context->traffic;
+    const GAPConnectionParameters *params = &profiles[traffic->wanted_profile];
+    HCIError status = HCI_BLE_connection_update_async(context->connection_handle, params->interval_min,
+                                                      params->interval_max, params->latency,
+                                                      params->supervision_timeout);
+    if (status != HCI_ERROR_SUCCESS) {
+      log_bl_warning("Connection update failed on handle %d\r\n", context->connection_handle);
+      traffic->wanted_profile = traffic->profile;
+      continue;
+    }
+
+    traffic->profile = traffic->wanted_profile;
+    traffic->update_pending = true;
+    traffic->update_requested_ms = now_ms;
+  }
+}
+
+void CONN_PARAMS_set_enabled(bool enabled) {
+  if (enabled && !manager_enabled) {
+    /* Start from a clean window, traffic seen while disabled would look like a burst. */
+    for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+      ConnectionContext *context = CONN_get_slot(i);
+      if (context) {
+        context->traffic.tx_bytes = 0;
+        context->traffic.rx_bytes = 0;
+        context->traffic.peak_queued = 0;
+      }
+    }
+    window_start_ms = hw_get_time_ms();
+  }
+  manager_enabled = enabled;
+}
+
+/* Each reply or update takes a command credit, requests left over are answered on the next call. */
+static void answer_peer_requests(void) {
+  for (uint8_t i = 0; i < MAX_CONNECTIONS && HCI_get_command_credits() > 0; i++) {
+    ConnectionContext *context = CONN_get_slot(i);
+    if (!context) {
+      continue;
+    }
+
+    /* The L2CAP response already went out, the LE Connection Update Complete event reports the outcome. */
+    if (context->peer_request.update_pending) {
+      GAPConnectionParameters *params = &context->peer_request.accepted;
+      context->peer_request.update_pending = false;
+      HCI_BLE_connection_update_async(context->connection_handle, params->interval_min, params->interval_max,
+                                      params->latency, params->supervision_timeout);
+      continue;
+    }
+
+    if (!context->peer_request.pending) {
+      continue;
+    }
+
+    GAPConnectionParameters params = context->peer_request.params;
+    context->peer_request.pending = false;
+
+    if (GAP_handle_connection_parameter_request(context->connection_handle, &params)) {
+      HCI_BLE_remote_connection_parameter_request_reply(context->connection_handle, params.interval_min,
+                                                        params.interval_max, params.latency,
+                                                        params.supervision_timeout);
+    } else {
+      HCI_BLE_remote_connection_parameter_request_negative_reply(context->connection_handle,
+                                                                 CONN_PARAM_REJECT_UNACCEPTABLE_PARAMETERS);
+    }
+  }
+}
+
+void CONN_PARAMS_process(void) {
+  answer_peer_requests();
+  if (manager_enabled) {
+    request_profiles();
+  }
+
+  uint64_t now_ms = hw_get_time_ms();
+  if (now_ms - window_start_ms < BT_CONN_PARAMS_WINDOW_MS) {
+    return;
+  }
+
+  uint32_t elapsed_ms = (uint32_t)(now_ms - window_start_ms);
+  window_start_ms = now_ms;
+
+  if (!manager_enabled) {
+    return;
+  }
+
+  for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+    ConnectionContext *context = CONN_get_slot(i);
+    if (context && is_managed(context)) {
+      evaluate_connection(context, now_ms, elapsed_ms);
+    }
+  }
+}
@@ -0,0 +1,131 @@
+#include "connection.h"
+
+#include <string.h>
+
+static ConnectionContext contexts[MAX_CONNECTIONS];
+
+/* Connection handle -> context slot. Indexed directly so RX and event paths never search. */
+static uint8_t handle_table[CONN_MAX_HANDLE + 1];
+
+static uint8_t open_count = 0;
+
+static void context_reset(ConnectionContext *context) {
+  memset(context, 0, sizeof(ConnectionContext));
+  context->att_mtu = ATT_DEFAULT_MTU;
+  context->max_tx_octets = CONN_DEFAULT_DATA_LENGTH;
+  context->max_tx_time = CONN_DEFAULT_DATA_TIME;
+  context->max_rx_octets = CONN_DEFAULT_DATA_LENGTH;
+  context->max_rx_time = CONN_DEFAULT_DATA_TIME;
+  context->tx_phy = PHY_LE_1M;
+  context->rx_phy = PHY_LE_1M;
+  context->preferred_phys = BT_LE_PREFERRED_PHYS;
+  HCI_ACL_queue_init(&context->tx);
+}
+
+void CONN_init(void) {
+  memset(handle_table, CONN_INVALID_SLOT, sizeof(handle_table));
+
+  for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+    context_reset(&contexts[i]);
+  }
+  open_count = 0;
+}
+
+ConnectionContext *CONN_open(uint16_t connection_handle) {
+  if (connection_handle > CONN_MAX_HANDLE) {
+    return NULL;
+  }
+
+  /* The controller reuses handles, a stale context means we missed the disconnection. */
+  if (handle_table[connection_handle] != CONN_INVALID_SLOT) {
+    CONN_close(connection_handle);
+  }
+
+  for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+    if (contexts[i].state == CONN_STATE_FREE) {
+      context_reset(&contexts[i]);
+      contexts[i].state = CONN_STATE_CONNECTED;
+      contexts[i].connection_handle = connection_handle;
+      handle_table[connection_handle] = i;
+      open_count++;
+      return &contexts[i];
+    }
+  }
+  return NULL;
+}
+
+void CONN_close(uint16_t connection_handle) {
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (!context) {
+    return;
+  }
+
+  /* The main loop may be sending from this context right now, so leave the queues to CONN_release_closed. */
+  handle_table[connection_handle] = CONN_INVALID_SLOT;
+  context->state = CONN_STATE_CLOSED;
+  open_count--;
+}
+
+void CONN_release_closed(void) {
+  for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+    if (contexts[i].state == CONN_STATE_CLOSED) {
+      HCI_ACL_flush(&contexts[i].tx);
+      /* A link that closed before GAP_process reported it stays unknown to the application. */
+      if (contexts[i].gap_events.reported) {
+        GAP_handle_connection_released(contexts[i].connection_handle, contexts[i].gap_events.disconnect_reason);
+      }
+      contexts[i].state = CONN_STATE_FREE;
+    }
+  }
+}
+
+ConnectionContext *CONN_lookup(uint16_t connection_handle) {
+  if (connection_handle > CONN_MAX_HANDLE) {
+    return NULL;
+  }
+
+  uint8_t slot = handle_table[connection_handle];
+  return (slot == CONN_INVALID_SLOT) ? NULL : &contexts[slot];
+}
+
+ConnectionContext *CONN_get_slot(uint8_t slot) {
+  if (slot >= MAX_CONNECTIONS || contexts[slot].state == CONN_STATE_FREE || contexts[slot].state == CONN_STATE_CLOSED) {
+    return NULL;
+  }
+  return &contexts[slot];
+}
+
+uint8_t CONN_count(void) {
+  return open_count;
+}
+
+uint16_t CONN_get_cccd(ConnectionContext *context, uint16_t attribute_handle) {
+  for (uint8_t i = 0; i < CONN_MAX_CCCDS; i++) {
+    if (context->cccds[i].attribute_handle == attribute_handle) {
+      return context->cccds[i].value;
+    }
+  }
+  return 0;
+}
+
+bool CONN_set_cccd(ConnectionContext *context, uint16_t attribute_handle, uint16_t value) {
+  ConnCCCD *free_entry = NULL;
+
+  for (uint8_t i = 0; i < CONN_MAX_CCCDS; i++) {
+    if (context->cccds[i].attribute_handle == attribute_handle) {
+      context->cccds[i].value = value;
+      return true;
+    }
+    if (!free_entry && context->cccds[i].attribute_handle == 0) {
+      free_entry = &context->cccds[i];
+    }
+  }
+
+  if (!free_entry) {
+    return false;
+  }
+
+  free_entry->attribute_handle = attribute_handle;
+  free_entry->value = value;
+  return true;
+}
@@ -0,0 +1,354 @@
+#include "ext_adv.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "hci_caps.h"
+#include "hci_defs.h"
+#include "log_bl.h"
+
+/* Controller status codes mapped to HCIError */
+#define STATUS_UNKNOWN_COMMAND 0x01
+#define STATUS_MEMORY_CAPACITY_EXCEEDED 0x07
+#define STATUS_COMMAND_DISALLOWED 0x0C
+#define STATUS_INVALID_PARAMETERS 0x12
+
+/* Operation values of LE Set Extended Advertising / Scan Response Data */
+#define OP_INTERMEDIATE_FRAGMENT 0x00
+#define OP_FIRST_FRAGMENT 0x01
+#define OP_LAST_FRAGMENT 0x02
+#define OP_COMPLETE_DATA 0x03
+
+/* Fragment_Preference: the controller should not fragment, fewer AUX_CHAIN_IND per event */
+#define FRAGMENT_PREFERENCE_MINIMIZE 0x01
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+static ExtAdvSet sets[EXT_ADV_MAX_SETS];
+static uint8_t controller_sets = 0;
+static uint16_t controller_max_data_length = 0;
+
+/* Completion of the command run_command waits for */
+static volatile uint16_t waiting_op_code = 0;
+static volatile uint8_t command_status = 0;
+static int8_t selected_tx_power = 0;
+
+static uint32_t hash_data(const uint8_t *data, uint16_t length) {
+  uint32_t hash = FNV_OFFSET_BASIS;
+  for (uint16_t i = 0; i < length; i++) {
+    hash = (hash ^ data[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+static HCIError map_status(uint8_t status) {
+  switch (status) {
+    case HCI_ERROR_SUCCESS:
+      return HCI_ERROR_SUCCESS;
+    case STATUS_UNKNOWN_COMMAND:
+      return HCI_ERROR_UNKNOWN_COMMAND;
+    case STATUS_MEMORY_CAPACITY_EXCEEDED:
+      return HCI_ERROR_MEMORY_ALLOCATION_FAILED;
+    case STATUS_COMMAND_DISALLOWED:
+      return HCI_ERROR_BUSY;
+    case STATUS_INVALID_PARAMETERS:
+      return HCI_ERROR_INVALID_PARAMETERS;
+    default:
+      return HCI_ERROR_INTERNAL_ERROR;
+  }
+}
+
+static HCIError run_command(uint16_t op_code, uint8_t *params, uint8_t length) {
+  HCICommand cmd = { .op_code.raw = op_code, .parameter_length = length, .parameters = params };
+
+  waiting_op_code = op_code;
+  command_status = HCI_ERROR_SUCCESS;
+  HCIError status = HCI_send_command(&cmd);
+  if (status != HCI_ERROR_SUCCESS) {
+    waiting_op_code = 0;
+    return status;
+  }
+
+  HCI_wait_response();
+  waiting_op_code = 0;
+  return map_status(command_status);
+}
+
+static ExtAdvSet *get_set(uint8_t handle) {
+  return (handle < EXT_ADV_MAX_SETS && sets[handle].used) ? &sets[handle] : NULL;
+}
+
+static HCIError send_parameters(uint8_t handle, const ExtAdvParameters *params) {
+  /* Convert milliseconds to 0.625 ms units. */
+  uint32_t interval_min = ((uint32_t)params->interval_min_ms * 16) / 10;
+  uint32_t interval_max = ((uint32_t)params->interval_max_ms * 16) / 10;
+
+  uint8_t cmd_params[25] = { 0 };
+  cmd_params[0] = handle;
+  cmd_params[1] = params->properties & 0xFF;
+  cmd_params[2] = (params->properties >> 8) & 0xFF;
+  cmd_params[3] = interval_min & 0xFF;
+  cmd_params[4] = (interval_min >> 8) & 0xFF;
+  cmd_params[5] = (interval_min >> 16) & 0xFF;
+  cmd_params[6] = interval_max & 0xFF;
+  cmd_params[7] = (interval_max >> 8) & 0xFF;
+  cmd_params[8] = (interval_max >> 16) & 0xFF;
+  cmd_params[9] = ADV_CHANNEL_37 | ADV_CHANNEL_38 | ADV_CHANNEL_39;
+  cmd_params[10] = ADV_OWN_ADDR_PUBLIC;
+  /* Peer address type and address at 11..17 only matter for directed advertising. */
+  cmd_params[18] = params->filter_policy;
+  cmd_params[19] = (uint8_t)params->tx_power;
+  cmd_params[20] = params->primary_phy;
+  cmd_params[21] = 0; /* Secondary_Advertising_Max_Skip */
+  cmd_params[22] = params->secondary_phy;
+  cmd_params[23] = params->sid;
+  cmd_params[24] = 0; /* Scan_Request_Notification_Enable */
+
+  HCIError status = run_command(CMD_BLE_SET_EXTENDED_ADVERTISING_PARAMETERS, cmd_params, sizeof(cmd_params));
+  if (status != HCI_ERROR_SUCCESS) {
+    return status;
+  }
+
+  ExtAdvSet *set = &sets[handle];
+  set->properties = params->properties;
+  set->duration_10ms = params->duration_10ms;
+  set->max_events = params->max_events;
+  set->selected_tx_power = selected_tx_power;
+  return HCI_ERROR_SUCCESS;
+}
+
+static HCIError send_data(uint16_t op_code, ExtAdvSet *set, uint8_t handle, const uint8_t *data, uint16_t length,
+                          uint32_t *sent_hash, uint16_t *sent_length, bool *sent_valid) {
+  uint16_t limit = (set->properties & EXT_ADV_PROP_LEGACY) ? EXT_ADV_LEGACY_DATA_LENGTH : controller_max_data_length;
+  if ((length > 0 && !data) || length > limit) {
+    return HCI_ERROR_INVALID_PARAMETERS;
+  }
+
+  uint32_t hash = hash_data(data, length);
+  if (*sent_valid && *sent_length == length && *sent_hash == hash) {
+    return HCI_ERROR_SUCCESS;
+  }
+
+  /* An enabled set only takes data that replaces all of it in one command. */
+  if (set->enabled && length > EXT_ADV_FRAGMENT_SIZE) {
+    return HCI_ERROR_BUSY;
+  }
+
+  uint8_t params[4 + EXT_ADV_FRAGMENT_SIZE];
+  uint16_t offset = 0;
+  *sent_valid = false;
+
+  do {
+    uint16_t fragment = length - offset;
+    if (fragment > EXT_ADV_FRAGMENT_SIZE) {
+      fragment = EXT_ADV_FRAGMENT_SIZE;
+    }
+
+    bool first = offset == 0;
+    bool last = offset + fragment == length;
+    params[0] = handle;
+    params[1] = (first && last) ? OP_COMPLETE_DATA
+                : first         ? OP_FIRST_FRAGMENT
+                : last          ? OP_LAST_FRAGMENT
+                                : OP_INTERMEDIATE_FRAGMENT;
+    params[2] = FRAGMENT_PREFERENCE_MINIMIZE;
+    params[3] = fragment;
+    if (fragment > 0) {
+      memcpy(&params[4], &data[offset], fragment);
+    }
+
+    HCIError status = run_command(op_code, params, 4 + fragment);
+    if (status != HCI_ERROR_SUCCESS) {
+      return status;
+    }
+    offset += fragment;
+  } while (offset < length);
+
+  *sent_hash = hash;
+  *sent_length = length;
+  *sent_valid = true;
+  return HCI_ERROR_SUCCESS;
+}
+
+HCIError EXT_ADV_init(void) {
+  memset(sets, 0, sizeof(sets));
+  controller_sets = 0;
+  controller_max_data_length = 0;
+
+  if (!HCI_CAPS_le_feature_supported(HCI_LE_FEATURE_EXTENDED_ADVERTISING)) {
+    return HCI_ERROR_UNKNOWN_COMMAND;
+  }
+
+  HCIError status = run_command(CMD_BLE_READ_NUMBER_OF_SUPPORTED_ADVERTISING_SETS, NULL, 0);
+  if (status == HCI_ERROR_SUCCESS) {
+    status = run_command(CMD_BLE_READ_MAXIMUM_ADVERTISING_DATA_LENGTH, NULL, 0);
+  }
+  if (status == HCI_ERROR_SUCCESS) {
+    status = run_command(CMD_BLE_CLEAR_ADVERTISING_SETS, NULL, 0);
+  }
+  if (status != HCI_ERROR_SUCCESS) {
+    controller_sets = 0;
+  }
+  return status;
+}
+
+uint8_t EXT_ADV_max_sets(void) {
+  return (controller_sets < EXT_ADV_MAX_SETS) ? controller_sets : EXT_ADV_MAX_SETS;
+}
+
+uint16_t EXT_ADV_max_data_length(void) {
+  return controller_max_data_length;
+}
+
+HCIError EXT_ADV_create_set(const ExtAdvParameters *params, uint8_t *handle) {
+  if (!params || !handle) {
+    return HCI_ERROR_INVALID_PARAMETERS;
+  }
+  *handle = EXT_ADV_INVALID_HANDLE;
+
+  /* The handle is the slot index, the controller accepts any value below its set count. */
+  for (uint8_t i = 0; i < EXT_ADV_max_sets(); i++) {
+    if (!sets[i].used) {
+      HCIError status = send_parameters(i, params);
+      if (status != HCI_ERROR_SUCCESS) {
+        return status;
+      }
+      sets[i].used = true;
+      *handle = i;
+      return HCI_ERROR_SUCCESS;
+    }
+  }
+  return HCI_ERROR_MEMORY_ALLOCATION_FAILED;
+}
+
+HCIError EXT_ADV_set_parameters(uint8_t handle, const ExtAdvParameters *params) {
+  ExtAdvSet *set = get_set(handle);
+  if (!set || !params) {
+    return HCI_ERROR_INVALID_PARAMETERS;
+  }
+  if (set->enabled) {
+    return HCI_ERROR_BUSY;
+  }
+  return send_parameters(handle, params);
+}
+
+HCIError EXT_ADV_set_data(uint8_t handle, const uint8_t *data, uint16_t length) {
+  ExtAdvSet *set = get_set(handle);
+  if (!set) {
+    return HCI_ERROR_INVALID_PARAMETERS;
+  }
+  return send_data(CMD_BLE_SET_EXTENDED_ADVERTISING_DATA, set, handle, data, length, &set->data_hash,
+                   &set->data_length, &set->data_valid);
+}
+
+HCIError EXT_ADV_set_scan_response(uint8_t handle, const uint8_t *data, uint16_t length) {
+  ExtAdvSet *set = get_set(handle);
+  if (!set || !(set->properties & EXT_ADV_PROP_SCANNABLE)) {
+    return HCI_ERROR_INVALID_PARAMETERS;
+  }
+  return send_data(CMD_BLE_SET_EXTENDED_SCAN_RESPONSE_DATA, set, handle, data, length, &set->scan_rsp_hash,
+                   &set->scan_rsp_length, &set->scan_rsp_valid);
+}
+
+HCIError EXT_ADV_enable(const uint8_t *handles, uint8_t count, bool enable) {
+  if (count > EXT_ADV_MAX_SETS || (count > 0 && !handles) || (count == 0 && enable)) {
+    return HCI_ERROR_INVALID_PARAMETERS;
+  }
+
+  uint8_t params[2 + 4 * EXT_ADV_MAX_SETS];
+  params[0] = enable ? 0x01 : 0x00;
+  params[1] = count;
+  for (uint8_t i = 0; i < count; i++) {
+    ExtAdvSet *set = get_set(handles[i]);
+    if (!set) {
+      return HCI_ERROR_INVALID_PARAMETERS;
+    }
+    params[2 + 4 * i] = handles[i];
+    params[3 + 4 * i] = set->duration_10ms & 0xFF;
+    params[4 + 4 * i] = (set->duration_10ms >> 8) & 0xFF;
+    params[5 + 4 * i] = set->max_events;
+  }
+
+  HCIError status = run_command(CMD_BLE_SET_EXTENDED_ADVERTISING_ENABLE, params, 2 + 4 * count);
+  if (status != HCI_ERROR_SUCCESS) {
+    return status;
+  }
+
+  if (count == 0) {
+    for (uint8_t i = 0; i < EXT_ADV_MAX_SETS; i++) {
+      sets[i].enabled = false;
+    }
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    sets[handles[i]].enabled = enable;
+  }
+  return HCI_ERROR_SUCCESS;
+}
+
+HCIError EXT_ADV_remove_set(uint8_t handle) {
+  ExtAdvSet *set = get_set(handle);
+  if (!set) {
+    return HCI_ERROR_INVALID_PARAMETERS;
+  }
+  if (set->enabled) {
+    return HCI_ERROR_BUSY;
+  }
+
+  uint8_t params[1] = { handle };
+  HCIError status = run_command(CMD_BLE_REMOVE_ADVERTISING_SET, params, sizeof(params));
+  if (status != HCI_ERROR_SUCCESS) {
+    return status;
+  }
+
+  memset(set, 0, sizeof(ExtAdvSet));
+  return HCI_ERROR_SUCCESS;
+}
+
+const ExtAdvSet *EXT_ADV_get_set(uint8_t handle) {
+  return get_set(handle);
+}
+
+bool EXT_ADV_handle_command_complete(uint16_t op_code, uint8_t status, uint8_t *return_parameters, uint8_t length) {
+  if (waiting_op_code == 0 || op_code != waiting_op_code) {
+    return false;
+  }
+
+  command_status = status;
+  if (status != HCI_ERROR_SUCCESS) {
+    return true;
+  }
+
+  switch (op_code) {
+    case CMD_BLE_READ_NUMBER_OF_SUPPORTED_ADVERTISING_SETS:
+      if (length >= 1) {
+        controller_sets = return_parameters[0];
+      }
+      break;
+    case CMD_BLE_READ_MAXIMUM_ADVERTISING_DATA_LENGTH:
+      if (length >= 2) {
+        controller_max_data_length = return_parameters[0] | (return_parameters[1] << 8);
+      }
+      break;
+    case CMD_BLE_SET_EXTENDED_ADVERTISING_PARAMETERS:
+      if (length >= 1) {
+        selected_tx_power = (int8_t)return_parameters[0];
+      }
+      break;
+    default:
+      break;
+  }
+  return true;
+}
+
+void EXT_ADV_handle_set_terminated(uint8_t status, uint8_t handle) {
+  ExtAdvSet *set = get_set(handle);
+  if (!set) {
+    return;
+  }
+
+  set->enabled = false;
+  if (status != HCI_ERROR_SUCCESS) {
+    log_bl_debug("Advertising set %d stopped: 0x%x\r\n", handle, status);
+  }
+}
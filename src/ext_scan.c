@@ -0,0 +1,124 @@
+#include "ext_scan.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "gap.h"
+#include "hardware_bl.h"
+#include "hci_defs.h"
+
+/* Time after which a chain without its next fragment is given up. AUX_CHAIN_IND packets follow each
+ * other within milliseconds. */
+#define FRAGMENT_TIMEOUT_MS 500
+
+static ExtScanBuffer buffers[EXT_SCAN_BUFFERS];
+static ExtScanStats stats;
+
+static uint8_t report_type(uint16_t event_type) {
+  if (!(event_type & EXT_SCAN_EVENT_LEGACY)) {
+    return (event_type & EXT_SCAN_EVENT_SCAN_RSP) ? SCAN_REPORT_EXT_SCAN_RSP : SCAN_REPORT_EXT_ADV;
+  }
+
+  if (event_type & EXT_SCAN_EVENT_SCAN_RSP) {
+    return SCAN_REPORT_SCAN_RSP;
+  }
+  if (event_type & EXT_SCAN_EVENT_DIRECTED) {
+    return SCAN_REPORT_ADV_DIRECT_IND;
+  }
+  if (event_type & EXT_SCAN_EVENT_CONNECTABLE) {
+    return SCAN_REPORT_ADV_IND;
+  }
+  return (event_type & EXT_SCAN_EVENT_SCANNABLE) ? SCAN_REPORT_ADV_SCAN_IND : SCAN_REPORT_ADV_NONCONN_IND;
+}
+
+static ExtScanBuffer *find_buffer(uint8_t addr_type, const uint8_t *addr, uint8_t sid, bool scan_rsp) {
+  for (uint8_t i = 0; i < EXT_SCAN_BUFFERS; i++) {
+    ExtScanBuffer *buffer = &buffers[i];
+    if (buffer->used && buffer->addr_type == addr_type && buffer->sid == sid && buffer->scan_rsp == scan_rsp &&
+        memcmp(buffer->addr, addr, 6) == 0) {
+      return buffer;
+    }
+  }
+  return NULL;
+}
+
+static ExtScanBuffer *claim_buffer(uint64_t now_ms) {
+  ExtScanBuffer *oldest = NULL;
+
+  for (uint8_t i = 0; i < EXT_SCAN_BUFFERS; i++) {
+    ExtScanBuffer *buffer = &buffers[i];
+    if (buffer->used && now_ms - buffer->updated_ms > FRAGMENT_TIMEOUT_MS) {
+      buffer->used = false;
+      stats.evicted++;
+    }
+    if (!buffer->used) {
+      return buffer;
+    }
+    if (!oldest || buffer->updated_ms < oldest->updated_ms) {
+      oldest = buffer;
+    }
+  }
+
+  /* Every buffer is busy, the chain that has waited longest is the least likely to complete. */
+  stats.evicted++;
+  return oldest;
+}
+
+void EXT_SCAN_reset(void) {
+  for (uint8_t i = 0; i < EXT_SCAN_BUFFERS; i++) {
+    buffers[i].used = false;
+  }
+}
+
+void EXT_SCAN_handle_report(uint16_t event_type, uint8_t addr_type, uint8_t *addr, uint8_t sid, uint8_t *data,
+                            uint8_t data_len, int8_t rssi) {
+  uint8_t data_status = (event_type & EXT_SCAN_EVENT_DATA_STATUS_MASK) >> EXT_SCAN_EVENT_DATA_STATUS_SHIFT;
+  bool scan_rsp = (event_type & EXT_SCAN_EVENT_SCAN_RSP) != 0;
+  ExtScanBuffer *buffer = find_buffer(addr_type, addr, sid, scan_rsp);
+
+  /* Common case: the data fits one report, pass it on without copying. */
+  if (!buffer && data_status == EXT_SCAN_DATA_COMPLETE) {
+    GAP_handle_advertising_report(report_type(event_type), addr_type, addr, data, data_len, rssi);
+    return;
+  }
+
+  if (data_status == EXT_SCAN_DATA_TRUNCATED) {
+    if (buffer) {
+      buffer->used = false;
+    }
+    stats.truncated++;
+    return;
+  }
+
+  uint64_t now_ms = hw_get_time_ms();
+  if (!buffer) {
+    buffer = claim_buffer(now_ms);
+    buffer->used = true;
+    buffer->scan_rsp = scan_rsp;
+    buffer->addr_type = addr_type;
+    memcpy(buffer->addr, addr, 6);
+    buffer->sid = sid;
+    buffer->length = 0;
+  }
+
+  if (buffer->length + data_len > EXT_SCAN_MAX_DATA_LENGTH) {
+    buffer->used = false;
+    stats.overflowed++;
+    return;
+  }
+
+  memcpy(&buffer->data[buffer->length], data, data_len);
+  buffer->length += data_len;
+  buffer->updated_ms = now_ms;
+
+  if (data_status == EXT_SCAN_DATA_COMPLETE) {
+    buffer->used = false;
+    stats.reassembled++;
+    GAP_handle_advertising_report(report_type(event_type), addr_type, buffer->addr, buffer->data, buffer->length,
+                                  rssi);
+  }
+}
+
+void EXT_SCAN_get_stats(ExtScanStats *out) {
+  *out = stats;
+}
@@ -1,26 +1,145 @@
 #include "gap.h"
 
+#include "accept_list.h"
+#include "adv_data.h"
+#include "auto_connect.h"
+#include "connection.h"
+#include "ext_scan.h"
 #include "hci.h"
 #include "hci_defs.h"
+#include "link_setup.h"
 #include "mem_utils.h"
 
-static GAPConnection connections[MAX_CONNECTIONS];
+/* Core specification limits for connection parameters */
+#define CONN_INTERVAL_MIN 0x0006
+#define CONN_INTERVAL_MAX 0x0C80
+#define CONN_LATENCY_MAX 0x01F3
+#define CONN_SUPERVISION_TIMEOUT_MIN 0x000A
+#define CONN_SUPERVISION_TIMEOUT_MAX 0x0C80
+
 static GAPEventCallback gap_event_callback = NULL;
-static uint8_t connection_count = 0;
+static GAPConnectionParameterCallback gap_conn_param_callback = NULL;
+static const AdvFilter *gap_scan_filter = NULL;
+static uint8_t gap_scan_result_events = SCAN_CACHE_NEW_DEVICE | SCAN_CACHE_PAYLOAD_CHANGED;
+static uint8_t gap_accept_list_uses = 0;
+static uint8_t gap_scan_phys = 0;
+
+/* Settings the running advertiser and scanner were started with. Starting again with the same
+ * settings sends nothing, other settings need a stop first since the controller rejects parameter
+ * changes while the role runs. */
+static struct {
+  uint16_t interval_ms;
+  bool connectable;
+  uint8_t filter_policy;
+} gap_adv_running;
+
+static struct {
+  uint16_t interval_ms;
+  uint16_t window_ms;
+  uint8_t filter_policy;
+  uint8_t phys;
+} gap_scan_running;
+
+/* Advertising data and scan response last sent to the controller, in HCI parameter layout. Setting the
+ * same bytes again sends nothing. */
+static uint8_t gap_adv_data_sent[AD_MAX_DATA_LENGTH + 1];
+static uint8_t gap_scan_rsp_sent[AD_MAX_DATA_LENGTH + 1];
+static bool gap_adv_data_valid = false;
+static bool gap_scan_rsp_valid = false;
+
+/* Name and appearance the GAP owned payload is built from. Explicitly set advertising data takes the
+ * payload over until the next GAP_set_device_name. */
+static char gap_device_name[AD_MAX_DATA_LENGTH - 2];
+static uint8_t gap_device_name_len = 0;
+static bool gap_device_name_written = false;
+static uint16_t gap_appearance = 0;
+static bool gap_payload_owned = false;
+
+static bool advertiser_active(void) {
+  HCIRoles roles;
+  HCI_get_roles(&roles);
+  return roles.advertiser == HCI_ROLE_ON || roles.advertiser == HCI_ROLE_STARTING;
+}
 
-GAPError GAP_init(GAPEventCallback event_callback, uint8_t *bt_addr) {
-  if (bt_addr == NULL) {
+static bool scanner_active(void) {
+  HCIRoles roles;
+  HCI_get_roles(&roles);
+  return roles.scanner == HCI_ROLE_ON || roles.scanner == HCI_ROLE_STARTING;
+}
+
+static GAPError write_legacy_data(uint16_t op_code, uint8_t *sent, bool *valid, const uint8_t *data,
+                                  uint8_t length) {
+  /* The command always carries all 31 data bytes, unused ones zeroed. */
+  uint8_t params[AD_MAX_DATA_LENGTH + 1] = { 0 };
+  params[0] = length;
+  memcpy(&params[1], data, length);
+
+  if (*valid && memcmp(params, sent, sizeof(params)) == 0) {
+    return GAP_ERROR_SUCCESS;
+  }
+
+  HCICommand cmd = { .op_code.raw = op_code, .parameter_length = sizeof(params), .parameters = params };
+
+  *valid = false;
+  HCIError status = HCI_send_command(&cmd);
+  if (status != HCI_ERROR_SUCCESS) {
+    return GAP_ERROR_HCI_ERROR;
+  }
+
+  HCI_wait_response();
+
+  memcpy(sent, params, sizeof(params));
+  *valid = true;
+  return GAP_ERROR_SUCCESS;
+}
+
+static GAPError write_payload(const ADBuilder *builder) {
+  ADPayload payload;
+  if (!AD_builder_encode(builder, &payload)) {
     return GAP_ERROR_INVALID_PARAMETERS;
   }
 
-  for (int i = 0; i < MAX_CONNECTIONS; i++) {
-    connections[i].connected = false;
-    connections[i].services_discovered = false;
-    connections[i].connection_handle = 0;
+  GAPError status = write_legacy_data(CMD_BLE_SET_ADVERTISING_DATA, gap_adv_data_sent, &gap_adv_data_valid,
+                                      payload.adv_data, payload.adv_data_length);
+  if (status != GAP_ERROR_SUCCESS) {
+    return status;
+  }
+  return write_legacy_data(CMD_BLE_SET_SCAN_RESPONSE_DATA, gap_scan_rsp_sent, &gap_scan_rsp_valid,
+                           payload.scan_rsp_data, payload.scan_rsp_data_length);
+}
+
+static GAPError write_owned_payload(void) {
+  ADBuilder builder;
+  AD_builder_init(&builder);
+  AD_builder_add_flags(&builder, AD_FLAG_LE_GENERAL_DISCOVERABLE | AD_FLAG_BR_EDR_NOT_SUPPORTED);
+  if (gap_appearance != 0) {
+    uint8_t appearance[2] = { gap_appearance & 0xFF, (gap_appearance >> 8) & 0xFF };
+    AD_builder_add(&builder, AD_TYPE_APPEARANCE, appearance, sizeof(appearance));
+  }
+  AD_builder_add_name(&builder, gap_device_name, gap_device_name_len);
+
+  return write_payload(&builder);
+}
+
+static GAPError sync_accept_list(void) {
+  HCIError status = ACCEPT_LIST_sync();
+  if (status == HCI_ERROR_BUSY) {
+    return GAP_ERROR_BUSY;
+  }
+  return (status == HCI_ERROR_SUCCESS) ? GAP_ERROR_SUCCESS : GAP_ERROR_HCI_ERROR;
+}
+
+GAPError GAP_init(GAPEventCallback event_callback, uint8_t *bt_addr) {
+  if (bt_addr == NULL) {
+    return GAP_ERROR_INVALID_PARAMETERS;
   }
 
   gap_event_callback = event_callback;
-  connection_count = 0U;
+
+  /* The controller was reset by HCI_init, nothing sent before is still set. */
+  gap_adv_data_valid = false;
+  gap_scan_rsp_valid = false;
+  gap_device_name_written = false;
 
   HCIError status = HCI_set_bt_addr(bt_addr);
 
@@ -35,19 +154,23 @@ GAPError GAP_deinit(void) {
   GAP_stop_advertising();
   GAP_stop_scanning();
 
-  for (int i = 0; i < MAX_CONNECTIONS; i++) {
-    if (connections[i].connected) {
-      GAP_disconnect(connections[i].connection_handle);
+  for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+    ConnectionContext *context = CONN_get_slot(i);
+    if (context && context->state == CONN_STATE_CONNECTED) {
+      GAP_disconnect(context->connection_handle);
     }
   }
 
   gap_event_callback = NULL;
-  connection_count = 0;
 
   return GAP_ERROR_SUCCESS;
 }
 
 GAPError GAP_set_device_name(const char *name) {
+  if (name == NULL) {
+    return GAP_ERROR_INVALID_PARAMETERS;
+  }
+
   static uint8_t params[248] = { 0 };
 
   size_t name_len = 0;
@@ -55,49 +178,61 @@ GAPError GAP_set_device_name(const char *name) {
     name_len++;
   }
 
-  memcpy(params, name, name_len);
-  memset(params + name_len, 0U, 248 - name_len);
-
-  HCICommand cmd = { .op_code.raw = CMD_BT_WRITE_LOCAL_NAME, .parameter_length = sizeof(params), .parameters = params };
-
-  HCIError hci_status = HCI_send_command(&cmd);
-  if (hci_status != HCI_ERROR_SUCCESS) {
-    return GAP_ERROR_HCI_ERROR;
-  }
-
-  HCI_wait_response();
-
-  /* Update the advertising data as well */
-
-  static uint8_t adv_data[31] = { 0 };
-  uint8_t adv_idx = 0;
+  /* The local name is 248 bytes on the wire, only send it when it actually changes. */
+  if (!gap_device_name_written || memcmp(params, name, name_len) != 0 ||
+      (name_len < sizeof(params) && params[name_len] != 0)) {
+    memcpy(params, name, name_len);
+    memset(params + name_len, 0U, 248 - name_len);
 
-  /* Add flags */
-  adv_data[adv_idx++] = 2;    /* Length of flags field */
-  adv_data[adv_idx++] = 0x01; /* Flags type */
-  adv_data[adv_idx++] = 0x06; /* Flags value (LE General Discoverable + BR/EDR Not Supported) */
+    HCICommand cmd = { .op_code.raw = CMD_BT_WRITE_LOCAL_NAME, .parameter_length = sizeof(params), .parameters = params };
 
-  /* Add name (truncate if too long) */
-  uint8_t available_space = 31 - adv_idx - 2;
-  uint8_t actual_name_len = (name_len > available_space) ? available_space : name_len;
-
-  adv_data[adv_idx++] = actual_name_len + 1;
-  adv_data[adv_idx++] = 0x09;
+    gap_device_name_written = false;
+    HCIError hci_status = HCI_send_command(&cmd);
+    if (hci_status != HCI_ERROR_SUCCESS) {
+      return GAP_ERROR_HCI_ERROR;
+    }
 
-  memcpy(&adv_data[adv_idx], name, actual_name_len);
-  adv_idx += actual_name_len;
+    HCI_wait_response();
+    gap_device_name_written = true;
+  }
 
-  GAPError gap_status = GAP_set_advertising_data(adv_data, adv_idx);
+  /* Update the advertising data as well, a name that does not fit moves to the scan response */
+  gap_device_name_len = (name_len > sizeof(gap_device_name)) ? sizeof(gap_device_name) : name_len;
+  memcpy(gap_device_name, name, gap_device_name_len);
+  gap_payload_owned = true;
 
-  if (gap_status != GAP_ERROR_SUCCESS) {
-    return gap_status;
-  }
-  return GAP_ERROR_SUCCESS;
+  return write_owned_payload();
 }
 
 GAPError GAP_start_advertising(uint16_t interval_ms, bool connectable) {
   uint8_t zero_addr[6] = { 0 };
 
+  /* The two list bits line up with the scan request and connect bits of Adv_FilterPolicy. */
+  uint8_t filter_policy = 0;
+  if (gap_accept_list_uses & GAP_ACCEPT_LIST_ADV_SCAN_REQUEST) {
+    filter_policy |= ADV_FILTER_POLICY_ALLOW_SCAN;
+  }
+  if (gap_accept_list_uses & GAP_ACCEPT_LIST_ADV_CONNECT) {
+    filter_policy |= ADV_FILTER_POLICY_ALLOW_CONN;
+  }
+  if (advertiser_active()) {
+    if (gap_adv_running.interval_ms == interval_ms && gap_adv_running.connectable == connectable &&
+        gap_adv_running.filter_policy == filter_policy) {
+      return GAP_ERROR_SUCCESS;
+    }
+    GAPError gap_status = GAP_stop_advertising();
+    if (gap_status != GAP_ERROR_SUCCESS) {
+      return gap_status;
+    }
+  }
+
+  if (filter_policy != ADV_FILTER_POLICY_ALLOW_ALL) {
+    GAPError gap_status = sync_accept_list();
+    if (gap_status != GAP_ERROR_SUCCESS) {
+      return gap_status;
+    }
+  }
+
   HCIError status =
       HCI_BLE_set_advertising_param(interval_ms,                                                      /* min interval */
                                     interval_ms,                                                      /* max interval */
@@ -106,61 +241,56 @@ GAPError GAP_start_advertising(uint16_t interval_ms, bool connectable) {
                                     ADV_DIR_ADDR_PUBLIC,                              /* direct address type */
                                     zero_addr,                                        /* direct address */
                                     ADV_CHANNEL_37 | ADV_CHANNEL_38 | ADV_CHANNEL_39, /* channel map */
-                                    ADV_FILTER_POLICY_ALLOW_ALL                       /* filter policy */
+                                    filter_policy                                     /* filter policy */
       );
 
   if (status != HCI_ERROR_SUCCESS) {
     return GAP_ERROR_HCI_ERROR;
   }
 
-  uint8_t enable_val = 1U;
-  HCICommand adv_enable_cmd = { .op_code.raw = CMD_BLE_SET_ADVERTISE_ENABLE,
-                                .parameter_length = 1,
-                                .parameters = (uint8_t *){ &enable_val } };
-
-  status = HCI_send_command(&adv_enable_cmd);
-
-  if (status != HCI_ERROR_SUCCESS) {
+  status = HCI_BLE_set_advertise_enable(true);
+  if (status != HCI_ERROR_SUCCESS || !advertiser_active()) {
     return GAP_ERROR_HCI_ERROR;
   }
 
-  HCI_wait_response();
+  gap_adv_running.interval_ms = interval_ms;
+  gap_adv_running.connectable = connectable;
+  gap_adv_running.filter_policy = filter_policy;
   return GAP_ERROR_SUCCESS;
 }
 
 GAPError GAP_set_advertising_data(uint8_t *adv_data, uint8_t adv_data_len) {
-  if (adv_data == NULL || adv_data_len > 32) {
+  if (adv_data == NULL || adv_data_len > AD_MAX_DATA_LENGTH) {
     return GAP_ERROR_INVALID_PARAMETERS;
   }
 
-  /* Data goes out of scope when function returns unless declared as a static variable. */
-  static uint8_t data[32] = { 0 };
-  data[0] = adv_data_len;
-  memcpy(&data[1], adv_data, adv_data_len);
+  gap_payload_owned = false;
+  return write_legacy_data(CMD_BLE_SET_ADVERTISING_DATA, gap_adv_data_sent, &gap_adv_data_valid, adv_data,
+                           adv_data_len);
+}
 
-  HCICommand cmd = { .op_code.raw = CMD_BLE_SET_ADVERTISING_DATA, .parameter_length = sizeof(data), .parameters = data };
+void GAP_invalidate_advertising_data(void) {
+  gap_adv_data_valid = false;
+}
 
-  HCIError status = HCI_send_command(&cmd);
-  if (status != HCI_ERROR_SUCCESS) {
-    return GAP_ERROR_HCI_ERROR;
+GAPError GAP_set_advertising_payload(const ADBuilder *builder) {
+  if (builder == NULL) {
+    return GAP_ERROR_INVALID_PARAMETERS;
   }
 
-  HCI_wait_response();
-  return GAP_ERROR_SUCCESS;
+  gap_payload_owned = false;
+  return write_payload(builder);
 }
 
 GAPError GAP_stop_advertising(void) {
-  uint8_t disable_val = 0U;
-  HCICommand adv_disable_cmd = { .op_code.raw = CMD_BLE_SET_ADVERTISE_ENABLE,
-                                 .parameter_length = 1,
-                                 .parameters = (uint8_t *){ &disable_val } };
+  if (!advertiser_active()) {
+    return GAP_ERROR_SUCCESS;
+  }
 
-  HCIError status = HCI_send_command(&adv_disable_cmd);
-  if (status != HCI_ERROR_SUCCESS) {
+  HCIError status = HCI_BLE_set_advertise_enable(false);
+  if (status != HCI_ERROR_SUCCESS || advertiser_active()) {
     return GAP_ERROR_HCI_ERROR;
   }
-
-  HCI_wait_response();
   return GAP_ERROR_SUCCESS;
 }
 
@@ -170,6 +300,15 @@ GAPError GAP_set_advertising_parameters(uint8_t type, uint16_t min_interval_ms,
     return GAP_ERROR_INVALID_PARAMETERS;
   }
 
+  /* Parameters only change while the advertiser is stopped, resume it afterwards. */
+  bool resume = advertiser_active();
+  if (resume) {
+    GAPError gap_status = GAP_stop_advertising();
+    if (gap_status != GAP_ERROR_SUCCESS) {
+      return gap_status;
+    }
+  }
+
   uint8_t zero_addr[6] = { 0 };
 
   HCIError status = HCI_BLE_set_advertising_param(min_interval_ms,     /* min interval */
@@ -182,6 +321,13 @@ GAPError GAP_set_advertising_parameters(uint8_t type, uint16_t min_interval_ms,
                                                   filter_policy        /* filter policy */
   );
 
+  /* The settings GAP_start_advertising compares against no longer describe the advertiser. */
+  gap_adv_running.interval_ms = 0;
+
+  if (resume && HCI_BLE_set_advertise_enable(true) != HCI_ERROR_SUCCESS) {
+    return GAP_ERROR_HCI_ERROR;
+  }
+
   if (status != HCI_ERROR_SUCCESS) {
     return GAP_ERROR_HCI_ERROR;
   }
@@ -194,52 +340,99 @@ GAPError GAP_start_scanning(uint16_t interval_ms, uint16_t window_ms) {
     return GAP_ERROR_INVALID_PARAMETERS;
   }
 
-  HCIError status = HCI_BLE_set_scan_parameters(SCAN_ACTIVE,             /* scan type */
-                                                interval_ms,             /* scan interval */
-                                                window_ms,               /* scan window */
-                                                SCAN_PUBLIC_DEVICE_ADDR, /* own address type */
-                                                SCAN_ACCEPT_ALL          /* filter policy */
-  );
+  Scan_FilterPolicy filter_policy = (gap_accept_list_uses & GAP_ACCEPT_LIST_SCAN) ? SCAN_WHITELIST_ONLY : SCAN_ACCEPT_ALL;
+
+  if (scanner_active()) {
+    if (gap_scan_running.interval_ms == interval_ms && gap_scan_running.window_ms == window_ms &&
+        gap_scan_running.filter_policy == filter_policy && gap_scan_running.phys == gap_scan_phys) {
+      return GAP_ERROR_SUCCESS;
+    }
+    GAPError gap_status = GAP_stop_scanning();
+    if (gap_status != GAP_ERROR_SUCCESS) {
+      return gap_status;
+    }
+  }
+
+  if (filter_policy == SCAN_WHITELIST_ONLY) {
+    GAPError gap_status = sync_accept_list();
+    if (gap_status != GAP_ERROR_SUCCESS) {
+      return gap_status;
+    }
+  }
+
+  HCIError status;
+  if (gap_scan_phys != 0) {
+    status = HCI_BLE_set_extended_scan_parameters(SCAN_ACTIVE, interval_ms, window_ms, SCAN_PUBLIC_DEVICE_ADDR,
+                                                  filter_policy, gap_scan_phys);
+  } else {
+    status = HCI_BLE_set_scan_parameters(SCAN_ACTIVE,             /* scan type */
+                                         interval_ms,             /* scan interval */
+                                         window_ms,               /* scan window */
+                                         SCAN_PUBLIC_DEVICE_ADDR, /* own address type */
+                                         filter_policy            /* filter policy */
+    );
+  }
 
   if (status != HCI_ERROR_SUCCESS) {
     return GAP_ERROR_HCI_ERROR;
   }
 
-  status = HCI_BLE_set_scan_enable(true, true);
-  if (status != HCI_ERROR_SUCCESS) {
+  /* Duplicates are filtered by the scan cache, the controller's filter would also hide RSSI changes. */
+  SCAN_CACHE_clear();
+  EXT_SCAN_reset();
+  if (gap_scan_phys != 0) {
+    status = HCI_BLE_set_extended_scan_enable(true, false);
+  } else {
+    status = HCI_BLE_set_scan_enable(true, false);
+  }
+  if (status != HCI_ERROR_SUCCESS || !scanner_active()) {
     return GAP_ERROR_HCI_ERROR;
   }
 
+  gap_scan_running.interval_ms = interval_ms;
+  gap_scan_running.window_ms = window_ms;
+  gap_scan_running.filter_policy = filter_policy;
+  gap_scan_running.phys = gap_scan_phys;
   return GAP_ERROR_SUCCESS;
 }
 
 GAPError GAP_stop_scanning(void) {
-  HCIError status = HCI_BLE_set_scan_enable(false, false);
-  if (status != HCI_ERROR_SUCCESS) {
+  if (!scanner_active()) {
+    return GAP_ERROR_SUCCESS;
+  }
+
+  HCIError status = (gap_scan_running.phys != 0) ? HCI_BLE_set_extended_scan_enable(false, false)
+                                                  : HCI_BLE_set_scan_enable(false, false);
+  if (status != HCI_ERROR_SUCCESS || scanner_active()) {
     return GAP_ERROR_HCI_ERROR;
   }
   return GAP_ERROR_SUCCESS;
 }
 
 GAPError GAP_set_scan_response_data(uint8_t *scan_data, uint8_t scan_data_len) {
-  if (scan_data == NULL || scan_data_len > 31) {
+  if (scan_data == NULL || scan_data_len > AD_MAX_DATA_LENGTH) {
     return GAP_ERROR_INVALID_PARAMETERS;
   }
 
-  static uint8_t data[32] = { 0 };
-  data[0] = scan_data_len;
+  gap_payload_owned = false;
+  return write_legacy_data(CMD_BLE_SET_SCAN_RESPONSE_DATA, gap_scan_rsp_sent, &gap_scan_rsp_valid, scan_data,
+                           scan_data_len);
+}
 
-  memcpy(&data[1], scan_data, scan_data_len);
+void GAP_set_extended_scanning(uint8_t phys) {
+  gap_scan_phys = phys & (PHY_PREFER_LE_1M | PHY_PREFER_LE_CODED);
+}
 
-  HCICommand cmd = { .op_code.raw = CMD_BLE_SET_SCAN_RESPONSE_DATA, .parameter_length = sizeof(data), .parameters = data };
+void GAP_set_accept_list_policy(uint8_t uses) {
+  gap_accept_list_uses = uses;
+}
 
-  HCIError status = HCI_send_command(&cmd);
-  if (status != HCI_ERROR_SUCCESS) {
-    return GAP_ERROR_HCI_ERROR;
-  }
+void GAP_set_scan_result_events(uint8_t changes) {
+  gap_scan_result_events = changes;
+}
 
-  HCI_wait_response();
-  return GAP_ERROR_SUCCESS;
+void GAP_set_scan_filter(const AdvFilter *filter) {
+  gap_scan_filter = filter;
 }
 
 GAPError GAP_set_scan_parameters(bool active, bool filter_duplicates, uint8_t filter_policy) {
@@ -261,6 +454,19 @@ GAPError GAP_set_scan_parameters(bool active, bool filter_duplicates, uint8_t fi
 }
 
 GAPError GAP_connect(uint8_t *peer_addr, uint16_t scan_interval_ms, uint16_t scan_window_ms) {
+  if (peer_addr == NULL) {
+    return GAP_ERROR_INVALID_PARAMETERS;
+  }
+
+  if (CONN_count() >= MAX_CONNECTIONS) {
+    return GAP_ERROR_NO_RESOURCES;
+  }
+
+  /* The controller runs one initiator, take it from background reconnection. */
+  if (AUTO_CONN_yield() != HCI_ERROR_SUCCESS) {
+    return GAP_ERROR_BUSY;
+  }
+
   HCIError status = HCI_BLE_create_connection(scan_interval_ms,                    /* scan interval */
                                               scan_window_ms,                      /* scan window */
                                               CONN_INITIATOR_FILTER_LIST_NOT_USED, /* filter policy */
@@ -274,28 +480,68 @@ GAPError GAP_connect(uint8_t *peer_addr, uint16_t scan_interval_ms, uint16_t sca
   );
 
   if (status != HCI_ERROR_SUCCESS) {
+    AUTO_CONN_unyield();
     return GAP_ERROR_HCI_ERROR;
   }
 
   return GAP_ERROR_SUCCESS;
 }
 
-GAPError GAP_disconnect(uint16_t connection_handle) {
-  int conn_idx = -1;
+GAPError GAP_connect_accept_list(uint16_t scan_interval_ms, uint16_t scan_window_ms) {
+  if (CONN_count() >= MAX_CONNECTIONS) {
+    return GAP_ERROR_NO_RESOURCES;
+  }
 
-  for (int i = 0; i < MAX_CONNECTIONS; i++) {
-    if (connections[i].connected && connections[i].connection_handle == connection_handle) {
-      conn_idx = i;
-      break;
-    }
+  if (ACCEPT_LIST_count() == 0) {
+    return GAP_ERROR_INVALID_PARAMETERS;
+  }
+
+  if (AUTO_CONN_yield() != HCI_ERROR_SUCCESS) {
+    return GAP_ERROR_BUSY;
+  }
+
+  GAPError gap_status = sync_accept_list();
+  if (gap_status != GAP_ERROR_SUCCESS) {
+    AUTO_CONN_unyield();
+    return gap_status;
+  }
+
+  /* The peer address is ignored when the controller picks the peer from the accept list. */
+  uint8_t zero_addr[6] = { 0 };
+  HCIError status = HCI_BLE_create_connection(scan_interval_ms,                 /* scan interval */
+                                              scan_window_ms,                   /* scan window */
+                                              CONN_INITIATOR_FILTER_LIST_USED,  /* filter policy */
+                                              CONN_PEER_PUBLIC_DEVICE_ADDRESS,  /* peer address type */
+                                              zero_addr,                        /* peer address */
+                                              CONN_OWN_PUBLIC_DEVICE_ADDRESS,   /* own address type */
+                                              50,                               /* min connection interval (ms) */
+                                              100,                              /* max connection interval (ms) */
+                                              0,                                /* connection latency */
+                                              2000                              /* supervision timeout (ms) */
+  );
+
+  if (status != HCI_ERROR_SUCCESS) {
+    AUTO_CONN_unyield();
+    return GAP_ERROR_HCI_ERROR;
   }
 
-  if (conn_idx == -1) {
+  return GAP_ERROR_SUCCESS;
+}
+
+GAPError GAP_disconnect(uint16_t connection_handle) {
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (!context) {
     return GAP_ERROR_INVALID_PARAMETERS;
   }
 
+  if (context->state == CONN_STATE_DISCONNECTING) {
+    return GAP_ERROR_BUSY;
+  }
+
+  context->state = CONN_STATE_DISCONNECTING;
   HCIError status = HCI_disconnect(connection_handle, CONN_DISCONNECT_REMOTE_USER_TERMINATED);
   if (status != HCI_ERROR_SUCCESS) {
+    context->state = CONN_STATE_CONNECTED;
     return GAP_ERROR_HCI_ERROR;
   }
 
@@ -304,15 +550,7 @@ GAPError GAP_disconnect(uint16_t connection_handle) {
 
 GAPError GAP_update_connection_parameters(uint16_t connection_handle, uint16_t min_interval_ms, uint16_t max_interval_ms,
                                           uint16_t latency, uint16_t timeout_ms) {
-  int conn_idx = -1;
-  for (int i = 0; i < MAX_CONNECTIONS; i++) {
-    if (connections[i].connected && connections[i].connection_handle == connection_handle) {
-      conn_idx = i;
-      break;
-    }
-  }
-
-  if (conn_idx == -1) {
+  if (!CONN_lookup(connection_handle)) {
     return GAP_ERROR_INVALID_PARAMETERS;
   }
 
@@ -330,19 +568,245 @@ GAPError GAP_update_connection_parameters(uint16_t connection_handle, uint16_t m
   return GAP_ERROR_SUCCESS;
 }
 
-GAPError GAP_set_appearance(uint16_t appearance) {
-  (void)appearance;
+GAPError GAP_set_connection_policy(uint16_t connection_handle, GAPConnectionPolicy policy) {
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (!context || policy > GAP_CONN_POLICY_POWER) {
+    return GAP_ERROR_INVALID_PARAMETERS;
+  }
+
+  context->param_policy = policy;
   return GAP_ERROR_SUCCESS;
 }
 
+GAPError GAP_set_preferred_phy(uint16_t connection_handle, uint8_t phys) {
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (!context || phys == 0 || (phys & ~(PHY_PREFER_LE_1M | PHY_PREFER_LE_2M | PHY_PREFER_LE_CODED))) {
+    return GAP_ERROR_INVALID_PARAMETERS;
+  }
+
+  /* Sent without waiting, so it needs a free command credit now. */
+  if (HCI_get_command_credits() == 0) {
+    return GAP_ERROR_BUSY;
+  }
+
+  context->preferred_phys = phys;
+
+  if (HCI_BLE_set_phy_async(connection_handle, phys, phys) != HCI_ERROR_SUCCESS) {
+    return GAP_ERROR_HCI_ERROR;
+  }
+
+  return GAP_ERROR_SUCCESS;
+}
+
+void GAP_set_connection_parameter_callback(GAPConnectionParameterCallback callback) {
+  gap_conn_param_callback = callback;
+}
+
+GAPError GAP_set_appearance(uint16_t appearance) {
+  gap_appearance = appearance;
+  if (!gap_payload_owned) {
+    return GAP_ERROR_SUCCESS;
+  }
+  return write_owned_payload();
+}
+
 GAPError GAP_get_connection_info(uint16_t connection_handle, GAPConnection *connection) {
-  (void)connection_handle;
-  (void)connection;
+  if (connection == NULL) {
+    return GAP_ERROR_INVALID_PARAMETERS;
+  }
+
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (!context) {
+    return GAP_ERROR_INVALID_PARAMETERS;
+  }
+
+  connection->connection_handle = context->connection_handle;
+  connection->att_mtu = context->att_mtu;
+  connection->connected = (context->state == CONN_STATE_CONNECTED);
+  connection->services_discovered = context->services_discovered;
+  connection->role = context->role;
+  connection->interval = context->conn_interval;
+  connection->latency = context->conn_latency;
+  connection->supervision_timeout = context->supervision_timeout;
+  connection->max_tx_octets = context->max_tx_octets;
+  connection->max_rx_octets = context->max_rx_octets;
+  connection->tx_phy = context->tx_phy;
+  connection->rx_phy = context->rx_phy;
 
   return GAP_ERROR_SUCCESS;
 }
 
 GAPError GAP_set_preferred_mtu(uint16_t mtu) {
-  (void)mtu;
+  if (mtu < ATT_DEFAULT_MTU || mtu > ATT_MAX_MTU) {
+    return GAP_ERROR_INVALID_PARAMETERS;
+  }
+
+  LINK_set_preferred_mtu(mtu);
   return GAP_ERROR_SUCCESS;
 }
+
+static void deliver_connection_event(GAPEventType type, ConnectionContext *context) {
+  if (!gap_event_callback) {
+    return;
+  }
+
+  GAPEvent event = { .type = type, .connection_handle = context->connection_handle };
+  event.params.connection.role = context->role;
+  event.params.connection.peer_addr_type = context->peer_address_type;
+  memcpy(event.params.connection.peer_addr, context->peer_address, sizeof(event.params.connection.peer_addr));
+  event.params.connection.interval = context->conn_interval;
+  event.params.connection.latency = context->conn_latency;
+  event.params.connection.supervision_timeout = context->supervision_timeout;
+
+  gap_event_callback(&event);
+}
+
+static bool connection_parameters_valid(GAPConnectionParameters *params) {
+  if (params->interval_min < CONN_INTERVAL_MIN || params->interval_max > CONN_INTERVAL_MAX ||
+      params->interval_min > params->interval_max || params->latency > CONN_LATENCY_MAX ||
+      params->supervision_timeout < CONN_SUPERVISION_TIMEOUT_MIN ||
+      params->supervision_timeout > CONN_SUPERVISION_TIMEOUT_MAX) {
+    return false;
+  }
+
+  /* Timeout (10 ms) must exceed (1 + latency) * interval (1.25 ms) * 2 */
+  return (uint32_t)params->supervision_timeout * 4 > (uint32_t)(1 + params->latency) * params->interval_max;
+}
+
+bool GAP_handle_connection_parameter_request(uint16_t connection_handle, GAPConnectionParameters *params) {
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (!context || context->state != CONN_STATE_CONNECTED || !connection_parameters_valid(params)) {
+    return false;
+  }
+
+  /* Narrowing the range to one end keeps the parameters valid. */
+  switch (context->param_policy) {
+    case GAP_CONN_POLICY_THROUGHPUT:
+      params->interval_max = params->interval_min;
+      params->latency = 0;
+      break;
+
+    case GAP_CONN_POLICY_POWER:
+      params->interval_min = params->interval_max;
+      break;
+
+    default:
+      break;
+  }
+
+  if (gap_conn_param_callback && !gap_conn_param_callback(connection_handle, params)) {
+    return false;
+  }
+
+  return connection_parameters_valid(params);
+}
+
+void GAP_handle_connection_complete(uint16_t connection_handle) {
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (context) {
+    context->gap_events.connected = true;
+  }
+}
+
+void GAP_handle_connection_update(uint16_t connection_handle) {
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (context) {
+    context->gap_events.updated = true;
+  }
+}
+
+void GAP_handle_link_ready(uint16_t connection_handle) {
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (context) {
+    context->gap_events.link_ready = true;
+  }
+}
+
+static void deliver_link_ready(ConnectionContext *context) {
+  if (!gap_event_callback) {
+    return;
+  }
+
+  GAPEvent event = { .type = GAP_EVENT_LINK_READY, .connection_handle = context->connection_handle };
+  event.params.link_ready.att_mtu = context->att_mtu;
+  event.params.link_ready.max_tx_octets = context->max_tx_octets;
+  event.params.link_ready.max_rx_octets = context->max_rx_octets;
+  event.params.link_ready.tx_phy = context->tx_phy;
+  event.params.link_ready.rx_phy = context->rx_phy;
+  event.params.link_ready.interval = context->conn_interval;
+  event.params.link_ready.latency = context->conn_latency;
+
+  gap_event_callback(&event);
+}
+
+void GAP_handle_advertising_report(uint8_t event_type, uint8_t addr_type, uint8_t *addr, uint8_t *data,
+                                   uint16_t data_len, int8_t rssi) {
+  if (gap_scan_filter && !ADV_FILTER_match(gap_scan_filter, data, data_len, rssi)) {
+    return;
+  }
+
+  const ScanCacheEntry *entry;
+  uint8_t changes = SCAN_CACHE_update(addr_type, addr, event_type, data, data_len, rssi, &entry);
+  if (!gap_event_callback || !(changes & gap_scan_result_events)) {
+    return;
+  }
+
+  GAPEvent event = { .type = GAP_EVENT_SCAN_RESULT };
+  event.params.scan_result.event_type = event_type;
+  event.params.scan_result.addr_type = addr_type;
+  memcpy(event.params.scan_result.addr, addr, 6);
+  event.params.scan_result.rssi = rssi;
+  event.params.scan_result.rssi_smoothed = SCAN_CACHE_get_smoothed_rssi(entry);
+  event.params.scan_result.changes = changes;
+  event.params.scan_result.adv_data = data;
+  event.params.scan_result.adv_data_len = data_len;
+  gap_event_callback(&event);
+}
+
+void GAP_handle_disconnection_complete(uint16_t connection_handle, uint8_t reason) {
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (context) {
+    context->gap_events.disconnect_reason = reason;
+  }
+}
+
+void GAP_handle_connection_released(uint16_t connection_handle, uint8_t reason) {
+  if (!gap_event_callback) {
+    return;
+  }
+
+  GAPEvent event = { .type = GAP_EVENT_DISCONNECTED, .connection_handle = connection_handle };
+  event.params.disconnection.reason = reason;
+  gap_event_callback(&event);
+}
+
+void GAP_process(void) {
+  for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+    ConnectionContext *context = CONN_get_slot(i);
+    if (!context) {
+      continue;
+    }
+
+    /* Each flag is cleared before its event is built, so one the interrupt raises meanwhile waits for the
+     * next pass. The connected event already carries the current parameters, a pending update adds nothing. */
+    ConnGapEvents *events = &context->gap_events;
+    if (events->connected) {
+      events->connected = false;
+      events->updated = false;
+      events->reported = true;
+      deliver_connection_event(GAP_EVENT_CONNECTED, context);
+    }
+    if (!events->reported) {
+      continue;
+    }
+
+    if (events->updated) {
+      events->updated = false;
+      deliver_connection_event(GAP_EVENT_CONNECTION_UPDATED, context);
+    }
+    if (events->link_ready) {
+      events->link_ready = false;
+      deliver_link_ready(context);
+    }
+  }
+}
@@ -1,133 +1,97 @@
 #include "gatt.h"
 
+#include "att_server.h"
+#include "connection.h"
+#include "gatt_db.h"
+#include "hci_acl.h"
 #include "hci_defs.h"
+#include "l2cap.h"
+#include "link_setup.h"
 #include "mem_utils.h"
 
-static GATTService gatt_services[MAX_SERVICES];
-static uint8_t service_count = 0U;
-static uint16_t next_handle = 1U;
-
 static GATTEventCallback gatt_event_callback = NULL;
 
-static GATTService *find_service_by_uuid(uint16_t uuid) {
-  for (uint8_t i = 0; i < service_count; i++) {
-    if (gatt_services[i].uuid == uuid) {
-      return &gatt_services[i];
-    }
+/* Resolve a characteristic declaration or value handle to the value attribute. */
+static const GATTAttribute *find_characteristic_by_handle(uint16_t handle, uint16_t *value_handle) {
+  uint16_t resolved = GATT_DB_value_handle(handle);
+  if (value_handle) {
+    *value_handle = resolved;
   }
-  return NULL;
+  return resolved ? GATT_DB_get(resolved) : NULL;
 }
 
-static GATTCharacteristic *find_characteristic_by_uuid(GATTService *service, uint16_t uuid) {
-  if (!service) return NULL;
+/* ATT allows a single outstanding client request per bearer, the response clears it. */
+static GATTError send_att_request(uint16_t connection_handle, uint8_t *packet, uint16_t length) {
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (!context) {
+    return GATT_ERROR_INVALID_PARAMETER;
+  }
 
-  for (uint8_t i = 0; i < service->characteristic_count; i++) {
-    if (service->characteristics[i].uuid == uuid) {
-      return &service->characteristics[i];
-    }
+  if (context->att.pending_request != 0) {
+    return GATT_ERROR_BUSY;
   }
-  return NULL;
-}
 
-static GATTCharacteristic *find_characteristic_by_handle(uint16_t handle) {
-  for (uint8_t i = 0; i < service_count; i++) {
-    for (uint8_t j = 0; j < gatt_services[i].characteristic_count; j++) {
-      if (gatt_services[i].characteristics[j].handle == handle ||
-          gatt_services[i].characteristics[j].value_handle == handle) {
-        return &gatt_services[i].characteristics[j];
-      }
-    }
+  if (length > context->att_mtu) {
+    return GATT_ERROR_INVALID_VALUE_LENGTH;
+  }
+
+  context->att.pending_request = packet[0];
+  if (HCI_ACL_enqueue(connection_handle, L2CAP_ATT_CID, HCI_ACL_PRIORITY_ATT_RESPONSE, packet, length) !=
+      HCI_ERROR_SUCCESS) {
+    context->att.pending_request = 0;
+    return GATT_ERROR_INSUFFICIENT_RESOURCES;
   }
-  return NULL;
+
+  return GATT_ERROR_SUCCESS;
+}
+
+static bool att_is_response(uint8_t opcode) {
+  /* Responses are the odd opcodes up to Execute Write Response. */
+  return (opcode & 0x01U) && opcode <= ATT_EXECUTE_WRITE_RESPONSE;
 }
 
 GATTError GATT_init(void) {
-  service_count = 0;
-  next_handle = 1;
+  GATT_DB_init();
   gatt_event_callback = NULL;
   return GATT_ERROR_SUCCESS;
 }
 
 GATTError GATT_deinit(void) {
-  for (uint8_t i = 0; i < MAX_SERVICES; i++) {
-    memzero((uint64_t)&gatt_services[i], sizeof(GATTService));
-  }
-
+  GATT_DB_init();
   gatt_event_callback = NULL;
 
   return GATT_ERROR_SUCCESS;
 }
 
 GATTError GATT_register_service(uint16_t uuid, bool is_primary) {
-  if (service_count >= MAX_SERVICES) {
-    return GATT_ERROR_INSUFFICIENT_RESOURCES;
-  }
-
-  gatt_services[service_count].uuid = uuid;
-  gatt_services[service_count].is_primary = is_primary;
-  gatt_services[service_count].handle = next_handle++;
-  gatt_services[service_count].characteristic_count = 0U;
-
-  service_count++;
-  return GATT_ERROR_SUCCESS;
+  return GATT_DB_add_service(uuid, is_primary);
 }
 
 GATTError GATT_remove_service(uint16_t service_uuid) {
-  GATTService *service = find_service_by_uuid(service_uuid);
-
-  if (!service) {
-    return GATT_ERROR_INVALID_HANDLE;
-  }
-
-  uint8_t service_index = 0;
-
-  for (; service_index < service_count; service_index++) {
-    if (gatt_services[service_index].uuid == service_uuid) {
-      break;
-    }
-  }
-
-  if (service_index >= service_count) {
-    return GATT_ERROR_INVALID_HANDLE;
-  }
-
-  /* Shift all services after this one */
-  for (uint8_t i = service_index; i < service_count - 1U; i++) {
-    gatt_services[i] = gatt_services[i + 1];
-  }
-
-  service_count--;
-  return GATT_ERROR_SUCCESS;
+  return GATT_DB_remove_service(service_uuid);
 }
 
 GATTError GATT_add_characteristic(uint16_t service_uuid, uint16_t char_uuid, GATTCharacteristicProperties properties,
                                   GATTCharacteristicPermissions permissions, uint8_t *initial_value, uint16_t value_length) {
-  GATTService *service = find_service_by_uuid(service_uuid);
-  if (!service) {
-    return GATT_ERROR_INVALID_HANDLE;
-  }
-
-  if (service->characteristic_count >= MAX_CHARACTERISTICS_PER_SERVICE) {
-    return GATT_ERROR_INSUFFICIENT_RESOURCES;
-  }
+  return GATT_add_variable_characteristic(service_uuid, char_uuid, properties, permissions, initial_value, value_length,
+                                          value_length);
+}
 
-  if (value_length > MAX_VALUE_LENGTH) {
+GATTError GATT_add_variable_characteristic(uint16_t service_uuid, uint16_t char_uuid,
+                                           GATTCharacteristicProperties properties,
+                                           GATTCharacteristicPermissions permissions, uint8_t *initial_value,
+                                           uint16_t value_length, uint16_t max_length) {
+  if (max_length > MAX_VALUE_LENGTH || value_length > max_length) {
     return GATT_ERROR_INVALID_VALUE_LENGTH;
   }
 
-  GATTCharacteristic *characteristic = &service->characteristics[service->characteristic_count];
-  characteristic->uuid = char_uuid;
-  characteristic->properties = properties;
-  characteristic->permissions = permissions;
-  characteristic->handle = next_handle++;
-  characteristic->value_handle = next_handle++;
-  characteristic->value_length = value_length;
-
-  if (initial_value && value_length > 0) {
-    memcpy(characteristic->value, initial_value, value_length);
-  }
+  return GATT_DB_add_characteristic(service_uuid, char_uuid, properties, permissions, initial_value, value_length,
+                                    max_length);
+}
 
-  service->characteristic_count++;
+GATTError GATT_freeze_database(void) {
+  GATT_DB_freeze();
+  ATT_SERVER_build_discovery_cache();
   return GATT_ERROR_SUCCESS;
 }
 
@@ -136,41 +100,35 @@ GATTError GATT_update_characteristic_value(uint16_t service_uuid, uint16_t char_
     return GATT_ERROR_INVALID_VALUE_LENGTH;
   }
 
-  GATTService *service = find_service_by_uuid(service_uuid);
-  if (!service) {
-    return GATT_ERROR_INVALID_HANDLE;
-  }
-
-  GATTCharacteristic *characteristic = find_characteristic_by_uuid(service, char_uuid);
-
-  if (!characteristic) {
+  uint16_t service = GATT_DB_find_service(service_uuid);
+  uint16_t handle = service ? GATT_DB_find_characteristic(service, char_uuid) : 0;
+  if (handle == 0) {
     return GATT_ERROR_INVALID_HANDLE;
   }
 
-  memcpy(characteristic->value, value, length);
-  characteristic->value_length = length;
-  return GATT_ERROR_SUCCESS;
+  return GATT_DB_write(handle, value, length);
 }
 
 GATTError GATT_read_characteristic_value(uint16_t service_uuid, uint16_t char_uuid, uint8_t *buffer, uint16_t *length) {
-  if (!buffer && !length) {
+  if (!buffer || !length) {
     return GATT_ERROR_INVALID_PARAMETER;
   }
 
-  GATTService *service = find_service_by_uuid(service_uuid);
-
-  if (!service) {
+  uint16_t service = GATT_DB_find_service(service_uuid);
+  uint16_t handle = service ? GATT_DB_find_characteristic(service, char_uuid) : 0;
+  if (handle == 0) {
     return GATT_ERROR_INVALID_HANDLE;
   }
 
-  GATTCharacteristic *characteristic = find_characteristic_by_uuid(service, char_uuid);
-
-  if (!characteristic) {
+  uint8_t scratch[GATT_DB_SCRATCH_SIZE];
+  uint16_t value_length = 0;
+  const uint8_t *value = GATT_DB_read(handle, scratch, &value_length);
+  if (!value) {
     return GATT_ERROR_INVALID_HANDLE;
   }
 
-  memcpy(buffer, characteristic->value, characteristic->value_length);
-  *length = characteristic->value_length;
+  memcpy(buffer, value, value_length);
+  *length = value_length;
 
   return GATT_ERROR_SUCCESS;
 }
@@ -180,7 +138,8 @@ GATTError GATT_send_notification(uint16_t connection_handle, uint16_t char_handl
     return GATT_ERROR_INVALID_VALUE_LENGTH;
   }
 
-  GATTCharacteristic *characteristic = find_characteristic_by_handle(char_handle);
+  uint16_t value_handle = 0;
+  const GATTAttribute *characteristic = find_characteristic_by_handle(char_handle, &value_handle);
 
   if (!characteristic) {
     return GATT_ERROR_INVALID_HANDLE;
@@ -190,17 +149,24 @@ GATTError GATT_send_notification(uint16_t connection_handle, uint16_t char_handl
     return GATT_ERROR_REQUEST_NOT_SUPPORTED;
   }
 
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (!context) {
+    return GATT_ERROR_INVALID_PARAMETER;
+  }
+
+  if (length + 3U > context->att_mtu) {
+    return GATT_ERROR_INVALID_VALUE_LENGTH;
+  }
+
   static uint8_t packet[MAX_VALUE_LENGTH + 3];
   packet[0] = ATT_HANDLE_VALUE_NOTIFICATION;
-  packet[1] = char_handle & 0xFFU;
-  packet[2] = (char_handle >> 8U) & 0xFFU;
+  packet[1] = value_handle & 0xFFU;
+  packet[2] = (value_handle >> 8U) & 0xFFU;
   memcpy(&packet[3], value, length);
 
-  HCIAsyncData acl_data = {
-    .connection_handle = connection_handle, .pb_flag = 0, .bc_flag = 0, .data_total_length = length + 3U, .data = packet
-  };
-
-  return (HCI_send_async_data(&acl_data) == HCI_ERROR_SUCCESS) ? GATT_ERROR_SUCCESS : GATT_ERROR_INSUFFICIENT_RESOURCES;
+  HCIError status =
+      HCI_ACL_enqueue(connection_handle, L2CAP_ATT_CID, HCI_ACL_PRIORITY_NOTIFICATION, packet, length + 3U);
+  return (status == HCI_ERROR_SUCCESS) ? GATT_ERROR_SUCCESS : GATT_ERROR_INSUFFICIENT_RESOURCES;
 }
 
 GATTError GATT_send_indication(uint16_t connection_handle, uint16_t char_handle, uint8_t *value, uint16_t length) {
@@ -208,7 +174,8 @@ GATTError GATT_send_indication(uint16_t connection_handle, uint16_t char_handle,
     return GATT_ERROR_INVALID_VALUE_LENGTH;
   }
 
-  GATTCharacteristic *characteristic = find_characteristic_by_handle(char_handle);
+  uint16_t value_handle = 0;
+  const GATTAttribute *characteristic = find_characteristic_by_handle(char_handle, &value_handle);
 
   if (!characteristic) {
     return GATT_ERROR_INVALID_HANDLE;
@@ -218,17 +185,34 @@ GATTError GATT_send_indication(uint16_t connection_handle, uint16_t char_handle,
     return GATT_ERROR_REQUEST_NOT_SUPPORTED;
   }
 
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (!context) {
+    return GATT_ERROR_INVALID_PARAMETER;
+  }
+
+  if (length + 3U > context->att_mtu) {
+    return GATT_ERROR_INVALID_VALUE_LENGTH;
+  }
+
+  /* Only one indication may be outstanding until the peer confirms it. */
+  if (context->att.indication_pending) {
+    return GATT_ERROR_BUSY;
+  }
+
   static uint8_t packet[MAX_VALUE_LENGTH + 3];
   packet[0] = ATT_HANDLE_VALUE_INDICATION;
-  packet[1] = char_handle & 0xFFU;
-  packet[2] = (char_handle >> 8U) & 0xFFU;
+  packet[1] = value_handle & 0xFFU;
+  packet[2] = (value_handle >> 8U) & 0xFFU;
   memcpy(&packet[3], value, length);
 
-  HCIAsyncData acl_data = {
-    .connection_handle = connection_handle, .pb_flag = 0, .bc_flag = 0, .data_total_length = length + 3U, .data = packet
-  };
+  HCIError status =
+      HCI_ACL_enqueue(connection_handle, L2CAP_ATT_CID, HCI_ACL_PRIORITY_INDICATION, packet, length + 3U);
+  if (status != HCI_ERROR_SUCCESS) {
+    return GATT_ERROR_INSUFFICIENT_RESOURCES;
+  }
 
-  return (HCI_send_async_data(&acl_data) == HCI_ERROR_SUCCESS) ? GATT_ERROR_SUCCESS : GATT_ERROR_INSUFFICIENT_RESOURCES;
+  context->att.indication_pending = true;
+  return GATT_ERROR_SUCCESS;
 }
 
 GATTError GATT_discover_services(uint16_t connection_handle) {
@@ -243,15 +227,7 @@ GATTError GATT_discover_services(uint16_t connection_handle) {
   packet[5] = GATT_PRIMARY_SERVICE_UUID & 0xFFU;
   packet[6] = (GATT_PRIMARY_SERVICE_UUID >> 8U) & 0xFFU;
 
-  HCIAsyncData acl_data = {
-    .connection_handle = connection_handle, .pb_flag = 0, .bc_flag = 0, .data_total_length = sizeof(packet), .data = packet
-  };
-
-  if (HCI_send_async_data(&acl_data) != HCI_ERROR_SUCCESS) {
-    return GATT_ERROR_INSUFFICIENT_RESOURCES;
-  }
-
-  return GATT_ERROR_SUCCESS;
+  return send_att_request(connection_handle, packet, sizeof(packet));
 }
 
 GATTError GATT_discover_characteristics(uint16_t connection_handle, uint16_t start_handle, uint16_t end_handle) {
@@ -265,20 +241,12 @@ GATTError GATT_discover_characteristics(uint16_t connection_handle, uint16_t sta
   packet[5] = GATT_CHARACTERISTIC_UUID & 0xFFU;
   packet[6] = (GATT_CHARACTERISTIC_UUID >> 8U) & 0xFFU;
 
-  HCIAsyncData acl_data = {
-    .connection_handle = connection_handle, .pb_flag = 0, .bc_flag = 0, .data_total_length = sizeof(packet), .data = packet
-  };
-
-  if (HCI_send_async_data(&acl_data) != HCI_ERROR_SUCCESS) {
-    return GATT_ERROR_INSUFFICIENT_RESOURCES;
-  }
-
-  return GATT_ERROR_SUCCESS;
+  return send_att_request(connection_handle, packet, sizeof(packet));
 }
 
 GATTError GATT_subscribe_characteristic(uint16_t connection_handle, uint16_t char_handle,
                                         GATTNotificationType notification_type) {
-  GATTCharacteristic *characteristic = find_characteristic_by_handle(char_handle);
+  const GATTAttribute *characteristic = find_characteristic_by_handle(char_handle, NULL);
 
   if (!characteristic) {
     return GATT_ERROR_INVALID_HANDLE;
@@ -311,19 +279,11 @@ GATTError GATT_subscribe_characteristic(uint16_t connection_handle, uint16_t cha
   packet[3] = cccd_value[0];
   packet[4] = cccd_value[1];
 
-  HCIAsyncData acl_data = {
-    .connection_handle = connection_handle, .pb_flag = 0, .bc_flag = 0, .data_total_length = sizeof(packet), .data = packet
-  };
-
-  if (HCI_send_async_data(&acl_data) != HCI_ERROR_SUCCESS) {
-    return GATT_ERROR_INSUFFICIENT_RESOURCES;
-  }
-
-  return GATT_ERROR_SUCCESS;
+  return send_att_request(connection_handle, packet, sizeof(packet));
 }
 
 GATTError GATT_unsubscribe_characteristic(uint16_t connection_handle, uint16_t char_handle) {
-  GATTCharacteristic *characteristic = find_characteristic_by_handle(char_handle);
+  const GATTAttribute *characteristic = find_characteristic_by_handle(char_handle, NULL);
 
   if (!characteristic) {
     return GATT_ERROR_INVALID_HANDLE;
@@ -344,19 +304,11 @@ GATTError GATT_unsubscribe_characteristic(uint16_t connection_handle, uint16_t c
   packet[3] = cccd_value[0];
   packet[4] = cccd_value[1];
 
-  HCIAsyncData acl_data = {
-    .connection_handle = connection_handle, .pb_flag = 0, .bc_flag = 0, .data_total_length = sizeof(packet), .data = packet
-  };
-
-  if (HCI_send_async_data(&acl_data) != HCI_ERROR_SUCCESS) {
-    return GATT_ERROR_INSUFFICIENT_RESOURCES;
-  }
-
-  return GATT_ERROR_SUCCESS;
+  return send_att_request(connection_handle, packet, sizeof(packet));
 }
 
 GATTError GATT_read_characteristic(uint16_t connection_handle, uint16_t char_handle) {
-  GATTCharacteristic *characteristic = find_characteristic_by_handle(char_handle);
+  const GATTAttribute *characteristic = find_characteristic_by_handle(char_handle, NULL);
 
   if (!characteristic) {
     return GATT_ERROR_INVALID_HANDLE;
@@ -371,15 +323,7 @@ GATTError GATT_read_characteristic(uint16_t connection_handle, uint16_t char_han
   packet[1] = char_handle & 0xFF;
   packet[2] = (char_handle >> 8) & 0xFF;
 
-  HCIAsyncData acl_data = {
-    .connection_handle = connection_handle, .pb_flag = 0, .bc_flag = 0, .data_total_length = sizeof(packet), .data = packet
-  };
-
-  if (HCI_send_async_data(&acl_data) != HCI_ERROR_SUCCESS) {
-    return GATT_ERROR_INSUFFICIENT_RESOURCES;
-  }
-
-  return GATT_ERROR_SUCCESS;
+  return send_att_request(connection_handle, packet, sizeof(packet));
 }
 
 GATTError GATT_write_characteristic(uint16_t connection_handle, uint16_t char_handle, uint8_t *value, uint16_t length) {
@@ -387,7 +331,7 @@ GATTError GATT_write_characteristic(uint16_t connection_handle, uint16_t char_ha
     return GATT_ERROR_INVALID_PARAMETER;
   }
 
-  GATTCharacteristic *characteristic = find_characteristic_by_handle(char_handle);
+  const GATTAttribute *characteristic = find_characteristic_by_handle(char_handle, NULL);
 
   if (!characteristic) {
     return GATT_ERROR_INVALID_HANDLE;
@@ -397,21 +341,13 @@ GATTError GATT_write_characteristic(uint16_t connection_handle, uint16_t char_ha
     return GATT_ERROR_REQUEST_NOT_SUPPORTED;
   }
 
-  static uint8_t packet[MAX_VALUE_LENGTH];
+  static uint8_t packet[MAX_VALUE_LENGTH + 3];
   packet[0] = ATT_WRITE_REQUEST;
   packet[1] = char_handle & 0xFFU;
   packet[2] = (char_handle >> 8U) & 0xFFU;
   memcpy(&packet[3], value, length);
 
-  HCIAsyncData acl_data = {
-    .connection_handle = connection_handle, .pb_flag = 0, .bc_flag = 0, .data_total_length = 3 + length, .data = packet
-  };
-
-  if (HCI_send_async_data(&acl_data) != HCI_ERROR_SUCCESS) {
-    return GATT_ERROR_INSUFFICIENT_RESOURCES;
-  }
-
-  return GATT_ERROR_SUCCESS;
+  return send_att_request(connection_handle, packet, 3 + length);
 }
 
 GATTError GATT_read_descriptor(uint16_t connection_handle, uint16_t desc_handle) {
@@ -420,15 +356,7 @@ GATTError GATT_read_descriptor(uint16_t connection_handle, uint16_t desc_handle)
   packet[1] = desc_handle & 0xFFU;
   packet[2] = (desc_handle >> 8U) & 0xFFU;
 
-  HCIAsyncData acl_data = {
-    .connection_handle = connection_handle, .pb_flag = 0, .bc_flag = 0, .data_total_length = sizeof(packet), .data = packet
-  };
-
-  if (HCI_send_async_data(&acl_data) != HCI_ERROR_SUCCESS) {
-    return GATT_ERROR_INSUFFICIENT_RESOURCES;
-  }
-
-  return GATT_ERROR_SUCCESS;
+  return send_att_request(connection_handle, packet, sizeof(packet));
 }
 
 GATTError GATT_write_descriptor(uint16_t connection_handle, uint16_t desc_handle, uint8_t *value, uint16_t length) {
@@ -436,42 +364,35 @@ GATTError GATT_write_descriptor(uint16_t connection_handle, uint16_t desc_handle
     return GATT_ERROR_INVALID_PARAMETER;
   }
 
-  static uint8_t packet[MAX_VALUE_LENGTH];
+  static uint8_t packet[MAX_VALUE_LENGTH + 3];
   packet[0] = ATT_WRITE_REQUEST;
   packet[1] = desc_handle & 0xFFU;
   packet[2] = (desc_handle >> 8U) & 0xFFU;
   memcpy(&packet[3], value, length);
 
-  HCIAsyncData acl_data = {
-    .connection_handle = connection_handle, .pb_flag = 0, .bc_flag = 0, .data_total_length = 3 + length, .data = packet
-  };
-
-  if (HCI_send_async_data(&acl_data) != HCI_ERROR_SUCCESS) {
-    return GATT_ERROR_INSUFFICIENT_RESOURCES;
-  }
-
-  return GATT_ERROR_SUCCESS;
+  return send_att_request(connection_handle, packet, 3 + length);
 }
 
 GATTError GATT_exchange_mtu(uint16_t connection_handle, uint16_t client_mtu) {
-  if (client_mtu < ATT_DEFAULT_MTU) {
+  if (client_mtu < ATT_DEFAULT_MTU || client_mtu > ATT_MAX_MTU) {
     return GATT_ERROR_INVALID_PARAMETER;
   }
 
-  static uint8_t packet[3];
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (!context) {
+    return GATT_ERROR_INVALID_PARAMETER;
+  }
+
+  uint8_t packet[3];
   packet[0] = ATT_EXCHANGE_MTU_REQUEST;
   packet[1] = client_mtu & 0xFFU;
   packet[2] = (client_mtu >> 8U) & 0xFFU;
 
-  HCIAsyncData acl_data = {
-    .connection_handle = connection_handle, .pb_flag = 0, .bc_flag = 0, .data_total_length = sizeof(packet), .data = packet
-  };
-
-  if (HCI_send_async_data(&acl_data) != HCI_ERROR_SUCCESS) {
-    return GATT_ERROR_INSUFFICIENT_RESOURCES;
+  GATTError status = send_att_request(connection_handle, packet, sizeof(packet));
+  if (status == GATT_ERROR_SUCCESS) {
+    context->att.requested_mtu = client_mtu;
   }
-
-  return GATT_ERROR_SUCCESS;
+  return status;
 }
 
 void GATT_register_event_handler(GATTEventCallback callback) {
@@ -518,14 +439,8 @@ void GATT_handle_acl_data(HCIAsyncData *acl_data) {
     return;
   }
 
-  if (acl_data->data_total_length >= 5) {
-    uint16_t l2cap_length = acl_data->data[0] | (acl_data->data[1] << 8);
-    uint16_t l2cap_cid = acl_data->data[2] | (acl_data->data[3] << 8);
-
-    if (l2cap_cid == L2CAP_ATT_CID) {
-      GATT_process_att_packet(acl_data->connection_handle, &acl_data->data[4], l2cap_length);
-    }
-  }
+  /* L2CAP resolves the connection, reassembles and hands ATT PDUs back to GATT_process_att_packet. */
+  L2CAP_handle_acl_data(acl_data);
 }
 
 void GATT_process_att_packet(uint16_t connection_handle, uint8_t *packet, uint16_t length) {
@@ -535,12 +450,28 @@ void GATT_process_att_packet(uint16_t connection_handle, uint8_t *packet, uint16
 
   uint8_t opcode = packet[0];
 
+  /* Requests and commands from the peer's client go to the local database. */
+  if (ATT_SERVER_handle(connection_handle, packet, length, gatt_event_callback)) {
+    return;
+  }
+
+  ConnectionContext *context = CONN_lookup(connection_handle);
+
+  if (context && att_is_response(opcode)) {
+    context->att.pending_request = 0;
+  }
+
   switch (opcode) {
     case ATT_ERROR_RESPONSE:
       if (length < 5) return;
 
       uint16_t handle = packet[2] | (packet[3] << 8U);
 
+      /* A server that rejects the exchange keeps the default MTU. */
+      if (packet[1] == ATT_EXCHANGE_MTU_REQUEST) {
+        LINK_complete(connection_handle, LINK_PROC_MTU);
+      }
+
       if (gatt_event_callback) {
         GATTEvent event = { .type = GATT_EVENT_ERROR,
                             .connection_handle = connection_handle,
@@ -557,6 +488,12 @@ void GATT_process_att_packet(uint16_t connection_handle, uint8_t *packet, uint16
 
       uint16_t server_mtu = packet[1] | (packet[2] << 8U);
 
+      if (context) {
+        uint16_t mtu = (server_mtu < context->att.requested_mtu) ? server_mtu : context->att.requested_mtu;
+        context->att_mtu = (mtu < ATT_DEFAULT_MTU) ? ATT_DEFAULT_MTU : mtu;
+        server_mtu = context->att_mtu;
+      }
+
       if (gatt_event_callback) {
         GATTEvent event = { .type = GATT_EVENT_MTU_EXCHANGE,
                             .connection_handle = connection_handle,
@@ -567,6 +504,8 @@ void GATT_process_att_packet(uint16_t connection_handle, uint8_t *packet, uint16
         event.params.mtu_exchange.mtu = server_mtu;
         gatt_event_callback(&event);
       }
+
+      LINK_complete(connection_handle, LINK_PROC_MTU);
       break;
 
     case ATT_READ_RESPONSE:
@@ -663,11 +602,8 @@ void GATT_process_att_packet(uint16_t connection_handle, uint8_t *packet, uint16
 
       uint8_t confirm_packet[1] = { ATT_HANDLE_VALUE_CONFIRMATION };
 
-      HCIAsyncData confirm_data = {
-        .connection_handle = connection_handle, .pb_flag = 0, .bc_flag = 0, .data_total_length = 1, .data = confirm_packet
-      };
-
-      HCI_send_async_data(&confirm_data);
+      HCI_ACL_enqueue(connection_handle, L2CAP_ATT_CID, HCI_ACL_PRIORITY_ATT_RESPONSE, confirm_packet,
+                      sizeof(confirm_packet));
 
       if (gatt_event_callback) {
         GATTEvent event = { .type = GATT_EVENT_INDICATION,
@@ -680,6 +616,12 @@ void GATT_process_att_packet(uint16_t connection_handle, uint8_t *packet, uint16
       }
       break;
 
+    case ATT_HANDLE_VALUE_CONFIRMATION:
+      if (context) {
+        context->att.indication_pending = false;
+      }
+      break;
+
     case ATT_FIND_INFORMATION_RESPONSE:
       if (length < 2) return;
 
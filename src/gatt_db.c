@@ -0,0 +1,333 @@
+#include "gatt_db.h"
+
+#include <stddef.h>
+#include <string.h>
+
+/* Arena blocks hold a GATTValue header followed by the value bytes, kept pointer aligned. */
+#define ARENA_ALIGN (sizeof(void *))
+#define ALIGN_UP(x) (((x) + ARENA_ALIGN - 1U) & ~(ARENA_ALIGN - 1U))
+#define BLOCK_SIZE(capacity) (ALIGN_UP(sizeof(GATTValue)) + ALIGN_UP((size_t)(capacity)))
+
+static GATTAttribute attributes[GATT_DB_MAX_ATTRIBUTES];
+static uint16_t attribute_count = 0;
+
+/* Table served to lookups, either the runtime table above or a static one loaded by GATT_DB_load. */
+static const GATTAttribute *table = attributes;
+
+/* A frozen database keeps its structure, so handles and declarations can be cached by other modules. */
+static bool frozen = false;
+static uint8_t generation = 0;
+
+static uint8_t value_arena[GATT_DB_ARENA_SIZE] __attribute__((aligned(sizeof(void *))));
+static size_t arena_used = 0;
+
+static GATTValue *arena_alloc(uint16_t capacity) {
+  size_t size = BLOCK_SIZE(capacity);
+  if (arena_used + size > sizeof(value_arena)) {
+    return NULL;
+  }
+
+  GATTValue *value = (GATTValue *)&value_arena[arena_used];
+  value->length = 0;
+  value->capacity = capacity;
+  value->data = &value_arena[arena_used + ALIGN_UP(sizeof(GATTValue))];
+  arena_used += size;
+  return value;
+}
+
+/* Slide the remaining blocks down over the holes left by removed values, lowest address first. */
+static void arena_compact(void) {
+  size_t cursor = 0;
+
+  for (;;) {
+    GATTAttribute *next = NULL;
+    for (uint16_t i = 0; i < attribute_count; i++) {
+      GATTAttribute *attr = &attributes[i];
+      if (attr->value && (uint8_t *)attr->value >= &value_arena[cursor] &&
+          (!next || attr->value < next->value)) {
+        next = attr;
+      }
+    }
+
+    if (!next) {
+      break;
+    }
+
+    size_t size = BLOCK_SIZE(next->value->capacity);
+    uint8_t *block = &value_arena[cursor];
+    if ((uint8_t *)next->value != block) {
+      memmove(block, next->value, size);
+      next->value = (GATTValue *)block;
+      next->value->data = block + ALIGN_UP(sizeof(GATTValue));
+    }
+    cursor += size;
+  }
+
+  arena_used = cursor;
+}
+
+static bool is_service(const GATTAttribute *attr) {
+  return attr->type == GATT_PRIMARY_SERVICE_UUID || attr->type == GATT_SECONDARY_SERVICE_UUID;
+}
+
+void GATT_DB_init(void) {
+  memset(attributes, 0, sizeof(attributes));
+  table = attributes;
+  attribute_count = 0;
+  arena_used = 0;
+  frozen = false;
+  generation++;
+}
+
+GATTError GATT_DB_load(const GATTAttribute *static_table, uint16_t count) {
+  if (!static_table || count == 0 || count > 0xFFFEU) {
+    return GATT_ERROR_INVALID_PARAMETER;
+  }
+
+  /* A handle skipped in the definition leaves a zeroed entry, and the table must open with a service. */
+  if (!is_service(&static_table[0])) {
+    return GATT_ERROR_INVALID_PARAMETER;
+  }
+  for (uint16_t i = 0; i < count; i++) {
+    if (static_table[i].type == 0) {
+      return GATT_ERROR_INVALID_PARAMETER;
+    }
+  }
+
+  GATT_DB_init();
+  table = static_table;
+  attribute_count = count;
+  frozen = true;
+  return GATT_ERROR_SUCCESS;
+}
+
+void GATT_DB_freeze(void) {
+  frozen = true;
+}
+
+bool GATT_DB_is_frozen(void) {
+  return frozen;
+}
+
+uint8_t GATT_DB_generation(void) {
+  return generation;
+}
+
+const GATTAttribute *GATT_DB_get(uint16_t handle) {
+  if (handle == 0 || handle > attribute_count) {
+    return NULL;
+  }
+  return &table[handle - 1];
+}
+
+uint16_t GATT_DB_last_handle(void) {
+  return attribute_count;
+}
+
+GATTError GATT_DB_add_service(uint16_t uuid, bool is_primary) {
+  if (frozen) {
+    return GATT_ERROR_REQUEST_NOT_SUPPORTED;
+  }
+
+  if (attribute_count >= GATT_DB_MAX_ATTRIBUTES) {
+    return GATT_ERROR_INSUFFICIENT_RESOURCES;
+  }
+
+  GATTAttribute *attr = &attributes[attribute_count++];
+  memset(attr, 0, sizeof(*attr));
+  attr->type = is_primary ? GATT_PRIMARY_SERVICE_UUID : GATT_SECONDARY_SERVICE_UUID;
+  attr->service_uuid = uuid;
+  attr->permissions = GATT_PERM_READ;
+  return GATT_ERROR_SUCCESS;
+}
+
+GATTError GATT_DB_remove_service(uint16_t uuid) {
+  if (frozen) {
+    return GATT_ERROR_REQUEST_NOT_SUPPORTED;
+  }
+
+  uint16_t start = GATT_DB_find_service(uuid);
+  if (start == 0) {
+    return GATT_ERROR_INVALID_HANDLE;
+  }
+
+  uint16_t end = GATT_DB_service_end(start);
+  uint16_t removed = end - start + 1;
+
+  memmove(&attributes[start - 1], &attributes[end], (attribute_count - end) * sizeof(GATTAttribute));
+  attribute_count -= removed;
+  memset(&attributes[attribute_count], 0, removed * sizeof(GATTAttribute));
+
+  arena_compact();
+  return GATT_ERROR_SUCCESS;
+}
+
+GATTError GATT_DB_add_characteristic(uint16_t service_uuid, uint16_t uuid, uint8_t properties, uint8_t permissions,
+                                     const uint8_t *value, uint16_t length, uint16_t capacity) {
+  if (frozen) {
+    return GATT_ERROR_REQUEST_NOT_SUPPORTED;
+  }
+
+  if (length > capacity || (length > 0 && !value)) {
+    return GATT_ERROR_INVALID_VALUE_LENGTH;
+  }
+
+  uint16_t service = GATT_DB_find_service(service_uuid);
+  if (service == 0) {
+    return GATT_ERROR_INVALID_HANDLE;
+  }
+
+  bool has_cccd = (properties & (GATT_PROP_NOTIFY | GATT_PROP_INDICATE)) != 0;
+  uint16_t needed = has_cccd ? 3 : 2;
+  if (attribute_count + needed > GATT_DB_MAX_ATTRIBUTES) {
+    return GATT_ERROR_INSUFFICIENT_RESOURCES;
+  }
+
+  GATTValue *stored = arena_alloc(capacity);
+  if (!stored) {
+    return GATT_ERROR_INSUFFICIENT_RESOURCES;
+  }
+  if (length > 0) {
+    memcpy(stored->data, value, length);
+  }
+  stored->length = length;
+
+  /* Insert at the end of the service, later services move up. */
+  uint16_t index = GATT_DB_service_end(service);
+  memmove(&attributes[index + needed], &attributes[index], (attribute_count - index) * sizeof(GATTAttribute));
+  attribute_count += needed;
+
+  GATTAttribute *attr = &attributes[index];
+  memset(attr, 0, needed * sizeof(GATTAttribute));
+
+  attr[0].type = GATT_CHARACTERISTIC_UUID;
+  attr[0].permissions = GATT_PERM_READ;
+
+  attr[1].type = uuid;
+  attr[1].permissions = permissions;
+  attr[1].properties = properties;
+  attr[1].value = stored;
+
+  if (has_cccd) {
+    attr[2].type = GATT_CCCD_UUID;
+    attr[2].permissions = GATT_PERM_READ | GATT_PERM_WRITE;
+  }
+
+  return GATT_ERROR_SUCCESS;
+}
+
+uint16_t GATT_DB_find_service(uint16_t uuid) {
+  for (uint16_t i = 0; i < attribute_count; i++) {
+    if (is_service(&table[i]) && table[i].service_uuid == uuid) {
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+uint16_t GATT_DB_service_end(uint16_t service_handle) {
+  uint16_t handle = service_handle;
+  while (handle < attribute_count && !is_service(&table[handle])) {
+    handle++;
+  }
+  return handle;
+}
+
+uint16_t GATT_DB_find_characteristic(uint16_t service_handle, uint16_t uuid) {
+  uint16_t end = GATT_DB_service_end(service_handle);
+  for (uint16_t handle = service_handle + 1; handle < end; handle++) {
+    if (table[handle - 1].type == GATT_CHARACTERISTIC_UUID && table[handle].type == uuid) {
+      return handle + 1;
+    }
+  }
+  return 0;
+}
+
+uint16_t GATT_DB_value_handle(uint16_t handle) {
+  const GATTAttribute *attr = GATT_DB_get(handle);
+  if (!attr) {
+    return 0;
+  }
+
+  if (attr->type == GATT_CHARACTERISTIC_UUID) {
+    return handle + 1;
+  }
+
+  const GATTAttribute *previous = GATT_DB_get(handle - 1);
+  return (previous && previous->type == GATT_CHARACTERISTIC_UUID) ? handle : 0;
+}
+
+uint16_t GATT_DB_descriptor_owner(uint16_t handle) {
+  const GATTAttribute *descriptor = GATT_DB_get(handle);
+  if (!descriptor || is_service(descriptor) || descriptor->type == GATT_CHARACTERISTIC_UUID) {
+    return 0;
+  }
+
+  for (uint16_t declaration = handle - 1; declaration > 0; declaration--) {
+    const GATTAttribute *attr = &table[declaration - 1];
+    if (is_service(attr)) {
+      return 0;
+    }
+    if (attr->type == GATT_CHARACTERISTIC_UUID) {
+      /* Right behind the declaration is the value itself. */
+      return (declaration + 1 < handle) ? declaration + 1 : 0;
+    }
+  }
+  return 0;
+}
+
+const uint8_t *GATT_DB_read(uint16_t handle, uint8_t *scratch, uint16_t *length) {
+  const GATTAttribute *attr = GATT_DB_get(handle);
+  if (!attr || !length) {
+    return NULL;
+  }
+
+  if (attr->value) {
+    *length = attr->value->length;
+    return attr->value->data;
+  }
+
+  if (attr->encoded) {
+    *length = attr->encoded_length;
+    return attr->encoded;
+  }
+
+  if (is_service(attr)) {
+    scratch[0] = attr->service_uuid & 0xFFU;
+    scratch[1] = (attr->service_uuid >> 8U) & 0xFFU;
+    *length = 2;
+    return scratch;
+  }
+
+  if (attr->type == GATT_CHARACTERISTIC_UUID) {
+    const GATTAttribute *value = &table[handle];
+    uint16_t value_handle = handle + 1;
+    scratch[0] = value->properties;
+    scratch[1] = value_handle & 0xFFU;
+    scratch[2] = (value_handle >> 8U) & 0xFFU;
+    scratch[3] = value->type & 0xFFU;
+    scratch[4] = (value->type >> 8U) & 0xFFU;
+    *length = 5;
+    return scratch;
+  }
+
+  /* CCCD values live in the connection context. */
+  return NULL;
+}
+
+GATTError GATT_DB_write(uint16_t handle, const uint8_t *value, uint16_t length) {
+  const GATTAttribute *attr = GATT_DB_get(handle);
+  if (!attr || !attr->value) {
+    return GATT_ERROR_INVALID_HANDLE;
+  }
+
+  if (length > attr->value->capacity || (length > 0 && !value)) {
+    return GATT_ERROR_INVALID_VALUE_LENGTH;
+  }
+
+  if (length > 0) {
+    memcpy(attr->value->data, value, length);
+  }
+  attr->value->length = length;
+  return GATT_ERROR_SUCCESS;
+}
@@ -6,7 +6,7 @@
 #include "uart.h"
 
 void HCI_handle_hw_rx(uint8_t byte);
-uint8_t HCI_buffer_space(void);
+uint16_t HCI_buffer_space(void);
 void hw_delay_ms(uint32_t ms);
 
 /* BEGIN USER DEFINED VARIABLES */
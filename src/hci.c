@@ -2,19 +2,47 @@
 
 #include <string.h>
 
+#include "accept_list.h"
+#include "auto_connect.h"
+#include "broadcaster.h"
+#include "connection.h"
+#include "ext_adv.h"
+#include "ext_scan.h"
 #include "hardware_bl.h"
+#include "hci_acl.h"
+#include "hci_caps.h"
+#include "l2cap.h"
+#include "link_setup.h"
 #include "log.h"
 #include "log_bl.h"
 
-#define MAX_PACKET_SIZE 256
+/* Command header + 255 parameter bytes */
+#define MAX_PACKET_SIZE 259
+
+/* Event header + 255 parameter bytes. Also holds an ACL header + 251 bytes of LE data. */
+#define MAX_RX_PACKET_SIZE 258
 
 static HCIState hci_state = HCI_STATE_IDLE;
+
+/* Per-role state, moved by the enabling commands and settled by their completions */
+static volatile HCIRoleState advertiser_state = HCI_ROLE_OFF;
+static volatile HCIRoleState scanner_state = HCI_ROLE_OFF;
+static volatile HCIRoleState initiator_state = HCI_ROLE_OFF;
+/* LE Create Connection Cancel sent, the initiator has not ended yet */
+static volatile bool initiator_cancel_pending = false;
 static bool waiting_response = false;
+static uint16_t waiting_op_code = 0;
+
+/* Commands the controller accepts before the next command complete or status */
+static volatile uint8_t command_credits = 1;
 
 static HW_RXState rx_state = HW_RX_STATE_WAIT_TYPE;
-static uint8_t rx_buffer[MAX_PACKET_SIZE];
-static uint8_t rx_count = 0;
-static uint8_t rx_expected = 0;
+static uint8_t rx_buffer[MAX_RX_PACKET_SIZE];
+static uint16_t rx_count = 0;
+static uint16_t rx_expected = 0;
+
+/* LL payload requested on new connections, raised by HCI_init when the controller supports DLE */
+static uint16_t le_data_length = CONN_DEFAULT_DATA_LENGTH;
 
 extern char _binary_BCM4345C0_hcd_start[];
 extern char _binary_BCM4345C0_hcd_end[];
@@ -50,6 +78,38 @@ void HCI_set_state(HCIState new_state) {
   hci_state = new_state;
 }
 
+void HCI_get_roles(HCIRoles *roles) {
+  roles->advertiser = advertiser_state;
+  roles->scanner = scanner_state;
+  roles->initiator = initiator_state;
+  roles->central_links = 0;
+  roles->peripheral_links = 0;
+
+  for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+    ConnectionContext *context = CONN_get_slot(i);
+    if (!context) {
+      continue;
+    }
+    if (context->role == CONN_ROLE_CENTRAL) {
+      roles->central_links++;
+    } else {
+      roles->peripheral_links++;
+    }
+  }
+}
+
+static void role_request(volatile HCIRoleState *role, bool enable) {
+  *role = enable ? HCI_ROLE_STARTING : HCI_ROLE_STOPPING;
+}
+
+static void role_settle(volatile HCIRoleState *role, bool success) {
+  if (*role == HCI_ROLE_STARTING) {
+    *role = success ? HCI_ROLE_ON : HCI_ROLE_OFF;
+  } else if (*role == HCI_ROLE_STOPPING) {
+    *role = success ? HCI_ROLE_OFF : HCI_ROLE_ON;
+  }
+}
+
 /***************************************************************************************
  * Packet serialization
  **************************************************************************************/
@@ -188,17 +248,30 @@ void HCI_handle_error(uint8_t error_code) {
  * HCI command and data transmission
  **************************************************************************************/
 HCIError HCI_send_command(HCICommand *cmd) {
+  /* Only the completion of this command releases HCI_wait_response(). */
+  waiting_op_code = cmd->op_code.raw;
+  return HCI_send_command_async(cmd);
+}
+
+HCIError HCI_send_command_async(HCICommand *cmd) {
   uint8_t packet[MAX_PACKET_SIZE];
   uint16_t packet_len = HCI_encode_packet(HCI_COMMAND_PACKET, cmd, packet, sizeof(packet));
   if (packet_len == 0) {
     return HCI_ERROR_INVALID_PARAMETERS;
   }
 
+  if (command_credits > 0) {
+    command_credits--;
+  }
   hw_transmit_buffer(packet, packet_len);
 
   return HCI_ERROR_SUCCESS;
 }
 
+uint8_t HCI_get_command_credits(void) {
+  return command_credits;
+}
+
 HCIError HCI_send_async_data(HCIAsyncData *data) {
   uint8_t packet[MAX_PACKET_SIZE];
   uint16_t packet_len = HCI_encode_packet(HCI_ASYNC_DATA_PACKET, data, packet, sizeof(packet));
@@ -217,7 +290,7 @@ HCIError HCI_send_async_data(HCIAsyncData *data) {
  **************************************************************************************/
 
 void HCI_handle_async_data(HCIAsyncData *data) {
-  (void)data;
+  L2CAP_handle_acl_data(data);
 }
 
 /***************************************************************************************
@@ -231,52 +304,56 @@ void HCI_handle_command_complete_event(uint8_t *parameters, uint8_t parameter_le
   }
 
   uint8_t num_cmd_packets = parameters[0];
-  (void)num_cmd_packets;
   uint16_t op_code = parameters[1] | (parameters[2] << 8);
   uint8_t status = parameters[3];
-  waiting_response = false;
-
-  if (status != HCI_ERROR_SUCCESS) {
-    HCI_handle_error(status);
-    return;
+  command_credits = num_cmd_packets;
+  if (op_code == waiting_op_code) {
+    waiting_response = false;
   }
+  AUTO_CONN_handle_command_result(op_code, status);
 
   switch (op_code) {
-    case CMD_BT_RESET:
-      HCI_set_state(HCI_STATE_ON);
-      break;
-
-    case CMD_BT_READ_REMOTE_VERSION_INFORMATION:
-      HCI_set_state(HCI_STATE_ON);
-      break;
-
     case CMD_BLE_SET_ADVERTISE_ENABLE:
-      /* This command toggles the advertising. */
-      if (hci_state == HCI_STATE_ADVERTISING) {
-        HCI_set_state(HCI_STATE_ON);
-      } else {
-        HCI_set_state(HCI_STATE_ADVERTISING);
-      }
+      role_settle(&advertiser_state, status == HCI_ERROR_SUCCESS);
       break;
-
     case CMD_BLE_SET_SCAN_ENABLE:
-      /* This command toggles scanning. */
-      if (hci_state == HCI_STATE_SCANNING) {
-        HCI_set_state(HCI_STATE_ON);
-      } else {
-        HCI_set_state(HCI_STATE_SCANNING);
+    case CMD_BLE_SET_EXTENDED_SCAN_ENABLE:
+      role_settle(&scanner_state, status == HCI_ERROR_SUCCESS);
+      break;
+    case CMD_BLE_CREATE_CONNECTION_CANCEL:
+      /* Rejected, so no connection complete follows and an initiator still up keeps running. */
+      if (status != HCI_ERROR_SUCCESS) {
+        initiator_cancel_pending = false;
+        if (initiator_state == HCI_ROLE_STOPPING) {
+          initiator_state = HCI_ROLE_ON;
+        }
       }
       break;
-
-    case CMD_BLE_SET_RANDOM_ADDRESS:
-      HCI_set_state(HCI_STATE_ON);
+    default:
       break;
+  }
 
-    case CMD_BLE_SET_SCAN_PARAMETERS:
-      HCI_set_state(HCI_STATE_ON);
-      break;
+  if (HCI_CAPS_handle_command_complete(op_code, status, &parameters[4], parameter_length - 4) ||
+      ACCEPT_LIST_handle_command_complete(op_code, status, &parameters[4], parameter_length - 4) ||
+      BCAST_handle_command_complete(op_code, status) ||
+      EXT_ADV_handle_command_complete(op_code, status, &parameters[4], parameter_length - 4)) {
+    return;
+  }
 
-    case CMD_BT_READ_BD_ADDR:
+  /* The Data Length Change event only follows if the lengths actually change, which they do not against a
+   * peer limited to 27 bytes. Set Data Length returns the connection handle, so bring-up counts the
+   * command itself as done and the event still updates the context if it comes. */
+  if (op_code == CMD_BLE_SET_DATA_LENGTH && parameter_length >= 6) {
+    LINK_complete((parameters[4] | (parameters[5] << 8)) & 0x0FFF, LINK_PROC_DATA_LENGTH);
+  }
+
+  if (status != HCI_ERROR_SUCCESS) {
+    HCI_handle_error(status);
+    return;
+  }
+
+  switch (op_code) {
+    case CMD_BT_RESET:
       HCI_set_state(HCI_STATE_ON);
       break;
 
@@ -293,8 +370,24 @@ void HCI_handle_command_status_event(uint8_t *parameters, uint8_t parameter_leng
 
   uint8_t status = parameters[0];
   uint8_t num_cmd_packets = parameters[1];
-  (void)num_cmd_packets;
   uint16_t op_code = parameters[2] | (parameters[3] << 8);
+  command_credits = num_cmd_packets;
+
+  /* Create connection, disconnect and connection update only ever answer with a command status. */
+  if (op_code == waiting_op_code) {
+    waiting_response = false;
+  }
+  AUTO_CONN_handle_command_result(op_code, status);
+
+  if (op_code == CMD_BLE_CREATE_CONNECTION) {
+    role_settle(&initiator_state, status == HCI_ERROR_SUCCESS);
+    if (initiator_state == HCI_ROLE_OFF) {
+      initiator_cancel_pending = false;
+    } else if (initiator_cancel_pending) {
+      /* A cancel sent while starting stops the initiator that just came up. */
+      initiator_state = HCI_ROLE_STOPPING;
+    }
+  }
 
   if (status != HCI_ERROR_SUCCESS) {
     HCI_handle_error(status);
@@ -302,19 +395,35 @@ void HCI_handle_command_status_event(uint8_t *parameters, uint8_t parameter_leng
   }
 
   switch (op_code) {
-    case CMD_BLE_CREATE_CONNECTION:
-      HCI_set_state(HCI_STATE_CONNECTING);
-      break;
-
     case CMD_BT_DISCONNECT:
-      HCI_set_state(HCI_STATE_DISCONNECTED);
+      /* Link state is tracked per connection, the controller itself stays on. */
       break;
   }
 }
 
 void HCI_handle_disconnection_complete_event(uint8_t *parameters, uint8_t parameter_length) {
-  (void)parameters;
-  (void)parameter_length;
+  if (parameter_length < 4) {
+    HCI_handle_error(HCI_ERROR_INVALID_PARAMETERS);
+    return;
+  }
+
+  uint8_t status = parameters[0];
+  uint16_t connection_handle = (parameters[1] | (parameters[2] << 8)) & 0x0FFF;
+  uint8_t reason = parameters[3];
+
+  if (status != HCI_ERROR_SUCCESS) {
+    HCI_handle_error(status);
+    return;
+  }
+
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (!context) {
+    return;
+  }
+
+  AUTO_CONN_handle_disconnection(context);
+  GAP_handle_disconnection_complete(connection_handle, reason);
+  CONN_close(connection_handle);
 }
 
 void HCI_handle_connection_complete_event(uint8_t *parameters, uint8_t parameter_length) {
@@ -322,66 +431,316 @@ void HCI_handle_connection_complete_event(uint8_t *parameters, uint8_t parameter
   (void)parameter_length;
 }
 
+static void open_connection(uint8_t status, uint16_t connection_handle, uint8_t role, uint8_t peer_address_type,
+                            uint8_t *peer_address, uint8_t *link_parameters) {
+  /* A central link or a failed attempt, a cancel included, ends the initiator. A peripheral link ends legacy
+   * advertising, so does the timeout of high duty cycle directed advertising. */
+  bool initiator_ended = (status == HCI_ERROR_SUCCESS) ? role == CONN_ROLE_CENTRAL
+                                                       : status != STATUS_ADVERTISING_TIMEOUT;
+  if (initiator_ended) {
+    initiator_state = HCI_ROLE_OFF;
+    initiator_cancel_pending = false;
+  }
+  if ((status == HCI_ERROR_SUCCESS && role == CONN_ROLE_PERIPHERAL) || status == STATUS_ADVERTISING_TIMEOUT) {
+    advertiser_state = HCI_ROLE_OFF;
+  }
+  AUTO_CONN_handle_connection_complete(status, role, peer_address_type, peer_address);
+
+  if (status != HCI_ERROR_SUCCESS) {
+    HCI_handle_error(status);
+    return;
+  }
+
+  ConnectionContext *context = CONN_open(connection_handle);
+  if (!context) {
+    /* The controller accepted more links than we have slots for, drop the extra one. */
+    log_bl_error("No free connection slot for handle %d\r\n", connection_handle);
+    HCI_disconnect_async(connection_handle, CONN_DISCONNECT_REMOTE_DEVICE_TERMINATED);
+    return;
+  }
+
+  context->role = role;
+  context->peer_address_type = peer_address_type;
+  memcpy(context->peer_address, peer_address, sizeof(context->peer_address));
+  context->conn_interval = link_parameters[0] | (link_parameters[1] << 8);
+  context->conn_latency = link_parameters[2] | (link_parameters[3] << 8);
+  context->supervision_timeout = link_parameters[4] | (link_parameters[5] << 8);
+
+  GAP_handle_connection_complete(connection_handle);
+  LINK_start(connection_handle);
+}
+
 void HCI_handle_BLE_connection_complete(uint8_t *subevent_parameters, uint8_t subevent_length) {
-  (void)subevent_parameters;
-  (void)subevent_length;
+  if (subevent_length < 18) {
+    HCI_handle_error(HCI_ERROR_INVALID_PARAMETERS);
+    return;
+  }
+
+  /* Status, handle, role, peer address type, peer address, interval, latency, timeout, clock accuracy */
+  open_connection(subevent_parameters[0],
+                  (subevent_parameters[1] | (subevent_parameters[2] << 8)) & 0x0FFF,
+                  subevent_parameters[3],
+                  subevent_parameters[4],
+                  &subevent_parameters[5],
+                  &subevent_parameters[11]);
 }
 
 void HCI_handle_BLE_connection_update_complete(uint8_t *subevent_parameters, uint8_t subevent_length) {
-  (void)subevent_parameters;
-  (void)subevent_length;
+  if (subevent_length < 9) {
+    HCI_handle_error(HCI_ERROR_INVALID_PARAMETERS);
+    return;
+  }
+
+  uint8_t status = subevent_parameters[0];
+  uint16_t connection_handle = (subevent_parameters[1] | (subevent_parameters[2] << 8)) & 0x0FFF;
+
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (context) {
+    context->traffic.update_pending = false;
+  }
+  LINK_complete(connection_handle, LINK_PROC_CONN_PARAMS);
+
+  if (status != HCI_ERROR_SUCCESS) {
+    HCI_handle_error(status);
+    return;
+  }
+
+  if (!context) {
+    return;
+  }
+
+  context->conn_interval = subevent_parameters[3] | (subevent_parameters[4] << 8);
+  context->conn_latency = subevent_parameters[5] | (subevent_parameters[6] << 8);
+  context->supervision_timeout = subevent_parameters[7] | (subevent_parameters[8] << 8);
+
+  GAP_handle_connection_update(connection_handle);
 }
 
 void HCI_handle_BLE_enhanced_connection_complete(uint8_t *subevent_parameters, uint8_t subevent_length) {
-  (void)subevent_parameters;
-  (void)subevent_length;
+  if (subevent_length < 30) {
+    HCI_handle_error(HCI_ERROR_INVALID_PARAMETERS);
+    return;
+  }
+
+  /* Same as the legacy event with local and peer resolvable private addresses before the interval. */
+  open_connection(subevent_parameters[0],
+                  (subevent_parameters[1] | (subevent_parameters[2] << 8)) & 0x0FFF,
+                  subevent_parameters[3],
+                  subevent_parameters[4],
+                  &subevent_parameters[5],
+                  &subevent_parameters[23]);
 }
 
-void HCI_handle_event(HCIEvent *event) {
-  switch (event->event_code) {
-    case EVNT_BT_COMMAND_COMPLETE:
-      HCI_handle_command_complete_event(event->parameters, event->parameter_total_length);
+void HCI_handle_BLE_remote_connection_parameter_request(uint8_t *subevent_parameters, uint8_t subevent_length) {
+  if (subevent_length < 10) {
+    HCI_handle_error(HCI_ERROR_INVALID_PARAMETERS);
+    return;
+  }
+
+  uint16_t connection_handle = (subevent_parameters[0] | (subevent_parameters[1] << 8)) & 0x0FFF;
+  GAPConnectionParameters params = {
+    .interval_min = subevent_parameters[2] | (subevent_parameters[3] << 8),
+    .interval_max = subevent_parameters[4] | (subevent_parameters[5] << 8),
+    .latency = subevent_parameters[6] | (subevent_parameters[7] << 8),
+    .supervision_timeout = subevent_parameters[8] | (subevent_parameters[9] << 8),
+  };
+
+  /* The controller holds the LL procedure open until the reply, CONN_PARAMS_process sends it from the main loop
+   * where the application hook may run and the reply can wait for a command credit. */
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (context) {
+    context->peer_request.params = params;
+    context->peer_request.pending = true;
+  }
+}
+
+void HCI_handle_BLE_data_length_change(uint8_t *subevent_parameters, uint8_t subevent_length) {
+  if (subevent_length < 10) {
+    HCI_handle_error(HCI_ERROR_INVALID_PARAMETERS);
+    return;
+  }
+
+  uint16_t connection_handle = (subevent_parameters[0] | (subevent_parameters[1] << 8)) & 0x0FFF;
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (!context) {
+    return;
+  }
+
+  context->max_tx_octets = subevent_parameters[2] | (subevent_parameters[3] << 8);
+  context->max_tx_time = subevent_parameters[4] | (subevent_parameters[5] << 8);
+  context->max_rx_octets = subevent_parameters[6] | (subevent_parameters[7] << 8);
+  context->max_rx_time = subevent_parameters[8] | (subevent_parameters[9] << 8);
+
+  /* A controller never reports less than the default, guard the scheduler's division anyway. */
+  if (context->max_tx_octets < CONN_DEFAULT_DATA_LENGTH) {
+    context->max_tx_octets = CONN_DEFAULT_DATA_LENGTH;
+  }
+
+  LINK_complete(connection_handle, LINK_PROC_DATA_LENGTH);
+}
+
+void HCI_handle_BLE_phy_update_complete(uint8_t *subevent_parameters, uint8_t subevent_length) {
+  if (subevent_length < 5) {
+    HCI_handle_error(HCI_ERROR_INVALID_PARAMETERS);
+    return;
+  }
+
+  uint8_t status = subevent_parameters[0];
+  uint16_t connection_handle = (subevent_parameters[1] | (subevent_parameters[2] << 8)) & 0x0FFF;
+
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (context && status == HCI_ERROR_SUCCESS) {
+    context->tx_phy = subevent_parameters[3];
+    context->rx_phy = subevent_parameters[4];
+  }
+  LINK_complete(connection_handle, LINK_PROC_PHY);
+
+  if (status != HCI_ERROR_SUCCESS) {
+    HCI_handle_error(status);
+  }
+}
+
+void HCI_handle_BLE_advertising_report(uint8_t *subevent_parameters, uint8_t subevent_length) {
+  if (subevent_length < 1) {
+    HCI_handle_error(HCI_ERROR_INVALID_PARAMETERS);
+    return;
+  }
+
+  uint8_t num_reports = subevent_parameters[0];
+  uint16_t offset = 1;
+
+  /* Reports are packed back to back, each with its own data length. Walk them once and hand GAP a
+   * pointer into the event buffer, nothing is copied. */
+  for (uint8_t i = 0; i < num_reports; i++) {
+    if (offset + SCAN_REPORT_FIXED_SIZE > subevent_length) {
       break;
-    case EVNT_BT_COMMAND_STATUS:
-      HCI_handle_command_status_event(event->parameters, event->parameter_total_length);
+    }
+
+    uint8_t *report = &subevent_parameters[offset];
+    uint8_t data_length = report[8];
+    if (offset + SCAN_REPORT_FIXED_SIZE + data_length > subevent_length) {
       break;
-    case EVNT_BLE_EVENT_CODE:
-      uint8_t subevent_code = event->parameters[0];
-      uint8_t *subevent_parameters = &event->parameters[1];
-      uint16_t subevent_length = event->parameter_total_length - 1;
+    }
 
-      switch (subevent_code) {
-        case SUB_EVNT_BLE_CONNECTION_COMPLETE:
-          HCI_handle_BLE_connection_complete(subevent_parameters, subevent_length);
-          break;
+    GAP_handle_advertising_report(report[0], report[1], &report[2], &report[9], data_length,
+                                  (int8_t)report[9 + data_length]);
+    offset += SCAN_REPORT_FIXED_SIZE + data_length;
+  }
+}
 
-        case SUB_EVNT_BLE_CONNECTION_UPDATE_COMPLETE:
-          HCI_handle_BLE_connection_update_complete(subevent_parameters, subevent_length);
-          break;
+void HCI_handle_BLE_extended_advertising_report(uint8_t *subevent_parameters, uint8_t subevent_length) {
+  if (subevent_length < 1) {
+    HCI_handle_error(HCI_ERROR_INVALID_PARAMETERS);
+    return;
+  }
 
-        case SUB_EVNT_BLE_ENHANCED_CONNECTION_COMPLETED:
-          HCI_handle_BLE_enhanced_connection_complete(subevent_parameters, subevent_length);
-          break;
+  uint8_t num_reports = subevent_parameters[0];
+  uint16_t offset = 1;
 
-        default:
-          HCI_handle_error(HCI_ERROR_INVALID_EVENT);
-          break;
-      }
-      break;
-    case EVNT_BT_DISCONNECTION_COMPLETE:
+  /* Same walk as legacy reports. Fragments of a longer payload are collected by EXT_SCAN. */
+  for (uint8_t i = 0; i < num_reports; i++) {
+    if (offset + EXT_SCAN_REPORT_FIXED_SIZE > subevent_length) {
       break;
-    default:
-      HCI_handle_error(HCI_ERROR_INVALID_EVENT);
+    }
+
+    uint8_t *report = &subevent_parameters[offset];
+    uint8_t data_length = report[23];
+    if (offset + EXT_SCAN_REPORT_FIXED_SIZE + data_length > subevent_length) {
       break;
+    }
+
+    EXT_SCAN_handle_report(report[0] | (report[1] << 8), report[2], &report[3], report[11],
+                           &report[EXT_SCAN_REPORT_FIXED_SIZE], data_length, (int8_t)report[13]);
+    offset += EXT_SCAN_REPORT_FIXED_SIZE + data_length;
   }
 }
 
+void HCI_handle_BLE_advertising_set_terminated(uint8_t *subevent_parameters, uint8_t subevent_length) {
+  if (subevent_length < 5) {
+    HCI_handle_error(HCI_ERROR_INVALID_PARAMETERS);
+    return;
+  }
+
+  /* A connection ending a connectable set is reported by the connection complete event as well. */
+  EXT_ADV_handle_set_terminated(subevent_parameters[0], subevent_parameters[1]);
+}
+
+static void handle_le_meta_event(uint8_t *parameters, uint8_t parameter_length);
+
+/* Dispatch tables, indexed by (sub)event code. They are also the source of the event masks, so the
+ * controller only reports events that have a handler. */
+static HCIEventHandler event_handlers[HCI_MAX_EVENT_CODE + 1] = {
+  [EVNT_BT_DISCONNECTION_COMPLETE] = HCI_handle_disconnection_complete_event,
+  [EVNT_BT_COMMAND_COMPLETE] = HCI_handle_command_complete_event,
+  [EVNT_BT_COMMAND_STATUS] = HCI_handle_command_status_event,
+  [EVNT_BT_NUMBER_OF_COMPLETED_PACKETS] = HCI_ACL_handle_completed_packets,
+  [EVNT_BLE_EVENT_CODE] = handle_le_meta_event,
+};
+
+static HCIEventHandler le_event_handlers[HCI_MAX_LE_SUBEVENT + 1] = {
+  [SUB_EVNT_BLE_CONNECTION_COMPLETE] = HCI_handle_BLE_connection_complete,
+  [SUB_EVNT_BLE_ADVERTISING_REPORT] = HCI_handle_BLE_advertising_report,
+  [SUB_EVNT_BLE_CONNECTION_UPDATE_COMPLETE] = HCI_handle_BLE_connection_update_complete,
+  [SUB_EVNT_BLE_REMOTE_CONNECTION_PARAMETER_REQUEST] = HCI_handle_BLE_remote_connection_parameter_request,
+  [SUB_EVNT_BLE_DATA_LENGTH_CHANGE] = HCI_handle_BLE_data_length_change,
+  [SUB_EVNT_BLE_ENHANCED_CONNECTION_COMPLETED] = HCI_handle_BLE_enhanced_connection_complete,
+  [SUB_EVNT_BLE_PHY_UPDATE_COMPLETE] = HCI_handle_BLE_phy_update_complete,
+  [SUB_EVNT_BLE_EXTENDED_ADVERTISING_REPORT] = HCI_handle_BLE_extended_advertising_report,
+  [SUB_EVNT_BLE_ADVERTISING_SET_TERMINATED] = HCI_handle_BLE_advertising_set_terminated,
+};
+
+static void handle_le_meta_event(uint8_t *parameters, uint8_t parameter_length) {
+  if (parameter_length < 1) {
+    HCI_handle_error(HCI_ERROR_INVALID_PARAMETERS);
+    return;
+  }
+
+  uint8_t subevent_code = parameters[0];
+  if (subevent_code > HCI_MAX_LE_SUBEVENT || !le_event_handlers[subevent_code]) {
+    HCI_handle_error(HCI_ERROR_INVALID_EVENT);
+    return;
+  }
+
+  le_event_handlers[subevent_code](&parameters[1], parameter_length - 1);
+}
+
+void HCI_handle_event(HCIEvent *event) {
+  if (event->event_code > HCI_MAX_EVENT_CODE || !event_handlers[event->event_code]) {
+    HCI_handle_error(HCI_ERROR_INVALID_EVENT);
+    return;
+  }
+
+  event_handlers[event->event_code](event->parameters, event->parameter_total_length);
+}
+
+HCIError HCI_register_event_handler(uint8_t event_code, HCIEventHandler handler) {
+  if (event_code == 0 || event_code > HCI_MAX_EVENT_CODE) {
+    return HCI_ERROR_INVALID_PARAMETERS;
+  }
+
+  event_handlers[event_code] = handler;
+  return HCI_ERROR_SUCCESS;
+}
+
+HCIError HCI_register_le_event_handler(uint8_t subevent_code, HCIEventHandler handler) {
+  if (subevent_code == 0 || subevent_code > HCI_MAX_LE_SUBEVENT) {
+    return HCI_ERROR_INVALID_PARAMETERS;
+  }
+
+  le_event_handlers[subevent_code] = handler;
+  return HCI_ERROR_SUCCESS;
+}
+
 /***************************************************************************************
  * Hardware RX handling
  **************************************************************************************/
 
 void HCI_handle_hw_rx(uint8_t byte) {
-  rx_buffer[rx_count++] = byte;
+  /* Packets larger than the buffer are consumed but not stored, then dropped. */
+  if (rx_count < sizeof(rx_buffer)) {
+    rx_buffer[rx_count] = byte;
+  }
+  rx_count++;
   switch (rx_state) {
     case HW_RX_STATE_WAIT_TYPE:
       rx_count = 1;
@@ -418,13 +777,15 @@ void HCI_handle_hw_rx(uint8_t byte) {
     case HW_RX_STATE_WAIT_PAYLOAD:
       if (rx_count == rx_expected) {
         /* Call handler function. */
-        if (rx_buffer[0] == HCI_EVENT_PACKET) {
+        if (rx_expected > sizeof(rx_buffer)) {
+          log_bl_warning("Oversized HCI packet of %d bytes dropped\r\n", rx_expected);
+        } else if (rx_buffer[0] == HCI_EVENT_PACKET) {
           HCIEvent event = { .event_code = rx_buffer[1],
                              .parameter_total_length = rx_buffer[2],
                              .parameters = &rx_buffer[3] };
           HCI_handle_event(&event);
         } else if (rx_buffer[0] == HCI_ASYNC_DATA_PACKET) {
-          HCIAsyncData async_data = { .connection_handle = (rx_buffer[1] & 0xFF) | ((rx_buffer[2] << 8) & 0x0F),
+          HCIAsyncData async_data = { .connection_handle = rx_buffer[1] | ((rx_buffer[2] & 0x0F) << 8),
                                       .pb_flag = (rx_buffer[2] >> 4) & 0x03,
                                       .bc_flag = (rx_buffer[2] >> 6) & 0x03,
                                       .data_total_length = rx_buffer[3] | (rx_buffer[4] << 8),
@@ -443,8 +804,8 @@ void HCI_handle_hw_rx(uint8_t byte) {
   }
 }
 
-uint8_t HCI_buffer_space() {
-  return MAX_PACKET_SIZE - rx_count;
+uint16_t HCI_buffer_space() {
+  return (rx_count < sizeof(rx_buffer)) ? sizeof(rx_buffer) - rx_count : 0;
 }
 
 /***************************************************************************************
@@ -491,10 +852,84 @@ HCIError HCI_BLE_set_advertising_param(uint16_t adv_interval_min, uint16_t adv_i
   return status;
 }
 
+HCIError HCI_BLE_set_advertise_enable(bool enable) {
+  uint8_t params[1] = { enable ? 0x01 : 0x00 };
+
+  HCICommand cmd = { .op_code.raw = CMD_BLE_SET_ADVERTISE_ENABLE, .parameter_length = sizeof(params), .parameters = params };
+
+  role_request(&advertiser_state, enable);
+  HCIError status = HCI_send_command(&cmd);
+  if (status != HCI_ERROR_SUCCESS) {
+    role_settle(&advertiser_state, false);
+    return status;
+  }
+
+  HCI_wait_response();
+  return status;
+}
+
 /***************************************************************************************
  * Scanning handling
  **************************************************************************************/
 
+HCIError HCI_BLE_set_extended_scan_parameters(Scan_Type scan_type, uint16_t scan_interval_ms, uint16_t scan_window_ms,
+                                              Scan_OwnAddressType own_address_type,
+                                              Scan_FilterPolicy scanning_filter_policy, uint8_t phys) {
+  /* Convert milliseconds to bluetooth units. */
+  uint16_t scan_interval = (uint16_t)((scan_interval_ms * 16) / 10);
+  uint16_t scan_window = (uint16_t)((scan_window_ms * 16) / 10);
+
+  /* Only LE 1M and LE Coded carry primary advertising channels. */
+  phys &= PHY_PREFER_LE_1M | PHY_PREFER_LE_CODED;
+  if (phys == 0) {
+    return HCI_ERROR_INVALID_PARAMETERS;
+  }
+
+  uint8_t params[3 + 2 * 5];
+  uint8_t length = 3;
+  params[0] = own_address_type;
+  params[1] = scanning_filter_policy;
+  params[2] = phys;
+
+  /* One block per PHY in Scanning_PHYs, each PHY gets the same timing. */
+  for (uint8_t phy = PHY_PREFER_LE_1M; phy <= PHY_PREFER_LE_CODED; phy <<= 1) {
+    if (phys & phy) {
+      params[length++] = scan_type;
+      params[length++] = scan_interval & 0xFF;
+      params[length++] = (scan_interval >> 8) & 0xFF;
+      params[length++] = scan_window & 0xFF;
+      params[length++] = (scan_window >> 8) & 0xFF;
+    }
+  }
+
+  HCICommand cmd = { .op_code.raw = CMD_BLE_SET_EXTENDED_SCAN_PARAMETERS, .parameter_length = length, .parameters = params };
+
+  HCIError status = HCI_send_command(&cmd);
+  if (status != HCI_ERROR_SUCCESS) {
+    return status;
+  }
+
+  HCI_wait_response();
+  return status;
+}
+
+HCIError HCI_BLE_set_extended_scan_enable(bool enable, bool filter_duplicates) {
+  /* Duration and period zero: scan until disabled. */
+  uint8_t params[6] = { enable ? 0x01 : 0x00, filter_duplicates ? 0x01 : 0x00, 0, 0, 0, 0 };
+
+  HCICommand cmd = { .op_code.raw = CMD_BLE_SET_EXTENDED_SCAN_ENABLE, .parameter_length = sizeof(params), .parameters = params };
+
+  role_request(&scanner_state, enable);
+  HCIError status = HCI_send_command(&cmd);
+  if (status != HCI_ERROR_SUCCESS) {
+    role_settle(&scanner_state, false);
+    return status;
+  }
+
+  HCI_wait_response();
+  return status;
+}
+
 HCIError HCI_BLE_set_scan_parameters(Scan_Type scan_type, uint16_t scan_interval_ms, uint16_t scan_window_ms,
                                      Scan_OwnAddressType own_address_type, Scan_FilterPolicy scanning_filter_policy) {
   /* Convert milliseconds to bluetooth units. */
@@ -528,8 +963,10 @@ HCIError HCI_BLE_set_scan_enable(bool enable, bool filter_duplicates) {
 
   HCICommand cmd = { .op_code.raw = CMD_BLE_SET_SCAN_ENABLE, .parameter_length = sizeof(params), .parameters = params };
 
+  role_request(&scanner_state, enable);
   HCIError status = HCI_send_command(&cmd);
   if (status != HCI_ERROR_SUCCESS) {
+    role_settle(&scanner_state, false);
     return status;
   }
 
@@ -541,49 +978,56 @@ HCIError HCI_BLE_set_scan_enable(bool enable, bool filter_duplicates) {
  * Connection handling
  **************************************************************************************/
 
+static void encode_create_connection(uint8_t *params, uint16_t scan_interval_ms, uint16_t scan_window_ms,
+                                     Conn_InitiatorFilterPolicy filter_policy, Conn_PeerAddressType peer_address_type,
+                                     uint8_t *peer_address, Conn_OwnAddressType own_address_type,
+                                     uint16_t conn_interval_min_ms, uint16_t conn_interval_max_ms,
+                                     uint16_t conn_latency, uint16_t supervision_timeout_ms) {
+  /* Convert milliseconds to bluetooth units */
+  uint16_t scan_interval = (uint16_t)((scan_interval_ms * 16) / 10);
+  uint16_t scan_window = (uint16_t)((scan_window_ms * 16) / 10);
+  uint16_t conn_interval_min = (uint16_t)((conn_interval_min_ms * 4) / 5); /* 1.25 ms units */
+  uint16_t conn_interval_max = (uint16_t)((conn_interval_max_ms * 4) / 5); /* 1.25 ms units */
+  uint16_t supervision_timeout = (uint16_t)(supervision_timeout_ms / 10);  /* 10 ms units */
+
+  params[0] = scan_interval & 0xFF;
+  params[1] = (scan_interval >> 8) & 0xFF;
+  params[2] = scan_window & 0xFF;
+  params[3] = (scan_window >> 8) & 0xFF;
+  params[4] = filter_policy;
+  params[5] = peer_address_type;
+  memcpy(&params[6], peer_address, 6); /* Peer address */
+  params[12] = own_address_type;
+  params[13] = conn_interval_min & 0xFF;
+  params[14] = (conn_interval_min >> 8) & 0xFF;
+  params[15] = conn_interval_max & 0xFF;
+  params[16] = (conn_interval_max >> 8) & 0xFF;
+  params[17] = conn_latency & 0xFF;
+  params[18] = (conn_latency >> 8) & 0xFF;
+  params[19] = supervision_timeout & 0xFF;
+  params[20] = (supervision_timeout >> 8) & 0xFF;
+  params[21] = 0x00;
+  params[22] = 0x00; /* Minimum CE length */
+  params[23] = 0x00;
+  params[24] = 0x00; /* Maximum CE length */
+}
+
 HCIError HCI_BLE_create_connection(uint16_t scan_interval_ms, uint16_t scan_window_ms,
                                    Conn_InitiatorFilterPolicy filter_policy, Conn_PeerAddressType peer_address_type,
                                    uint8_t *peer_address, Conn_OwnAddressType own_address_type,
                                    uint16_t conn_interval_min_ms, uint16_t conn_interval_max_ms, uint16_t conn_latency,
                                    uint16_t supervision_timeout_ms) {
-  /* Convert milliseconds to bluetooth units */
-  uint16_t scan_interval = (uint16_t)((scan_interval_ms * 16) / 10);
-  uint16_t scan_window = (uint16_t)((scan_window_ms * 16) / 10);
-  uint16_t conn_interval_min = (uint16_t)((conn_interval_min_ms * 16) / 10);
-  uint16_t conn_interval_max = (uint16_t)((conn_interval_max_ms * 16) / 10);
-
-  uint8_t params[25] = {
-    scan_interval & 0xFF,
-    (scan_interval >> 8) & 0xFF,
-    scan_window & 0xFF,
-    (scan_window >> 8) & 0xFF,
-    filter_policy,
-    peer_address_type,
-    peer_address[0],
-    peer_address[1],
-    peer_address[2], /* Peer address */
-    peer_address[3],
-    peer_address[4],
-    peer_address[5],
-    own_address_type,
-    conn_interval_min & 0xFF,
-    (conn_interval_min >> 8) & 0xFF,
-    conn_interval_max & 0xFF,
-    (conn_interval_max >> 8) & 0xFF,
-    conn_latency & 0xFF,
-    (conn_latency >> 8) & 0xFF,
-    supervision_timeout_ms & 0xFF,
-    (supervision_timeout_ms >> 8) & 0xFF,
-    0x00,
-    0x00, /* Minimum CE length */
-    0x00,
-    0x00 /* Maximum CE length */
-  };
+  uint8_t params[25];
+  encode_create_connection(params, scan_interval_ms, scan_window_ms, filter_policy, peer_address_type, peer_address,
+                           own_address_type, conn_interval_min_ms, conn_interval_max_ms, conn_latency,
+                           supervision_timeout_ms);
 
   HCICommand cmd = { .op_code.raw = CMD_BLE_CREATE_CONNECTION, .parameter_length = sizeof(params), .parameters = params };
 
+  role_request(&initiator_state, true);
   HCIError status = HCI_send_command(&cmd);
   if (status != HCI_ERROR_SUCCESS) {
+    role_settle(&initiator_state, false);
     return status;
   }
 
@@ -591,28 +1035,92 @@ HCIError HCI_BLE_create_connection(uint16_t scan_interval_ms, uint16_t scan_wind
   return status;
 }
 
+HCIError HCI_BLE_create_connection_async(uint16_t scan_interval_ms, uint16_t scan_window_ms,
+                                         Conn_InitiatorFilterPolicy filter_policy,
+                                         Conn_PeerAddressType peer_address_type, uint8_t *peer_address,
+                                         Conn_OwnAddressType own_address_type, uint16_t conn_interval_min_ms,
+                                         uint16_t conn_interval_max_ms, uint16_t conn_latency,
+                                         uint16_t supervision_timeout_ms) {
+  uint8_t params[25];
+  encode_create_connection(params, scan_interval_ms, scan_window_ms, filter_policy, peer_address_type, peer_address,
+                           own_address_type, conn_interval_min_ms, conn_interval_max_ms, conn_latency,
+                           supervision_timeout_ms);
+
+  HCICommand cmd = { .op_code.raw = CMD_BLE_CREATE_CONNECTION, .parameter_length = sizeof(params), .parameters = params };
+
+  role_request(&initiator_state, true);
+  HCIError status = HCI_send_command_async(&cmd);
+  if (status != HCI_ERROR_SUCCESS) {
+    role_settle(&initiator_state, false);
+  }
+  return status;
+}
+
+HCIError HCI_BLE_create_connection_cancel_async(void) {
+  HCICommand cmd = { .op_code.raw = CMD_BLE_CREATE_CONNECTION_CANCEL, .parameter_length = 0, .parameters = NULL };
+
+  /* The initiator stops with the connection complete event that follows, not with this command. While
+   * LE Create Connection awaits its status the initiator is still starting, the status moves it on. */
+  if (initiator_state == HCI_ROLE_OFF) {
+    return HCI_send_command_async(&cmd);
+  }
+
+  initiator_cancel_pending = true;
+  if (initiator_state == HCI_ROLE_ON) {
+    initiator_state = HCI_ROLE_STOPPING;
+  }
+  HCIError status = HCI_send_command_async(&cmd);
+  if (status != HCI_ERROR_SUCCESS) {
+    initiator_cancel_pending = false;
+    if (initiator_state == HCI_ROLE_STOPPING) {
+      initiator_state = HCI_ROLE_ON;
+    }
+  }
+  return status;
+}
+
+static void encode_connection_parameters(uint8_t *params, uint16_t connection_handle, uint16_t conn_interval_min,
+                                         uint16_t conn_interval_max, uint16_t conn_latency,
+                                         uint16_t supervision_timeout) {
+  /* Shared layout of LE Connection Update and LE Remote Connection Parameter Request Reply */
+  params[0] = connection_handle & 0xFF;
+  params[1] = (connection_handle >> 8) & 0xFF;
+  params[2] = conn_interval_min & 0xFF;
+  params[3] = (conn_interval_min >> 8) & 0xFF;
+  params[4] = conn_interval_max & 0xFF;
+  params[5] = (conn_interval_max >> 8) & 0xFF;
+  params[6] = conn_latency & 0xFF;
+  params[7] = (conn_latency >> 8) & 0xFF;
+  params[8] = supervision_timeout & 0xFF;
+  params[9] = (supervision_timeout >> 8) & 0xFF;
+  params[10] = 0x00;
+  params[11] = 0x00; /* Minimum CE length */
+  params[12] = 0x00;
+  params[13] = 0x00; /* Maximum CE length */
+}
+
+HCIError HCI_BLE_connection_update_async(uint16_t connection_handle, uint16_t conn_interval_min,
+                                         uint16_t conn_interval_max, uint16_t conn_latency,
+                                         uint16_t supervision_timeout) {
+  uint8_t params[14];
+  encode_connection_parameters(params, connection_handle, conn_interval_min, conn_interval_max, conn_latency,
+                               supervision_timeout);
+
+  HCICommand cmd = { .op_code.raw = CMD_BLE_CONNECTION_UPDATE, .parameter_length = sizeof(params), .parameters = params };
+
+  return HCI_send_command_async(&cmd);
+}
+
 HCIError HCI_BLE_connection_update(uint16_t connection_handle, uint16_t conn_interval_min_ms, uint16_t conn_interval_max_ms,
                                    uint16_t conn_latency, uint16_t supervision_timeout_ms) {
   /* Convert milliseconds to bluetooth units */
-  uint16_t conn_interval_min = (uint16_t)((conn_interval_min_ms * 16) / 10);
-  uint16_t conn_interval_max = (uint16_t)((conn_interval_max_ms * 16) / 10);
-
-  uint8_t params[14] = {
-    connection_handle & 0xFF,
-    (connection_handle >> 8) & 0xFF,
-    conn_interval_min & 0xFF,
-    (conn_interval_min >> 8) & 0xFF,
-    conn_interval_max & 0xFF,
-    (conn_interval_max >> 8) & 0xFF,
-    conn_latency & 0xFF,
-    (conn_latency >> 8) & 0xFF,
-    supervision_timeout_ms & 0xFF,
-    (supervision_timeout_ms >> 8) & 0xFF,
-    0x00,
-    0x00, /* Minimum CE length */
-    0x00,
-    0x00 /* Maximum CE length */
-  };
+  uint16_t conn_interval_min = (uint16_t)((conn_interval_min_ms * 4) / 5); /* 1.25 ms units */
+  uint16_t conn_interval_max = (uint16_t)((conn_interval_max_ms * 4) / 5); /* 1.25 ms units */
+  uint16_t supervision_timeout = (uint16_t)(supervision_timeout_ms / 10);  /* 10 ms units */
+
+  uint8_t params[14];
+  encode_connection_parameters(params, connection_handle, conn_interval_min, conn_interval_max, conn_latency,
+                               supervision_timeout);
 
   HCICommand cmd = { .op_code.raw = CMD_BLE_CONNECTION_UPDATE, .parameter_length = sizeof(params), .parameters = params };
 
@@ -625,6 +1133,137 @@ HCIError HCI_BLE_connection_update(uint16_t connection_handle, uint16_t conn_int
   return status;
 }
 
+HCIError HCI_BLE_remote_connection_parameter_request_reply(uint16_t connection_handle, uint16_t conn_interval_min,
+                                                           uint16_t conn_interval_max, uint16_t conn_latency,
+                                                           uint16_t supervision_timeout) {
+  uint8_t params[14];
+  encode_connection_parameters(params, connection_handle, conn_interval_min, conn_interval_max, conn_latency,
+                               supervision_timeout);
+
+  HCICommand cmd = { .op_code.raw = CMD_BLE_REMOTE_CONNECTION_PARAMETER_REQUEST_REPLY,
+                     .parameter_length = sizeof(params),
+                     .parameters = params };
+
+  return HCI_send_command_async(&cmd);
+}
+
+HCIError HCI_BLE_remote_connection_parameter_request_negative_reply(uint16_t connection_handle,
+                                                                    Conn_ParamRejectReason reason) {
+  uint8_t params[3];
+  params[0] = connection_handle & 0xFF;
+  params[1] = (connection_handle >> 8) & 0xFF;
+  params[2] = reason;
+
+  HCICommand cmd = { .op_code.raw = CMD_BLE_REMOTE_CONNECTION_PARAMETER_REQUEST_NEGATIVE_REPLY,
+                     .parameter_length = sizeof(params),
+                     .parameters = params };
+
+  return HCI_send_command_async(&cmd);
+}
+
+HCIError HCI_BLE_read_maximum_data_length(uint16_t *max_tx_octets, uint16_t *max_tx_time) {
+  if (max_tx_octets == NULL || max_tx_time == NULL) {
+    return HCI_ERROR_INVALID_PARAMETERS;
+  }
+
+  HCICommand cmd = { .op_code.raw = CMD_BLE_READ_MAXIMUM_DATA_LENGTH, .parameter_length = 0, .parameters = NULL };
+
+  HCIError status = HCI_send_command(&cmd);
+  if (status != HCI_ERROR_SUCCESS) {
+    return status;
+  }
+
+  HCI_wait_response();
+
+  /* Controllers before 4.2 answer with Unknown HCI Command. */
+  if (rx_buffer[6] != HCI_ERROR_SUCCESS) {
+    return HCI_ERROR_UNKNOWN_COMMAND;
+  }
+
+  *max_tx_octets = rx_buffer[7] | (rx_buffer[8] << 8);
+  *max_tx_time = rx_buffer[9] | (rx_buffer[10] << 8);
+
+  return status;
+}
+
+uint16_t HCI_BLE_get_suggested_data_length(void) {
+  return le_data_length;
+}
+
+HCIError HCI_BLE_write_suggested_default_data_length(uint16_t tx_octets, uint16_t tx_time) {
+  uint8_t params[4];
+  params[0] = tx_octets & 0xFF;
+  params[1] = (tx_octets >> 8) & 0xFF;
+  params[2] = tx_time & 0xFF;
+  params[3] = (tx_time >> 8) & 0xFF;
+
+  HCICommand cmd = { .op_code.raw = CMD_BLE_WRITE_SUGGESTED_DEFAULT_DATA_LENGTH,
+                     .parameter_length = sizeof(params),
+                     .parameters = params };
+
+  HCIError status = HCI_send_command(&cmd);
+  if (status != HCI_ERROR_SUCCESS) {
+    return status;
+  }
+
+  HCI_wait_response();
+  return status;
+}
+
+HCIError HCI_BLE_set_data_length_async(uint16_t connection_handle, uint16_t tx_octets, uint16_t tx_time) {
+  uint8_t params[6];
+  params[0] = connection_handle & 0xFF;
+  params[1] = (connection_handle >> 8) & 0xFF;
+  params[2] = tx_octets & 0xFF;
+  params[3] = (tx_octets >> 8) & 0xFF;
+  params[4] = tx_time & 0xFF;
+  params[5] = (tx_time >> 8) & 0xFF;
+
+  HCICommand cmd = { .op_code.raw = CMD_BLE_SET_DATA_LENGTH, .parameter_length = sizeof(params), .parameters = params };
+
+  return HCI_send_command_async(&cmd);
+}
+
+HCIError HCI_BLE_set_default_phy(uint8_t tx_phys, uint8_t rx_phys) {
+  uint8_t params[3] = { 0x00, tx_phys, rx_phys }; /* All PHYs: both preferences given */
+
+  HCICommand cmd = { .op_code.raw = CMD_BLE_SET_DEFAULT_PHY, .parameter_length = sizeof(params), .parameters = params };
+
+  HCIError status = HCI_send_command(&cmd);
+  if (status != HCI_ERROR_SUCCESS) {
+    return status;
+  }
+
+  HCI_wait_response();
+  return status;
+}
+
+HCIError HCI_BLE_set_phy_async(uint16_t connection_handle, uint8_t tx_phys, uint8_t rx_phys) {
+  uint8_t params[7];
+  params[0] = connection_handle & 0xFF;
+  params[1] = (connection_handle >> 8) & 0xFF;
+  params[2] = 0x00; /* All PHYs: both preferences given */
+  params[3] = tx_phys;
+  params[4] = rx_phys;
+  params[5] = 0x00;
+  params[6] = 0x00; /* PHY options: no coded PHY preference */
+
+  HCICommand cmd = { .op_code.raw = CMD_BLE_SET_PHY, .parameter_length = sizeof(params), .parameters = params };
+
+  return HCI_send_command_async(&cmd);
+}
+
+HCIError HCI_disconnect_async(uint16_t connection_handle, Conn_DisconnectReason reason) {
+  uint8_t params[3];
+  params[0] = connection_handle & 0xFF;
+  params[1] = (connection_handle >> 8) & 0xFF;
+  params[2] = reason;
+
+  HCICommand cmd = { .op_code.raw = CMD_BT_DISCONNECT, .parameter_length = sizeof(params), .parameters = params };
+
+  return HCI_send_command_async(&cmd);
+}
+
 HCIError HCI_disconnect(uint16_t connection_handle, Conn_DisconnectReason reason) {
   uint8_t params[3];
   params[0] = connection_handle & 0xFF;
@@ -643,13 +1282,16 @@ HCIError HCI_disconnect(uint16_t connection_handle, Conn_DisconnectReason reason
 }
 
 /***************************************************************************************
- * Set Event Mask
+ * Event masks
  **************************************************************************************/
 
-HCIError HCI_BLE_set_event_mask(uint8_t mask) {
-  uint8_t params[8] = { mask, 0, 0, 0, 0, 0, 0, 0 };
+static HCIError send_event_mask(uint16_t op_code, uint64_t mask) {
+  uint8_t params[8];
+  for (uint8_t i = 0; i < sizeof(params); i++) {
+    params[i] = (mask >> (8 * i)) & 0xFF;
+  }
 
-  HCICommand cmd = { .op_code.raw = CMD_BLE_SET_EVENT_MASK, .parameter_length = sizeof(params), .parameters = params };
+  HCICommand cmd = { .op_code.raw = op_code, .parameter_length = sizeof(params), .parameters = params };
 
   HCIError status = HCI_send_command(&cmd);
   if (status != HCI_ERROR_SUCCESS) {
@@ -660,6 +1302,76 @@ HCIError HCI_BLE_set_event_mask(uint8_t mask) {
   return status;
 }
 
+HCIError HCI_BLE_set_event_mask(uint64_t mask) {
+  return send_event_mask(CMD_BLE_SET_EVENT_MASK, mask);
+}
+
+HCIError HCI_set_event_mask(uint64_t mask) {
+  return send_event_mask(CMD_BT_SET_EVENT_MASK, mask);
+}
+
+HCIError HCI_set_event_mask_page_2(uint64_t mask) {
+  return send_event_mask(CMD_BT_SET_EVENT_MASK_PAGE_2, mask);
+}
+
+void HCI_build_event_masks(HCIEventMasks *masks) {
+  masks->event_mask = 0;
+  masks->event_mask_page_2 = 0;
+  masks->le_event_mask = 0;
+
+  for (uint8_t code = 1; code <= HCI_MAX_EVENT_CODE; code++) {
+    if (!event_handlers[code]) {
+      continue;
+    }
+
+    switch (code) {
+      case EVNT_BT_COMMAND_COMPLETE:
+      case EVNT_BT_COMMAND_STATUS:
+      case EVNT_BT_NUMBER_OF_COMPLETED_PACKETS:
+        /* Always reported, their mask bits are reserved. */
+        break;
+
+      default:
+        if (code < 0x40) {
+          masks->event_mask |= 1ULL << (code - 1);
+        } else {
+          masks->event_mask_page_2 |= 1ULL << (code - 0x40);
+        }
+        break;
+    }
+  }
+
+  for (uint8_t code = 1; code <= HCI_MAX_LE_SUBEVENT; code++) {
+    if (le_event_handlers[code]) {
+      masks->le_event_mask |= 1ULL << (code - 1);
+    }
+  }
+
+  /* The LE Meta event is the only way LE subevents reach us. */
+  if (masks->le_event_mask == 0) {
+    masks->event_mask &= ~(1ULL << (EVNT_BLE_EVENT_CODE - 1));
+  }
+}
+
+HCIError HCI_apply_event_masks(void) {
+  HCIEventMasks masks;
+  HCI_build_event_masks(&masks);
+
+  HCIError status = HCI_set_event_mask(masks.event_mask);
+  if (status != HCI_ERROR_SUCCESS) {
+    return status;
+  }
+
+  if (masks.event_mask_page_2 != 0 && HCI_CAPS_command_supported(HCI_CAPS_CMD_SET_EVENT_MASK_PAGE_2)) {
+    status = HCI_set_event_mask_page_2(masks.event_mask_page_2);
+    if (status != HCI_ERROR_SUCCESS) {
+      return status;
+    }
+  }
+
+  return HCI_BLE_set_event_mask(masks.le_event_mask);
+}
+
 /***************************************************************************************
  * BCM4345 firmware handling
  **************************************************************************************/
@@ -836,6 +1548,8 @@ HCIError HCI_get_bt_addr(uint8_t *bt_addr) {
 HCIError HCI_init(void) {
   HCIError status;
   hw_init();
+  CONN_init();
+  HCI_ACL_init();
 
   status = HCI_reset();
   hw_delay_ms(150);
@@ -849,6 +1563,40 @@ HCIError HCI_init(void) {
   hw_delay_ms(1000);
   hci_state = HCI_STATE_ON;
 
+  status = HCI_CAPS_discover();
+  if (status != HCI_ERROR_SUCCESS) {
+    log_bl_error("Failed to read controller capabilities %d\r\n", status);
+    return status;
+  }
+
+  /* The controller's default masks leave out LE events entirely. */
+  status = HCI_apply_event_masks();
+  if (status != HCI_ERROR_SUCCESS) {
+    log_bl_error("Failed to set event masks %d\r\n", status);
+    return status;
+  }
+
+  /* The controller keeps its accept list across a reset of the host, start both from empty. */
+  if (ACCEPT_LIST_init() != HCI_ERROR_SUCCESS) {
+    log_bl_warning("Failed to reset the accept list\r\n");
+  }
+
+  /* Data Length Extension is optional, links fall back to 27 byte PDUs without it. */
+  uint16_t max_tx_octets, max_tx_time;
+  if (HCI_CAPS_le_feature_supported(HCI_LE_FEATURE_DATA_LENGTH_EXTENSION) &&
+      HCI_BLE_read_maximum_data_length(&max_tx_octets, &max_tx_time) == HCI_ERROR_SUCCESS) {
+    le_data_length = (max_tx_octets < BT_LE_MAX_DATA_LENGTH) ? max_tx_octets : BT_LE_MAX_DATA_LENGTH;
+    if (le_data_length < CONN_DEFAULT_DATA_LENGTH) {
+      le_data_length = CONN_DEFAULT_DATA_LENGTH;
+    }
+    HCI_BLE_write_suggested_default_data_length(le_data_length, LE_1M_PDU_TIME(le_data_length));
+  }
+
+  /* Lets the controller accept peer-initiated PHY updates to every PHY we allow. */
+  if (HCI_CAPS_command_supported(HCI_CAPS_CMD_LE_SET_DEFAULT_PHY)) {
+    HCI_BLE_set_default_phy(BT_LE_PREFERRED_PHYS, BT_LE_PREFERRED_PHYS);
+  }
+
   /* Reset */
   return status;
 }
@@ -0,0 +1,329 @@
+#include "hci_acl.h"
+
+#include <string.h>
+
+#include "connection.h"
+#include "log_bl.h"
+
+typedef struct {
+  uint8_t data[L2CAP_MAX_PDU_SIZE];
+  uint16_t length;
+  uint8_t next;
+} HCI_ACLBuffer;
+
+static HCI_ACLBuffer acl_pool[HCI_ACL_POOL_SIZE];
+static uint8_t free_head = HCI_ACL_NO_BUFFER;
+
+static uint8_t round_robin_next[HCI_ACL_PRIORITY_COUNT];
+
+static uint16_t acl_data_length = HCI_ACL_DEFAULT_DATA_LENGTH;
+static uint8_t acl_total_credits = HCI_ACL_DEFAULT_NUM_PACKETS;
+
+/***************************************************************************************
+ * Buffer pool
+ **************************************************************************************/
+
+static uint8_t buffer_alloc(void) {
+  uint8_t index = free_head;
+  if (index != HCI_ACL_NO_BUFFER) {
+    free_head = acl_pool[index].next;
+    acl_pool[index].next = HCI_ACL_NO_BUFFER;
+  }
+  return index;
+}
+
+static void buffer_free(uint8_t index) {
+  acl_pool[index].next = free_head;
+  free_head = index;
+}
+
+/***************************************************************************************
+ * Queue handling
+ **************************************************************************************/
+
+/* Completed packets events arrive from the UART interrupt, which only advances packets_completed while the
+ * main loop only advances packets_sent. The difference is the queue's share of the controller buffers. */
+static uint8_t packets_in_flight(HCI_ACLQueue *queue) {
+  return (uint8_t)(queue->packets_sent - queue->packets_completed);
+}
+
+/* Priority class the queue would send from next, or HCI_ACL_PRIORITY_COUNT if it has nothing to send. */
+static uint8_t queue_priority(HCI_ACLQueue *queue) {
+  if (queue->current != HCI_ACL_NO_BUFFER) {
+    return queue->current_priority;
+  }
+
+  for (uint8_t p = 0; p < HCI_ACL_PRIORITY_COUNT; p++) {
+    if (queue->head[p] != HCI_ACL_NO_BUFFER) {
+      return p;
+    }
+  }
+  return HCI_ACL_PRIORITY_COUNT;
+}
+
+static ConnectionContext *select_next_connection(void) {
+  for (uint8_t p = 0; p < HCI_ACL_PRIORITY_COUNT; p++) {
+    for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+      uint8_t slot = (round_robin_next[p] + i) % MAX_CONNECTIONS;
+      ConnectionContext *context = CONN_get_slot(slot);
+
+      if (context && queue_priority(&context->tx) == p) {
+        round_robin_next[p] = (slot + 1) % MAX_CONNECTIONS;
+        return context;
+      }
+    }
+  }
+  return NULL;
+}
+
+static HCIError send_fragment(ConnectionContext *context) {
+  HCI_ACLQueue *queue = &context->tx;
+
+  if (queue->current == HCI_ACL_NO_BUFFER) {
+    uint8_t p = queue_priority(queue);
+    queue->current = queue->head[p];
+    queue->current_priority = p;
+    queue->current_offset = 0;
+
+    queue->head[p] = acl_pool[queue->current].next;
+    if (queue->head[p] == HCI_ACL_NO_BUFFER) {
+      queue->tail[p] = HCI_ACL_NO_BUFFER;
+    }
+    queue->queued--;
+  }
+
+  HCI_ACLBuffer *buffer = &acl_pool[queue->current];
+  uint16_t remaining = buffer->length - queue->current_offset;
+
+  /* Cut fragments on LL PDU boundaries so the controller never sends a runt PDU per fragment. */
+  uint16_t max_fragment = acl_data_length;
+  if (context->max_tx_octets < max_fragment) {
+    max_fragment -= max_fragment % context->max_tx_octets;
+  }
+  uint16_t fragment_length = (remaining > max_fragment) ? max_fragment : remaining;
+
+  HCIAsyncData acl = { .connection_handle = context->connection_handle,
+                       .pb_flag = (queue->current_offset == 0) ? 0x00 : 0x01, /* First / continuing fragment */
+                       .bc_flag = 0x00,
+                       .data_total_length = fragment_length,
+                       .data = &buffer->data[queue->current_offset] };
+
+  HCIError status = HCI_send_async_data(&acl);
+  if (status != HCI_ERROR_SUCCESS) {
+    return status;
+  }
+
+  queue->packets_sent++;
+  queue->current_offset += fragment_length;
+
+  if (queue->current_offset >= buffer->length) {
+    buffer_free(queue->current);
+    queue->current = HCI_ACL_NO_BUFFER;
+    queue->current_priority = HCI_ACL_PRIORITY_COUNT;
+    queue->current_offset = 0;
+  }
+  return HCI_ERROR_SUCCESS;
+}
+
+/***************************************************************************************
+ * Public API
+ **************************************************************************************/
+
+void HCI_ACL_init(void) {
+  free_head = HCI_ACL_NO_BUFFER;
+  for (uint8_t i = HCI_ACL_POOL_SIZE; i > 0; i--) {
+    buffer_free(i - 1);
+  }
+
+  memset(round_robin_next, 0, sizeof(round_robin_next));
+
+  acl_data_length = HCI_ACL_DEFAULT_DATA_LENGTH;
+  acl_total_credits = HCI_ACL_DEFAULT_NUM_PACKETS;
+}
+
+void HCI_ACL_queue_init(HCI_ACLQueue *queue) {
+  queue->queued = 0;
+  queue->current = HCI_ACL_NO_BUFFER;
+  queue->current_priority = HCI_ACL_PRIORITY_COUNT;
+  queue->current_offset = 0;
+  queue->packets_sent = 0;
+  queue->packets_completed = 0;
+  for (uint8_t p = 0; p < HCI_ACL_PRIORITY_COUNT; p++) {
+    queue->head[p] = HCI_ACL_NO_BUFFER;
+    queue->tail[p] = HCI_ACL_NO_BUFFER;
+  }
+}
+
+void HCI_ACL_set_buffer_size(uint16_t data_packet_length, uint8_t total_num_packets) {
+  if (data_packet_length == 0 || total_num_packets == 0) {
+    return;
+  }
+
+  /* HCI_send_async_data encodes into a 256 byte packet, 5 of which are the ACL header. */
+  if (data_packet_length > 251) {
+    data_packet_length = 251;
+  }
+
+  acl_data_length = data_packet_length;
+  acl_total_credits = total_num_packets;
+}
+
+uint8_t HCI_ACL_reserve(uint8_t **payload) {
+  if (payload == NULL) {
+    return HCI_ACL_NO_BUFFER;
+  }
+
+  uint8_t index = buffer_alloc();
+  *payload = (index != HCI_ACL_NO_BUFFER) ? &acl_pool[index].data[L2CAP_HEADER_SIZE] : NULL;
+  return index;
+}
+
+void HCI_ACL_release(uint8_t buffer_index) {
+  if (buffer_index < HCI_ACL_POOL_SIZE) {
+    buffer_free(buffer_index);
+  }
+}
+
+HCIError HCI_ACL_commit(uint16_t connection_handle, uint16_t cid, HCI_ACLPriority priority, uint8_t buffer_index,
+                        uint16_t length) {
+  if (buffer_index >= HCI_ACL_POOL_SIZE) {
+    return HCI_ERROR_INVALID_PARAMETERS;
+  }
+
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  HCIError status = HCI_ERROR_SUCCESS;
+  if (!context || priority >= HCI_ACL_PRIORITY_COUNT || length > HCI_ACL_MAX_PAYLOAD) {
+    status = HCI_ERROR_INVALID_PARAMETERS;
+  } else if (priority > HCI_ACL_PRIORITY_ATT_RESPONSE && context->tx.queued >= HCI_ACL_LINK_QUEUE_LIMIT) {
+    /* Keep one chatty connection from taking the whole pool. Signaling and ATT responses are exempt. */
+    status = HCI_ERROR_BUSY;
+  }
+
+  if (status != HCI_ERROR_SUCCESS) {
+    buffer_free(buffer_index);
+    return status;
+  }
+  HCI_ACLQueue *queue = &context->tx;
+
+  HCI_ACLBuffer *buffer = &acl_pool[buffer_index];
+  buffer->data[0] = length & 0xFF;
+  buffer->data[1] = (length >> 8) & 0xFF;
+  buffer->data[2] = cid & 0xFF;
+  buffer->data[3] = (cid >> 8) & 0xFF;
+  buffer->length = length + L2CAP_HEADER_SIZE;
+
+  if (queue->tail[priority] == HCI_ACL_NO_BUFFER) {
+    queue->head[priority] = buffer_index;
+  } else {
+    acl_pool[queue->tail[priority]].next = buffer_index;
+  }
+  queue->tail[priority] = buffer_index;
+  queue->queued++;
+
+  context->traffic.tx_bytes += length;
+  if (queue->queued > context->traffic.peak_queued) {
+    context->traffic.peak_queued = queue->queued;
+  }
+  return HCI_ERROR_SUCCESS;
+}
+
+HCIError HCI_ACL_enqueue(uint16_t connection_handle, uint16_t cid, HCI_ACLPriority priority, uint8_t *payload,
+                         uint16_t length) {
+  if (payload == NULL || priority >= HCI_ACL_PRIORITY_COUNT || length > HCI_ACL_MAX_PAYLOAD) {
+    return HCI_ERROR_INVALID_PARAMETERS;
+  }
+
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (!context) {
+    return HCI_ERROR_INVALID_PARAMETERS;
+  }
+
+  /* Fail before taking a buffer, a busy link should not cost a pool allocation. */
+  if (priority > HCI_ACL_PRIORITY_ATT_RESPONSE && context->tx.queued >= HCI_ACL_LINK_QUEUE_LIMIT) {
+    return HCI_ERROR_BUSY;
+  }
+
+  uint8_t *data = NULL;
+  uint8_t index = HCI_ACL_reserve(&data);
+  if (index == HCI_ACL_NO_BUFFER) {
+    return HCI_ERROR_MEMORY_ALLOCATION_FAILED;
+  }
+
+  memcpy(data, payload, length);
+  return HCI_ACL_commit(connection_handle, cid, priority, index, length);
+}
+
+void HCI_ACL_schedule(void) {
+  /* Credits freed while sending are picked up on the next pass. */
+  uint8_t credits = HCI_ACL_get_free_credits();
+
+  while (credits > 0) {
+    ConnectionContext *context = select_next_connection();
+    if (!context) {
+      break;
+    }
+
+    if (send_fragment(context) != HCI_ERROR_SUCCESS) {
+      log_bl_error("ACL send failed on handle %d\r\n", context->connection_handle);
+      break;
+    }
+    credits--;
+  }
+}
+
+void HCI_ACL_handle_completed_packets(uint8_t *parameters, uint8_t parameter_length) {
+  if (parameter_length < 1) {
+    HCI_handle_error(HCI_ERROR_INVALID_PARAMETERS);
+    return;
+  }
+
+  uint8_t num_handles = parameters[0];
+  if (parameter_length < 1 + num_handles * 4) {
+    HCI_handle_error(HCI_ERROR_INVALID_PARAMETERS);
+    return;
+  }
+
+  for (uint8_t i = 0; i < num_handles; i++) {
+    uint8_t *entry = &parameters[1 + i * 4];
+    uint16_t connection_handle = (entry[0] | (entry[1] << 8)) & 0x0FFF;
+    uint16_t completed = entry[2] | (entry[3] << 8);
+
+    /* Packets of closed connections stopped counting against the credits when they closed. */
+    ConnectionContext *context = CONN_lookup(connection_handle);
+    if (!context) {
+      continue;
+    }
+
+    HCI_ACLQueue *queue = &context->tx;
+    uint8_t in_flight = packets_in_flight(queue);
+    queue->packets_completed += (completed > in_flight) ? in_flight : completed;
+  }
+}
+
+void HCI_ACL_flush(HCI_ACLQueue *queue) {
+  for (uint8_t p = 0; p < HCI_ACL_PRIORITY_COUNT; p++) {
+    uint8_t index = queue->head[p];
+    while (index != HCI_ACL_NO_BUFFER) {
+      uint8_t next = acl_pool[index].next;
+      buffer_free(index);
+      index = next;
+    }
+  }
+
+  if (queue->current != HCI_ACL_NO_BUFFER) {
+    buffer_free(queue->current);
+  }
+
+  HCI_ACL_queue_init(queue);
+}
+
+uint8_t HCI_ACL_get_free_credits(void) {
+  uint16_t in_use = 0;
+  for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+    ConnectionContext *context = CONN_get_slot(i);
+    if (context) {
+      in_use += packets_in_flight(&context->tx);
+    }
+  }
+  return (acl_total_credits > in_use) ? acl_total_credits - in_use : 0;
+}
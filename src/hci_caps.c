@@ -0,0 +1,199 @@
+#include "hci_caps.h"
+
+#include <string.h>
+
+#include "hardware_bl.h"
+#include "hci_acl.h"
+#include "log_bl.h"
+
+#define DISCOVERY_TIMEOUT_MS 1000
+
+typedef enum {
+  QUERY_COMMANDS = 0x01,
+  QUERY_LMP_FEATURES = 0x02,
+  QUERY_LE_FEATURES = 0x04,
+  QUERY_LE_STATES = 0x08,
+  QUERY_LE_BUFFER_SIZE = 0x10,
+  QUERY_BUFFER_SIZE = 0x20
+} CapsQuery;
+
+static const struct {
+  uint16_t op_code;
+  CapsQuery query;
+} queries[] = {
+  { CMD_BT_READ_LOCAL_SUPPORTED_COMMANDS, QUERY_COMMANDS },
+  { CMD_BT_READ_LOCAL_SUPPORTED_FEATURES, QUERY_LMP_FEATURES },
+  { CMD_BLE_READ_LOCAL_SUPPORTED_FEATURES, QUERY_LE_FEATURES },
+  { CMD_BLE_READ_SUPPORTED_STATES, QUERY_LE_STATES },
+  { CMD_BLE_READ_BUFFER_SIZE, QUERY_LE_BUFFER_SIZE },
+};
+
+static HCICapabilities caps;
+
+/* CapsQuery bits sent and not yet answered */
+static volatile uint8_t pending = 0;
+
+static uint64_t read_le64(uint8_t *data) {
+  uint64_t value = 0;
+  for (uint8_t i = 0; i < 8; i++) {
+    value |= (uint64_t)data[i] << (8 * i);
+  }
+  return value;
+}
+
+static HCIError send_query(uint16_t op_code, CapsQuery query) {
+  /* Pipeline only as deep as the controller allows. */
+  uint64_t start_ms = hw_get_time_ms();
+  while (HCI_get_command_credits() == 0) {
+    if (hw_get_time_ms() - start_ms > DISCOVERY_TIMEOUT_MS) {
+      return HCI_ERROR_COMMAND_TIMEOUT;
+    }
+  }
+
+  HCICommand cmd = { .op_code.raw = op_code, .parameter_length = 0, .parameters = NULL };
+
+  pending |= query;
+  HCIError status = HCI_send_command_async(&cmd);
+  if (status != HCI_ERROR_SUCCESS) {
+    pending &= ~query;
+  }
+  return status;
+}
+
+static HCIError wait_for_answers(void) {
+  uint64_t start_ms = hw_get_time_ms();
+  while (pending != 0) {
+    if (hw_get_time_ms() - start_ms > DISCOVERY_TIMEOUT_MS) {
+      pending = 0;
+      return HCI_ERROR_COMMAND_TIMEOUT;
+    }
+  }
+  return HCI_ERROR_SUCCESS;
+}
+
+HCIError HCI_CAPS_discover(void) {
+  memset(&caps, 0, sizeof(caps));
+
+  for (uint8_t i = 0; i < sizeof(queries) / sizeof(queries[0]); i++) {
+    HCIError status = send_query(queries[i].op_code, queries[i].query);
+    if (status != HCI_ERROR_SUCCESS) {
+      return status;
+    }
+  }
+
+  HCIError status = wait_for_answers();
+  if (status != HCI_ERROR_SUCCESS) {
+    return status;
+  }
+
+  /* A zero LE buffer size means LE traffic uses the shared BR/EDR buffers. */
+  if (caps.le_acl_data_length == 0 || caps.le_acl_num_packets == 0) {
+    status = send_query(CMD_BT_READ_BUFFER_SIZE, QUERY_BUFFER_SIZE);
+    if (status == HCI_ERROR_SUCCESS) {
+      status = wait_for_answers();
+    }
+    if (status != HCI_ERROR_SUCCESS) {
+      return status;
+    }
+  }
+
+  HCI_ACL_set_buffer_size(caps.le_acl_data_length, caps.le_acl_num_packets);
+  caps.valid = true;
+
+  log_bl_debug("LE features 0x%x, ACL buffers %d x %d\r\n", (uint32_t)caps.le_features, caps.le_acl_num_packets,
+               caps.le_acl_data_length);
+  return HCI_ERROR_SUCCESS;
+}
+
+bool HCI_CAPS_handle_command_complete(uint16_t op_code, uint8_t status, uint8_t *return_parameters, uint8_t length) {
+  CapsQuery query;
+  switch (op_code) {
+    case CMD_BT_READ_LOCAL_SUPPORTED_COMMANDS:
+      query = QUERY_COMMANDS;
+      break;
+    case CMD_BT_READ_LOCAL_SUPPORTED_FEATURES:
+      query = QUERY_LMP_FEATURES;
+      break;
+    case CMD_BLE_READ_LOCAL_SUPPORTED_FEATURES:
+      query = QUERY_LE_FEATURES;
+      break;
+    case CMD_BLE_READ_SUPPORTED_STATES:
+      query = QUERY_LE_STATES;
+      break;
+    case CMD_BLE_READ_BUFFER_SIZE:
+      query = QUERY_LE_BUFFER_SIZE;
+      break;
+    case CMD_BT_READ_BUFFER_SIZE:
+      query = QUERY_BUFFER_SIZE;
+      break;
+    default:
+      return false;
+  }
+
+  if (!(pending & query)) {
+    return false;
+  }
+
+  /* A failed query leaves its part of the cache zeroed, i.e. nothing supported. */
+  if (status == HCI_ERROR_SUCCESS) {
+    switch (query) {
+      case QUERY_COMMANDS:
+        if (length >= sizeof(caps.commands)) {
+          memcpy(caps.commands, return_parameters, sizeof(caps.commands));
+        }
+        break;
+      case QUERY_LMP_FEATURES:
+        if (length >= sizeof(caps.lmp_features)) {
+          memcpy(caps.lmp_features, return_parameters, sizeof(caps.lmp_features));
+        }
+        break;
+      case QUERY_LE_FEATURES:
+        if (length >= 8) {
+          caps.le_features = read_le64(return_parameters);
+        }
+        break;
+      case QUERY_LE_STATES:
+        if (length >= 8) {
+          caps.le_states = read_le64(return_parameters);
+        }
+        break;
+      case QUERY_LE_BUFFER_SIZE:
+        if (length >= 3) {
+          caps.le_acl_data_length = return_parameters[0] | (return_parameters[1] << 8);
+          caps.le_acl_num_packets = return_parameters[2];
+        }
+        break;
+      case QUERY_BUFFER_SIZE:
+        /* ACL data packet length (2), SCO length (1), total ACL packets (2) */
+        if (length >= 5) {
+          caps.le_acl_data_length = return_parameters[0] | (return_parameters[1] << 8);
+          uint16_t num_packets = return_parameters[3] | (return_parameters[4] << 8);
+          caps.le_acl_num_packets = (num_packets > UINT8_MAX) ? UINT8_MAX : num_packets;
+        }
+        break;
+    }
+  }
+
+  pending &= ~query;
+  return true;
+}
+
+bool HCI_CAPS_command_supported(uint16_t command) {
+  return (command >> 3) < sizeof(caps.commands) && (caps.commands[command >> 3] >> (command & 0x07)) & 0x01;
+}
+
+bool HCI_CAPS_lmp_feature_supported(uint16_t feature) {
+  return (feature >> 3) < sizeof(caps.lmp_features) && (caps.lmp_features[feature >> 3] >> (feature & 0x07)) & 0x01;
+}
+
+bool HCI_CAPS_le_feature_supported(HCI_LEFeature feature) {
+  return (caps.le_features >> feature) & 0x01;
+}
+
+bool HCI_CAPS_le_state_supported(uint8_t state) {
+  return state < 64 && ((caps.le_states >> state) & 0x01);
+}
+
+const HCICapabilities *HCI_CAPS_get(void) {
+  return &caps;
+}
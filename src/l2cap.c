@@ -0,0 +1,240 @@
+#include "l2cap.h"
+
+#include <string.h>
+
+#include "connection.h"
+#include "gatt.h"
+#include "link_setup.h"
+#include "log_bl.h"
+
+/* A complete inbound PDU, without its basic header */
+typedef struct {
+  uint16_t connection_handle;
+  uint16_t cid;
+  uint16_t length;
+  uint8_t payload[L2CAP_MAX_PDU_SIZE - L2CAP_HEADER_SIZE];
+} L2CAPRxPDU;
+
+/* PDUs travel from the RX interrupt to L2CAP_process through this ring. The interrupt only advances
+ * rx_head, the main loop only rx_tail, and one slot stays empty to tell a full ring from an empty one. */
+static L2CAPRxPDU rx_queue[L2CAP_RX_QUEUE_SIZE + 1];
+static volatile uint8_t rx_head = 0;
+static volatile uint8_t rx_tail = 0;
+
+/***************************************************************************************
+ * LE signaling channel
+ **************************************************************************************/
+
+static HCIError l2cap_send_signaling(ConnectionContext *context, uint8_t code, uint8_t identifier, uint8_t *data,
+                                     uint8_t length) {
+  uint8_t packet[L2CAP_SIG_HEADER_SIZE + 8];
+  if (length > sizeof(packet) - L2CAP_SIG_HEADER_SIZE) {
+    return HCI_ERROR_INVALID_PARAMETERS;
+  }
+
+  packet[0] = code;
+  packet[1] = identifier;
+  packet[2] = length;
+  packet[3] = 0;
+  memcpy(&packet[L2CAP_SIG_HEADER_SIZE], data, length);
+
+  return HCI_ACL_enqueue(context->connection_handle, L2CAP_LE_SIGNALING_CID, HCI_ACL_PRIORITY_SIGNALING, packet,
+                         L2CAP_SIG_HEADER_SIZE + length);
+}
+
+static void l2cap_reject_command(ConnectionContext *context, uint8_t identifier) {
+  uint8_t reason[2] = { L2CAP_REJECT_COMMAND_NOT_UNDERSTOOD & 0xFF, (L2CAP_REJECT_COMMAND_NOT_UNDERSTOOD >> 8) & 0xFF };
+  l2cap_send_signaling(context, L2CAP_SIG_COMMAND_REJECT, identifier, reason, sizeof(reason));
+}
+
+static void l2cap_handle_conn_param_update_request(ConnectionContext *context, uint8_t identifier, uint8_t *data,
+                                                   uint16_t length) {
+  /* Only the central can change the parameters, a peripheral never receives this request. */
+  if (context->role != CONN_ROLE_CENTRAL || length < 8) {
+    l2cap_reject_command(context, identifier);
+    return;
+  }
+
+  GAPConnectionParameters params = {
+    .interval_min = data[0] | (data[1] << 8),
+    .interval_max = data[2] | (data[3] << 8),
+    .latency = data[4] | (data[5] << 8),
+    .supervision_timeout = data[6] | (data[7] << 8),
+  };
+
+  bool accepted = GAP_handle_connection_parameter_request(context->connection_handle, &params);
+
+  uint16_t result = accepted ? L2CAP_CONN_PARAM_ACCEPTED : L2CAP_CONN_PARAM_REJECTED;
+  uint8_t response[2] = { result & 0xFF, (result >> 8) & 0xFF };
+  l2cap_send_signaling(context, L2CAP_SIG_CONN_PARAM_UPDATE_RESPONSE, identifier, response, sizeof(response));
+
+  /* CONN_PARAMS_process sends the update once a command credit is free. */
+  if (accepted) {
+    context->peer_request.accepted = params;
+    context->peer_request.update_pending = true;
+  }
+}
+
+static void l2cap_handle_signaling(ConnectionContext *context, uint8_t *payload, uint16_t length) {
+  /* An LE signaling PDU carries exactly one command. */
+  if (length < L2CAP_SIG_HEADER_SIZE) {
+    return;
+  }
+
+  uint8_t code = payload[0];
+  uint8_t identifier = payload[1];
+  uint16_t data_length = payload[2] | (payload[3] << 8);
+  uint8_t *data = &payload[L2CAP_SIG_HEADER_SIZE];
+
+  if (data_length > length - L2CAP_SIG_HEADER_SIZE) {
+    return;
+  }
+
+  switch (code) {
+    case L2CAP_SIG_CONN_PARAM_UPDATE_REQUEST:
+      l2cap_handle_conn_param_update_request(context, identifier, data, data_length);
+      break;
+
+    case L2CAP_SIG_COMMAND_REJECT:
+    case L2CAP_SIG_CONN_PARAM_UPDATE_RESPONSE:
+      /* Our only request is the parameter update. Accepted, it completes with the LE connection update event. */
+      if (identifier == context->signaling_identifier) {
+        bool accepted = code == L2CAP_SIG_CONN_PARAM_UPDATE_RESPONSE && data_length >= 2 &&
+                        (data[0] | (data[1] << 8)) == L2CAP_CONN_PARAM_ACCEPTED;
+        if (!accepted) {
+          LINK_complete(context->connection_handle, LINK_PROC_CONN_PARAMS);
+        }
+      }
+      break;
+
+    default:
+      l2cap_reject_command(context, identifier);
+      break;
+  }
+}
+
+HCIError L2CAP_request_connection_parameter_update(uint16_t connection_handle, GAPConnectionParameters *params) {
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (!context || !params || context->role != CONN_ROLE_PERIPHERAL) {
+    return HCI_ERROR_INVALID_PARAMETERS;
+  }
+
+  uint8_t request[8] = {
+    params->interval_min & 0xFF,        (params->interval_min >> 8) & 0xFF,
+    params->interval_max & 0xFF,        (params->interval_max >> 8) & 0xFF,
+    params->latency & 0xFF,             (params->latency >> 8) & 0xFF,
+    params->supervision_timeout & 0xFF, (params->supervision_timeout >> 8) & 0xFF,
+  };
+
+  if (++context->signaling_identifier == 0) {
+    context->signaling_identifier = 1;
+  }
+
+  return l2cap_send_signaling(context, L2CAP_SIG_CONN_PARAM_UPDATE_REQUEST, context->signaling_identifier, request,
+                              sizeof(request));
+}
+
+/***************************************************************************************
+ * PDU dispatch and reassembly
+ **************************************************************************************/
+
+static void l2cap_queue(ConnectionContext *context, uint16_t cid, const uint8_t *payload, uint16_t length) {
+  uint8_t next = (rx_head + 1) % (L2CAP_RX_QUEUE_SIZE + 1);
+  if (next == rx_tail) {
+    log_bl_warning("L2CAP RX queue full, PDU dropped on handle %d\r\n", context->connection_handle);
+    return;
+  }
+
+  L2CAPRxPDU *pdu = &rx_queue[rx_head];
+  pdu->connection_handle = context->connection_handle;
+  pdu->cid = cid;
+  pdu->length = length;
+  memcpy(pdu->payload, payload, length);
+  rx_head = next;
+}
+
+static void l2cap_dispatch(ConnectionContext *context, uint16_t cid, uint8_t *payload, uint16_t length) {
+  switch (cid) {
+    case L2CAP_ATT_CID:
+      GATT_process_att_packet(context->connection_handle, payload, length);
+      break;
+
+    case L2CAP_LE_SIGNALING_CID:
+      l2cap_handle_signaling(context, payload, length);
+      break;
+
+    default:
+      log_bl_debug("L2CAP PDU on unsupported CID 0x%x dropped\r\n", cid);
+      break;
+  }
+}
+
+void L2CAP_handle_acl_data(HCIAsyncData *data) {
+  if (!data || !data->data) {
+    return;
+  }
+
+  ConnectionContext *context = CONN_lookup(data->connection_handle);
+  if (!context) {
+    return;
+  }
+
+  L2CAPReassembly *rx = &context->l2cap_rx;
+  context->traffic.rx_bytes += data->data_total_length;
+
+  if (data->pb_flag != L2CAP_PB_CONTINUING_FRAGMENT) {
+    if (rx->received != 0) {
+      log_bl_warning("Incomplete L2CAP PDU dropped on handle %d\r\n", context->connection_handle);
+    }
+    rx->received = 0;
+    rx->expected = 0;
+
+    /* Common case: the whole PDU fits in one ACL packet, queue it without reassembling. */
+    if (data->data_total_length >= L2CAP_HEADER_SIZE) {
+      uint16_t length = data->data[0] | (data->data[1] << 8);
+      if (length + L2CAP_HEADER_SIZE == data->data_total_length) {
+        uint16_t cid = data->data[2] | (data->data[3] << 8);
+        l2cap_queue(context, cid, &data->data[L2CAP_HEADER_SIZE], length);
+        return;
+      }
+    }
+  } else if (rx->received == 0) {
+    /* Continuation without a start fragment. */
+    return;
+  }
+
+  if (rx->received + data->data_total_length > sizeof(rx->buffer)) {
+    log_bl_warning("Oversized L2CAP PDU dropped on handle %d\r\n", context->connection_handle);
+    rx->received = 0;
+    rx->expected = 0;
+    return;
+  }
+
+  memcpy(&rx->buffer[rx->received], data->data, data->data_total_length);
+  rx->received += data->data_total_length;
+
+  if (rx->expected == 0 && rx->received >= L2CAP_HEADER_SIZE) {
+    rx->expected = (rx->buffer[0] | (rx->buffer[1] << 8)) + L2CAP_HEADER_SIZE;
+  }
+
+  if (rx->expected != 0 && rx->received >= rx->expected) {
+    uint16_t cid = rx->buffer[2] | (rx->buffer[3] << 8);
+    uint16_t length = rx->expected - L2CAP_HEADER_SIZE;
+    rx->received = 0;
+    rx->expected = 0;
+    l2cap_queue(context, cid, &rx->buffer[L2CAP_HEADER_SIZE], length);
+  }
+}
+
+void L2CAP_process(void) {
+  while (rx_tail != rx_head) {
+    L2CAPRxPDU *pdu = &rx_queue[rx_tail];
+
+    /* The connection may have closed while the PDU waited. */
+    ConnectionContext *context = CONN_lookup(pdu->connection_handle);
+    if (context) {
+      l2cap_dispatch(context, pdu->cid, pdu->payload, pdu->length);
+    }
+    rx_tail = (rx_tail + 1) % (L2CAP_RX_QUEUE_SIZE + 1);
+  }
+}
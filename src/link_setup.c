@@ -0,0 +1,148 @@
+#include "link_setup.h"
+
+#include <stddef.h>
+
+#include "connection.h"
+#include "gatt.h"
+#include "hci_caps.h"
+#include "hardware_bl.h"
+#include "l2cap.h"
+#include "log_bl.h"
+
+static uint16_t preferred_mtu = BT_ATT_PREFERRED_MTU;
+static GAPConnectionParameters preferred_params;
+static bool preferred_params_set = false;
+
+static void link_ready(ConnectionContext *context) {
+  context->link_setup.pending = 0;
+  context->link_setup.unsent = 0;
+  GAP_handle_link_ready(context->connection_handle);
+}
+
+/* Data length, PHY and the central's connection update are HCI commands. The controller grants a single
+ * command credit, so each waits for the Command Complete or Status of the one before. */
+static bool needs_command_credit(ConnectionContext *context, LinkProcedure procedure) {
+  return procedure == LINK_PROC_DATA_LENGTH || procedure == LINK_PROC_PHY ||
+         (procedure == LINK_PROC_CONN_PARAMS && context->role == CONN_ROLE_CENTRAL);
+}
+
+static bool send_request(ConnectionContext *context, LinkProcedure procedure) {
+  uint16_t connection_handle = context->connection_handle;
+  uint16_t data_length = HCI_BLE_get_suggested_data_length();
+
+  switch (procedure) {
+    case LINK_PROC_MTU:
+      /* Fails if the application already issued an ATT request from its GAP_EVENT_CONNECTED callback. */
+      return GATT_exchange_mtu(connection_handle, preferred_mtu) == GATT_ERROR_SUCCESS;
+    case LINK_PROC_DATA_LENGTH:
+      return HCI_BLE_set_data_length_async(connection_handle, data_length, LE_1M_PDU_TIME(data_length)) ==
+             HCI_ERROR_SUCCESS;
+    case LINK_PROC_PHY:
+      return HCI_BLE_set_phy_async(connection_handle, context->preferred_phys, context->preferred_phys) ==
+             HCI_ERROR_SUCCESS;
+    case LINK_PROC_CONN_PARAMS:
+      if (context->role == CONN_ROLE_CENTRAL) {
+        return HCI_BLE_connection_update_async(connection_handle, preferred_params.interval_min,
+                                               preferred_params.interval_max, preferred_params.latency,
+                                               preferred_params.supervision_timeout) == HCI_ERROR_SUCCESS;
+      }
+      return L2CAP_request_connection_parameter_update(connection_handle, &preferred_params) == HCI_ERROR_SUCCESS;
+    default:
+      return false;
+  }
+}
+
+static void send_requests(ConnectionContext *context) {
+  for (uint8_t procedure = LINK_PROC_MTU; procedure <= LINK_PROC_CONN_PARAMS; procedure <<= 1) {
+    if (!(context->link_setup.unsent & procedure) ||
+        (needs_command_credit(context, procedure) && HCI_get_command_credits() == 0)) {
+      continue;
+    }
+
+    context->link_setup.unsent &= ~procedure;
+    if (!send_request(context, procedure)) {
+      LINK_complete(context->connection_handle, procedure);
+    }
+  }
+}
+
+void LINK_set_preferred_mtu(uint16_t mtu) {
+  preferred_mtu = mtu;
+}
+
+void LINK_set_preferred_connection_parameters(GAPConnectionParameters *params) {
+  if (params) {
+    preferred_params = *params;
+  }
+  preferred_params_set = (params != NULL);
+}
+
+void LINK_start(uint16_t connection_handle) {
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (!context) {
+    return;
+  }
+
+  uint8_t pending = 0;
+
+  /* None of the procedures depends on another. The requests go out from LINK_process, this runs from the
+   * RX interrupt and must not compete with the main loop for the UART or the command credit. */
+  if (preferred_mtu > ATT_DEFAULT_MTU) {
+    pending |= LINK_PROC_MTU;
+  }
+
+  if (HCI_BLE_get_suggested_data_length() > CONN_DEFAULT_DATA_LENGTH) {
+    pending |= LINK_PROC_DATA_LENGTH;
+  }
+
+  /* Peers without 2M support answer the LL procedure by staying on 1M. */
+  if (context->preferred_phys != PHY_PREFER_LE_1M && HCI_CAPS_command_supported(HCI_CAPS_CMD_LE_SET_PHY)) {
+    pending |= LINK_PROC_PHY;
+  }
+
+  if (preferred_params_set) {
+    pending |= LINK_PROC_CONN_PARAMS;
+  }
+
+  context->link_setup.pending = pending;
+  context->link_setup.unsent = pending;
+  context->link_setup.started_ms = hw_get_time_ms();
+
+  if (pending == 0) {
+    link_ready(context);
+  }
+}
+
+void LINK_complete(uint16_t connection_handle, LinkProcedure procedure) {
+  ConnectionContext *context = CONN_lookup(connection_handle);
+  if (!context || !(context->link_setup.pending & procedure)) {
+    return;
+  }
+
+  context->link_setup.pending &= ~procedure;
+  if (context->link_setup.pending == 0) {
+    link_ready(context);
+  }
+}
+
+void LINK_process(void) {
+  uint64_t now_ms = hw_get_time_ms();
+
+  for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+    ConnectionContext *context = CONN_get_slot(i);
+    if (!context || context->link_setup.pending == 0) {
+      continue;
+    }
+
+    send_requests(context);
+    if (context->link_setup.pending == 0) {
+      continue;
+    }
+
+    if (now_ms - context->link_setup.started_ms >= BT_LINK_SETUP_TIMEOUT_MS) {
+      log_bl_warning("Link bring-up on handle %d timed out, pending 0x%x\r\n", context->connection_handle,
+                     context->link_setup.pending);
+      link_ready(context);
+    }
+  }
+}
@@ -0,0 +1,201 @@
+#include "scan_cache.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "hardware_bl.h"
+#include "hci_defs.h"
+
+#define SLOT_MASK (SCAN_CACHE_SIZE - 1)
+
+/* Slots checked for stale entries per report, so aging costs O(1) and needs no timer. */
+#define AGING_SLOTS_PER_UPDATE 2
+
+/* Smoothed RSSI keeps 4 fraction bits and moves 1/4 of the way towards each new sample. */
+#define RSSI_FRACTION_BITS 4
+#define RSSI_SMOOTHING_SHIFT 2
+#define RSSI_FILTER_EMPTY INT16_MIN
+
+#define FNV_OFFSET_BASIS 0x811C9DC5u
+#define FNV_PRIME 0x01000193u
+
+static ScanCacheEntry entries[SCAN_CACHE_SIZE];
+static uint16_t used_count = 0;
+static uint16_t aging_cursor = 0;
+
+static uint16_t home_slot(uint8_t addr_type, const uint8_t *addr) {
+  /* The low address bytes are the most random part of both public and random addresses. */
+  uint32_t key = addr[0] | (addr[1] << 8) | (addr[2] << 16) | ((uint32_t)(addr[3] ^ addr_type) << 24);
+  key ^= (addr[4] | (addr[5] << 8)) * 0x9E37u;
+  return (uint16_t)((key * 0x9E3779B1u) >> 24) & SLOT_MASK;
+}
+
+static uint32_t payload_hash(const uint8_t *data, uint16_t data_len) {
+  uint32_t hash = FNV_OFFSET_BASIS;
+  for (uint16_t i = 0; i < data_len; i++) {
+    hash = (hash ^ data[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+static bool entry_matches(ScanCacheEntry *entry, uint8_t addr_type, const uint8_t *addr) {
+  return entry->addr_type == addr_type && memcmp(entry->addr, addr, 6) == 0;
+}
+
+static bool entry_stale(ScanCacheEntry *entry, uint64_t now_ms) {
+  return now_ms - entry->last_seen_ms >= BT_SCAN_CACHE_MAX_AGE_MS;
+}
+
+/* Backward-shift deletion: pull later members of the probe cluster into the hole so lookups never
+ * need tombstones. The hole is always marked free, so the walk ends even when the table was full. */
+static void remove_slot(uint16_t slot) {
+  uint16_t hole = slot;
+  uint16_t next = (slot + 1) & SLOT_MASK;
+  entries[hole].used = false;
+
+  while (entries[next].used) {
+    uint16_t home = home_slot(entries[next].addr_type, entries[next].addr);
+    /* The entry may move into the hole only if the hole lies on its probe path. */
+    if (((next - home) & SLOT_MASK) >= ((next - hole) & SLOT_MASK)) {
+      entries[hole] = entries[next];
+      entries[next].used = false;
+      hole = next;
+    }
+    next = (next + 1) & SLOT_MASK;
+  }
+
+  used_count--;
+}
+
+static void age_entries(uint64_t now_ms) {
+  for (uint8_t i = 0; i < AGING_SLOTS_PER_UPDATE; i++) {
+    ScanCacheEntry *entry = &entries[aging_cursor];
+    if (entry->used && entry_stale(entry, now_ms)) {
+      /* The shift may move an unchecked entry into this slot, look at it again next time. */
+      remove_slot(aging_cursor);
+    } else {
+      aging_cursor = (aging_cursor + 1) & SLOT_MASK;
+    }
+  }
+}
+
+static void entry_init(ScanCacheEntry *entry, uint8_t addr_type, const uint8_t *addr) {
+  entry->used = true;
+  entry->addr_type = addr_type;
+  memcpy(entry->addr, addr, 6);
+  entry->rssi = SCAN_CACHE_RSSI_UNAVAILABLE;
+  entry->rssi_filtered = RSSI_FILTER_EMPTY;
+  entry->adv_hash = 0;
+  entry->rsp_hash = 0;
+}
+
+static void update_rssi(ScanCacheEntry *entry, int8_t rssi) {
+  entry->rssi = rssi;
+  if (rssi == SCAN_CACHE_RSSI_UNAVAILABLE) {
+    return;
+  }
+
+  int16_t sample = (int16_t)(rssi * (1 << RSSI_FRACTION_BITS));
+  if (entry->rssi_filtered == RSSI_FILTER_EMPTY) {
+    entry->rssi_filtered = sample;
+  } else {
+    entry->rssi_filtered += (sample - entry->rssi_filtered) / (1 << RSSI_SMOOTHING_SHIFT);
+  }
+}
+
+void SCAN_CACHE_clear(void) {
+  memset(entries, 0, sizeof(entries));
+  used_count = 0;
+  aging_cursor = 0;
+}
+
+uint8_t SCAN_CACHE_update(uint8_t addr_type, const uint8_t *addr, uint8_t event_type, const uint8_t *data,
+                          uint16_t data_len, int8_t rssi, const ScanCacheEntry **entry) {
+  uint64_t now_ms = hw_get_time_ms();
+  age_entries(now_ms);
+
+  uint8_t changes = SCAN_CACHE_REPORT;
+  uint16_t slot = home_slot(addr_type, addr);
+  ScanCacheEntry *found = NULL;
+  ScanCacheEntry *oldest = NULL;
+
+  for (uint16_t probes = 0; probes < SCAN_CACHE_SIZE; probes++) {
+    ScanCacheEntry *candidate = &entries[slot];
+    if (!candidate->used) {
+      entry_init(candidate, addr_type, addr);
+      used_count++;
+      changes |= SCAN_CACHE_NEW_DEVICE;
+      found = candidate;
+      break;
+    }
+    if (entry_matches(candidate, addr_type, addr)) {
+      if (entry_stale(candidate, now_ms)) {
+        entry_init(candidate, addr_type, addr);
+        changes |= SCAN_CACHE_NEW_DEVICE;
+      }
+      found = candidate;
+      break;
+    }
+    if (!oldest || candidate->last_seen_ms < oldest->last_seen_ms) {
+      oldest = candidate;
+    }
+    slot = (slot + 1) & SLOT_MASK;
+  }
+
+  /* Table full: every slot between the home slot and the oldest entry is in use, so the new
+   * advertiser stays reachable in its place. */
+  if (!found) {
+    found = oldest;
+    entry_init(found, addr_type, addr);
+    changes |= SCAN_CACHE_NEW_DEVICE;
+  }
+
+  uint32_t hash = payload_hash(data, data_len);
+  bool scan_rsp = event_type == SCAN_REPORT_SCAN_RSP || event_type == SCAN_REPORT_EXT_SCAN_RSP;
+  uint32_t *stored_hash = scan_rsp ? &found->rsp_hash : &found->adv_hash;
+  /* A zero hash means nothing of this kind arrived yet, so the first scan response of a known device
+   * counts as a change too. */
+  if (*stored_hash != hash) {
+    if (!(changes & SCAN_CACHE_NEW_DEVICE)) {
+      changes |= SCAN_CACHE_PAYLOAD_CHANGED;
+    }
+    *stored_hash = hash;
+  }
+
+  update_rssi(found, rssi);
+  found->last_seen_ms = now_ms;
+
+  if (entry) {
+    *entry = found;
+  }
+  return changes;
+}
+
+const ScanCacheEntry *SCAN_CACHE_lookup(uint8_t addr_type, const uint8_t *addr) {
+  if (!addr) {
+    return NULL;
+  }
+
+  uint64_t now_ms = hw_get_time_ms();
+  uint16_t slot = home_slot(addr_type, addr);
+
+  for (uint16_t probes = 0; probes < SCAN_CACHE_SIZE && entries[slot].used; probes++) {
+    if (entry_matches(&entries[slot], addr_type, addr)) {
+      return entry_stale(&entries[slot], now_ms) ? NULL : &entries[slot];
+    }
+    slot = (slot + 1) & SLOT_MASK;
+  }
+  return NULL;
+}
+
+int8_t SCAN_CACHE_get_smoothed_rssi(const ScanCacheEntry *entry) {
+  if (!entry || entry->rssi_filtered == RSSI_FILTER_EMPTY) {
+    return SCAN_CACHE_RSSI_UNAVAILABLE;
+  }
+  /* Round to nearest, the arithmetic shift of negative values would round towards -inf. */
+  return (int8_t)((entry->rssi_filtered + (1 << (RSSI_FRACTION_BITS - 1))) >> RSSI_FRACTION_BITS);
+}
+
+uint16_t SCAN_CACHE_count(void) {
+  return used_count;
+}